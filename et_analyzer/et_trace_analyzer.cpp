@@ -0,0 +1,530 @@
+#include "et_analyzer/et_trace_analyzer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "et_feeder/et_feeder_node.h"
+#include "et_feeder/et_iteration_fold.h"
+#include "et_feeder/et_trace_index.h"
+#include "third_party/utils/protoio.hh"
+
+using namespace std;
+using namespace Chakra;
+
+// Chunks per thread an indexed trace is split into, so that chunks of
+// different cost even out
+static const uint64_t kChunksPerThread = 4;
+static const uint32_t kMissingNode = UINT32_MAX;
+
+namespace {
+
+// What the analysis keeps of consecutive nodes of a trace
+struct TraceChunk {
+  vector<uint64_t> ids;
+  vector<uint64_t> runtimes;
+  // Parent IDs of node i are parent_ids[parents_end[i - 1], parents_end[i])
+  vector<uint64_t> parents_end;
+  vector<uint64_t> parent_ids;
+  ETTraceSummary summary;
+};
+
+} // namespace
+
+static ETTraceBreakdown& breakdown(
+    vector<ETTraceBreakdown>& breakdowns,
+    size_t index) {
+  if (index >= breakdowns.size()) {
+    breakdowns.resize(index + 1);
+  }
+  return breakdowns[index];
+}
+
+static void addNode(
+    TraceChunk& chunk,
+    const ChakraProtoMsg::Node& node,
+    const ETFeederNodeAttrs& attrs,
+    vector<uint64_t>& node_parent_ids) {
+  chunk.ids.push_back(node.id());
+  chunk.runtimes.push_back(node.duration_micros());
+  // Data and control edges are handled alike; a parent listed more than
+  // once (or under both kinds) counts once
+  node_parent_ids.assign(node.data_deps().begin(), node.data_deps().end());
+  node_parent_ids.insert(
+      node_parent_ids.end(), node.ctrl_deps().begin(), node.ctrl_deps().end());
+  sort(node_parent_ids.begin(), node_parent_ids.end());
+  node_parent_ids.erase(
+      unique(node_parent_ids.begin(), node_parent_ids.end()),
+      node_parent_ids.end());
+  chunk.parent_ids.insert(
+      chunk.parent_ids.end(), node_parent_ids.begin(), node_parent_ids.end());
+  chunk.parents_end.push_back(chunk.parent_ids.size());
+
+  ETTraceSummary& summary = chunk.summary;
+  ++summary.num_nodes;
+  summary.total_runtime += node.duration_micros();
+  bool is_comm = (node.type() == ChakraProtoMsg::COMM_SEND_NODE) ||
+      (node.type() == ChakraProtoMsg::COMM_RECV_NODE) ||
+      (node.type() == ChakraProtoMsg::COMM_COLL_NODE);
+  uint64_t bytes = is_comm ? attrs.comm_size : attrs.tensor_size;
+  ETTraceBreakdown& node_type = breakdown(summary.node_types, node.type());
+  ++node_type.count;
+  node_type.runtime += node.duration_micros();
+  node_type.bytes += bytes;
+  if (node.type() == ChakraProtoMsg::COMM_COLL_NODE) {
+    ETTraceBreakdown& comm_type =
+        breakdown(summary.comm_types, attrs.comm_type);
+    ++comm_type.count;
+    comm_type.runtime += node.duration_micros();
+    comm_type.bytes += bytes;
+  }
+}
+
+static void readGlobalMetadata(
+    ProtoInputStream& trace,
+    const string& filename,
+    ChakraProtoMsg::GlobalMetadata& metadata) {
+  if (!trace.is_open()) {
+    throw runtime_error("Failed to open trace file: " + filename);
+  }
+  if (!trace.read(metadata)) {
+    throw runtime_error("Failed to read global metadata: " + filename);
+  }
+}
+
+// Critical path, depths, and dependency counts of the whole trace
+static void analyzeGraph(const TraceChunk& trace, ETTraceSummary& summary) {
+  uint64_t num_nodes = trace.ids.size();
+  unordered_map<uint64_t, uint32_t> index;
+  index.reserve(num_nodes);
+  for (uint64_t i = 0; i < num_nodes; ++i) {
+    index.emplace(trace.ids[i], i);
+  }
+
+  vector<uint32_t> parents(trace.parent_ids.size());
+  vector<uint32_t> num_parents(num_nodes, 0);
+  bool forward_deps = false;
+  uint64_t parents_begin = 0;
+  for (uint64_t child = 0; child < num_nodes; ++child) {
+    for (uint64_t i = parents_begin; i < trace.parents_end[child]; ++i) {
+      auto parent = index.find(trace.parent_ids[i]);
+      if (parent == index.end()) {
+        parents[i] = kMissingNode;
+        ++summary.missing_deps;
+        continue;
+      }
+      parents[i] = parent->second;
+      ++num_parents[child];
+      ++summary.num_deps;
+      forward_deps = forward_deps || (parent->second >= child);
+    }
+    parents_begin = trace.parents_end[child];
+  }
+  index.clear();
+
+  // Traces list parents before their children as a rule, then the trace
+  // order is a topological order already
+  vector<uint32_t> order;
+  order.reserve(num_nodes);
+  if (!forward_deps) {
+    for (uint64_t i = 0; i < num_nodes; ++i) {
+      order.push_back(i);
+    }
+  } else {
+    vector<uint64_t> children_begin(num_nodes + 1, 0);
+    for (uint32_t parent : parents) {
+      if (parent != kMissingNode) {
+        ++children_begin[parent + 1];
+      }
+    }
+    for (uint64_t i = 0; i < num_nodes; ++i) {
+      children_begin[i + 1] += children_begin[i];
+    }
+    vector<uint32_t> children(children_begin.back());
+    vector<uint64_t> next_child(
+        children_begin.begin(), children_begin.end() - 1);
+    parents_begin = 0;
+    for (uint64_t child = 0; child < num_nodes; ++child) {
+      for (uint64_t i = parents_begin; i < trace.parents_end[child]; ++i) {
+        if (parents[i] != kMissingNode) {
+          children[next_child[parents[i]]++] = child;
+        }
+      }
+      parents_begin = trace.parents_end[child];
+    }
+    vector<uint32_t> num_unvisited_parents = num_parents;
+    for (uint64_t i = 0; i < num_nodes; ++i) {
+      if (num_unvisited_parents[i] == 0) {
+        order.push_back(i);
+      }
+    }
+    for (uint64_t next = 0; next < order.size(); ++next) {
+      uint32_t node = order[next];
+      for (uint64_t i = children_begin[node]; i < children_begin[node + 1];
+           ++i) {
+        if (--num_unvisited_parents[children[i]] == 0) {
+          order.push_back(children[i]);
+        }
+      }
+    }
+  }
+  summary.cyclic_nodes = num_nodes - order.size();
+
+  // Finish time of the longest path ending at every node, the number of
+  // nodes on it, and the depth of every node
+  vector<uint64_t> finish(num_nodes, 0);
+  vector<uint64_t> path_nodes(num_nodes, 0);
+  vector<uint64_t> depth(num_nodes, 0);
+  for (uint32_t node : order) {
+    uint64_t node_parents_begin = (node == 0) ? 0 : trace.parents_end[node - 1];
+    uint64_t start = 0;
+    uint64_t start_path_nodes = 0;
+    uint64_t node_depth = 0;
+    for (uint64_t i = node_parents_begin; i < trace.parents_end[node]; ++i) {
+      uint32_t parent = parents[i];
+      if (parent == kMissingNode) {
+        continue;
+      }
+      if ((finish[parent] > start) ||
+          ((finish[parent] == start) &&
+           (path_nodes[parent] > start_path_nodes))) {
+        start = finish[parent];
+        start_path_nodes = path_nodes[parent];
+      }
+      node_depth = max(node_depth, depth[parent] + 1);
+    }
+    finish[node] = start + trace.runtimes[node];
+    path_nodes[node] = start_path_nodes + 1;
+    depth[node] = node_depth;
+
+    if ((finish[node] > summary.critical_path_runtime) ||
+        ((finish[node] == summary.critical_path_runtime) &&
+         (path_nodes[node] > summary.critical_path_nodes))) {
+      summary.critical_path_runtime = finish[node];
+      summary.critical_path_nodes = path_nodes[node];
+    }
+    summary.max_depth = max(summary.max_depth, node_depth);
+    size_t bucket = 0;
+    while ((bucket < 64) && ((node_depth >> bucket) != 0)) {
+      ++bucket;
+    }
+    if (bucket >= summary.depth_histogram.size()) {
+      summary.depth_histogram.resize(bucket + 1, 0);
+    }
+    ++summary.depth_histogram[bucket];
+  }
+}
+
+void ETTraceSummary::merge(const ETTraceSummary& other) {
+  num_nodes += other.num_nodes;
+  num_deps += other.num_deps;
+  missing_deps += other.missing_deps;
+  cyclic_nodes += other.cyclic_nodes;
+  total_runtime += other.total_runtime;
+  if ((other.critical_path_runtime > critical_path_runtime) ||
+      ((other.critical_path_runtime == critical_path_runtime) &&
+       (other.critical_path_nodes > critical_path_nodes))) {
+    critical_path_runtime = other.critical_path_runtime;
+    critical_path_nodes = other.critical_path_nodes;
+  }
+  max_depth = max(max_depth, other.max_depth);
+  for (size_t i = 0; i < other.node_types.size(); ++i) {
+    ETTraceBreakdown& node_type = breakdown(node_types, i);
+    node_type.count += other.node_types[i].count;
+    node_type.runtime += other.node_types[i].runtime;
+    node_type.bytes += other.node_types[i].bytes;
+  }
+  for (size_t i = 0; i < other.comm_types.size(); ++i) {
+    ETTraceBreakdown& comm_type = breakdown(comm_types, i);
+    comm_type.count += other.comm_types[i].count;
+    comm_type.runtime += other.comm_types[i].runtime;
+    comm_type.bytes += other.comm_types[i].bytes;
+  }
+  if (other.depth_histogram.size() > depth_histogram.size()) {
+    depth_histogram.resize(other.depth_histogram.size(), 0);
+  }
+  for (size_t i = 0; i < other.depth_histogram.size(); ++i) {
+    depth_histogram[i] += other.depth_histogram[i];
+  }
+}
+
+ETTraceAnalyzer::ETTraceAnalyzer(size_t num_threads)
+    : thread_pool_(num_threads) {}
+
+ETTraceSummary ETTraceAnalyzer::analyze(const string& filename) {
+  return analyzeTrace(filename, 0);
+}
+
+vector<ETTraceSummary> ETTraceAnalyzer::analyze(
+    const vector<string>& filenames) {
+  vector<ETTraceSummary> summaries(filenames.size());
+  // Several traces keep the threads busy, one trace decompresses on more
+  uint32_t decompression_threads = (filenames.size() > 1) ? 1 : 0;
+  thread_pool_.parallelFor(filenames.size(), [&](size_t i) {
+    summaries[i] = analyzeTrace(filenames[i], decompression_threads);
+  });
+  return summaries;
+}
+
+ETTraceSummary ETTraceAnalyzer::analyzeTrace(
+    const string& filename,
+    uint32_t decompression_threads) {
+  ProtoInputStream trace(filename, decompression_threads);
+  ChakraProtoMsg::GlobalMetadata metadata;
+  readGlobalMetadata(trace, filename, metadata);
+  uint64_t nodes_offset = trace.tell();
+  ETIterationFoldLayout fold_layout;
+  bool folded = ETIterationFold::isFolded(metadata, fold_layout);
+
+  // Chunks start at indexed nodes; folded traces are read in one go since
+  // their iterations are replayed from the template
+  vector<uint64_t> chunk_offsets = {nodes_offset};
+  shared_ptr<ProtoStreamIndex> index;
+  if (!folded && (thread_pool_.numThreads() > 1)) {
+    index = ETTraceIndex::load(ETTraceIndex::defaultFilename(filename));
+  }
+  if ((index != nullptr) && trace.setIndex(index)) {
+    uint64_t num_chunks = thread_pool_.numThreads() * kChunksPerThread;
+    uint64_t stride = max<uint64_t>(1, index->entries.size() / num_chunks);
+    for (uint64_t i = stride; i < index->entries.size(); i += stride) {
+      if (index->entries[i].offset > chunk_offsets.back()) {
+        chunk_offsets.push_back(index->entries[i].offset);
+      }
+    }
+  } else {
+    index = nullptr;
+  }
+  chunk_offsets.push_back(UINT64_MAX);
+
+  vector<TraceChunk> chunks(chunk_offsets.size() - 1);
+  if (chunks.size() == 1) {
+    unique_ptr<ETIterationFold> fold;
+    if (folded) {
+      fold = make_unique<ETIterationFold>(fold_layout);
+    }
+    vector<uint64_t> node_parent_ids;
+    while (true) {
+      shared_ptr<ETFeederNode> node;
+      if ((fold != nullptr) && fold->replaying()) {
+        node = fold->nextReplayedNode();
+      } else {
+        shared_ptr<ChakraProtoMsg::Node> pkt_msg =
+            make_shared<ChakraProtoMsg::Node>();
+        if (!trace.read(*pkt_msg)) {
+          break;
+        }
+        node = make_shared<ETFeederNode>(pkt_msg);
+        if (fold != nullptr) {
+          fold->addTraceNode(node);
+        }
+      }
+      addNode(
+          chunks[0], *node->getChakraNode(), node->attrs(), node_parent_ids);
+    }
+  } else {
+    thread_pool_.parallelFor(chunks.size(), [&](size_t i) {
+      ProtoInputStream chunk_trace(filename, 1);
+      if (!chunk_trace.is_open() || !chunk_trace.setIndex(index) ||
+          !chunk_trace.seek(chunk_offsets[i])) {
+        throw runtime_error("Failed to seek in trace file: " + filename);
+      }
+      ChakraProtoMsg::Node node;
+      ETFeederNodeAttrs attrs;
+      vector<uint64_t> node_parent_ids;
+      while ((chunk_trace.tell() < chunk_offsets[i + 1]) &&
+             chunk_trace.read(node)) {
+        attrs = ETFeederNodeAttrs();
+        ETFeederNode::decodeAttrs(node, attrs);
+        addNode(chunks[i], node, attrs, node_parent_ids);
+      }
+    });
+  }
+
+  // The chunks in trace order make up the trace
+  TraceChunk& whole = chunks[0];
+  for (size_t i = 1; i < chunks.size(); ++i) {
+    TraceChunk& chunk = chunks[i];
+    uint64_t parents_offset = whole.parent_ids.size();
+    whole.ids.insert(whole.ids.end(), chunk.ids.begin(), chunk.ids.end());
+    whole.runtimes.insert(
+        whole.runtimes.end(), chunk.runtimes.begin(), chunk.runtimes.end());
+    for (uint64_t parents_end : chunk.parents_end) {
+      whole.parents_end.push_back(parents_offset + parents_end);
+    }
+    whole.parent_ids.insert(
+        whole.parent_ids.end(),
+        chunk.parent_ids.begin(),
+        chunk.parent_ids.end());
+    whole.summary.merge(chunk.summary);
+    chunk = TraceChunk();
+  }
+
+  ETTraceSummary summary = move(whole.summary);
+  summary.filename = filename;
+  analyzeGraph(whole, summary);
+  return summary;
+}
+
+static string jsonString(const string& str) {
+  ostringstream os;
+  os << '"';
+  for (unsigned char c : str) {
+    if ((c == '"') || (c == '\\')) {
+      os << '\\' << c;
+    } else if (c < 0x20) {
+      os << "\\u" << hex << setw(4) << setfill('0') << int(c) << dec;
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+  return os.str();
+}
+
+static string nodeTypeName(size_t type) {
+  if (!ChakraProtoMsg::NodeType_IsValid(type)) {
+    return to_string(type);
+  }
+  return ChakraProtoMsg::NodeType_Name(
+      static_cast<ChakraProtoMsg::NodeType>(type));
+}
+
+static string commTypeName(size_t type) {
+  if (!ChakraProtoMsg::CollectiveCommType_IsValid(type)) {
+    return to_string(type);
+  }
+  return ChakraProtoMsg::CollectiveCommType_Name(
+      static_cast<ChakraProtoMsg::CollectiveCommType>(type));
+}
+
+static void writeJsonBreakdowns(
+    ostream& os,
+    const vector<ETTraceBreakdown>& breakdowns,
+    string (*name)(size_t)) {
+  os << "{";
+  bool first = true;
+  for (size_t i = 0; i < breakdowns.size(); ++i) {
+    if (breakdowns[i].count == 0) {
+      continue;
+    }
+    os << (first ? "" : ", ") << jsonString(name(i))
+       << ": {\"count\": " << breakdowns[i].count
+       << ", \"runtime\": " << breakdowns[i].runtime
+       << ", \"bytes\": " << breakdowns[i].bytes << "}";
+    first = false;
+  }
+  os << "}";
+}
+
+static void writeJsonSummary(ostream& os, const ETTraceSummary& summary) {
+  os << "{";
+  if (!summary.filename.empty()) {
+    os << "\"filename\": " << jsonString(summary.filename) << ", ";
+  }
+  os << "\"num_nodes\": " << summary.num_nodes
+     << ", \"num_deps\": " << summary.num_deps
+     << ", \"missing_deps\": " << summary.missing_deps
+     << ", \"cyclic_nodes\": " << summary.cyclic_nodes
+     << ", \"total_runtime\": " << summary.total_runtime
+     << ", \"critical_path_runtime\": " << summary.critical_path_runtime
+     << ", \"critical_path_nodes\": " << summary.critical_path_nodes
+     << ", \"max_depth\": " << summary.max_depth << ", \"node_types\": ";
+  writeJsonBreakdowns(os, summary.node_types, nodeTypeName);
+  os << ", \"comm_types\": ";
+  writeJsonBreakdowns(os, summary.comm_types, commTypeName);
+  os << ", \"depth_histogram\": [";
+  for (size_t i = 0; i < summary.depth_histogram.size(); ++i) {
+    os << (i == 0 ? "" : ", ") << summary.depth_histogram[i];
+  }
+  os << "]}";
+}
+
+void ETTraceAnalyzer::writeJson(
+    ostream& os,
+    const vector<ETTraceSummary>& summaries) {
+  ETTraceSummary total;
+  os << "{\"traces\": [";
+  for (size_t i = 0; i < summaries.size(); ++i) {
+    os << (i == 0 ? "\n  " : ",\n  ");
+    writeJsonSummary(os, summaries[i]);
+    total.merge(summaries[i]);
+  }
+  os << "],\n\"total\": ";
+  writeJsonSummary(os, total);
+  os << "}" << endl;
+}
+
+static string csvString(const string& str) {
+  if (str.find_first_of(",\"\n") == string::npos) {
+    return str;
+  }
+  string quoted = "\"";
+  for (char c : str) {
+    quoted += (c == '"') ? "\"\"" : string(1, c);
+  }
+  return quoted + "\"";
+}
+
+void ETTraceAnalyzer::writeCsv(
+    ostream& os,
+    const vector<ETTraceSummary>& summaries) {
+  ETTraceSummary total;
+  for (const ETTraceSummary& summary : summaries) {
+    total.merge(summary);
+  }
+  // One column per breakdown of every known type, so that all rows line
+  // up
+  size_t num_node_types =
+      max<size_t>(ChakraProtoMsg::NodeType_ARRAYSIZE, total.node_types.size());
+  size_t num_comm_types = max<size_t>(
+      ChakraProtoMsg::CollectiveCommType_ARRAYSIZE, total.comm_types.size());
+  size_t num_depth_buckets = total.depth_histogram.size();
+
+  os << "trace,num_nodes,num_deps,missing_deps,cyclic_nodes,total_runtime,"
+     << "critical_path_runtime,critical_path_nodes,max_depth";
+  for (size_t i = 0; i < num_node_types; ++i) {
+    string name = nodeTypeName(i);
+    os << "," << name << "_count," << name << "_runtime," << name << "_bytes";
+  }
+  for (size_t i = 0; i < num_comm_types; ++i) {
+    string name = commTypeName(i);
+    os << "," << name << "_count," << name << "_runtime," << name << "_bytes";
+  }
+  for (size_t i = 0; i < num_depth_buckets; ++i) {
+    os << ",depth_bucket_" << i;
+  }
+  os << "\n";
+
+  auto writeRow = [&](const string& name, const ETTraceSummary& summary) {
+    os << csvString(name) << "," << summary.num_nodes << ","
+       << summary.num_deps << "," << summary.missing_deps << ","
+       << summary.cyclic_nodes << "," << summary.total_runtime << ","
+       << summary.critical_path_runtime << ","
+       << summary.critical_path_nodes << "," << summary.max_depth;
+    auto writeBreakdowns = [&](const vector<ETTraceBreakdown>& breakdowns,
+                               size_t num_types) {
+      for (size_t i = 0; i < num_types; ++i) {
+        ETTraceBreakdown value =
+            (i < breakdowns.size()) ? breakdowns[i] : ETTraceBreakdown();
+        os << "," << value.count << "," << value.runtime << ","
+           << value.bytes;
+      }
+    };
+    writeBreakdowns(summary.node_types, num_node_types);
+    writeBreakdowns(summary.comm_types, num_comm_types);
+    for (size_t i = 0; i < num_depth_buckets; ++i) {
+      os << ","
+         << ((i < summary.depth_histogram.size()) ? summary.depth_histogram[i]
+                                                  : 0);
+    }
+    os << "\n";
+  };
+  for (const ETTraceSummary& summary : summaries) {
+    writeRow(summary.filename, summary);
+  }
+  writeRow("total", total);
+  os.flush();
+}
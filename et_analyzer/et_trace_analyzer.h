@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "et_def/et_def.pb.h"
+#include "et_feeder/thread_pool.h"
+
+namespace Chakra {
+
+struct ETTraceBreakdown {
+  uint64_t count = 0;
+  uint64_t runtime = 0;
+  // comm_size of communication nodes, tensor_size of the others
+  uint64_t bytes = 0;
+};
+
+struct ETTraceSummary {
+  // Empty for the total over several traces
+  std::string filename = "";
+  uint64_t num_nodes = 0;
+  // Distinct parents per node, summed over all nodes
+  uint64_t num_deps = 0;
+  // Dependencies on nodes missing from the trace, which are ignored
+  uint64_t missing_deps = 0;
+  // Nodes on or below a dependency cycle, which are left out of the
+  // critical path and the depths
+  uint64_t cyclic_nodes = 0;
+  uint64_t total_runtime = 0;
+  // Longest chain of dependencies weighted by runtime, and its number of
+  // nodes; the longest of all traces for a total
+  uint64_t critical_path_runtime = 0;
+  uint64_t critical_path_nodes = 0;
+  // Longest chain of dependencies in nodes, 0 for a trace without any
+  uint64_t max_depth = 0;
+  // Indexed by NodeType and, for collective nodes, by CollectiveCommType
+  std::vector<ETTraceBreakdown> node_types{};
+  std::vector<ETTraceBreakdown> comm_types{};
+  // Number of nodes by dependency depth: entry 0 counts the nodes without
+  // parents, entry b > 0 those with a depth in [2^(b-1), 2^b)
+  std::vector<uint64_t> depth_histogram{};
+
+  // Adds up counters and keeps the longer critical path and depth
+  void merge(const ETTraceSummary& other);
+};
+
+// Computes summaries of .et files (plain or gzip, folded or not) without
+// holding their messages: every trace is streamed once, keeping only the
+// IDs, runtimes, and dependencies of its nodes for the critical path and
+// the depths. Traces are analyzed in parallel, and a trace with an index
+// written by et_indexer is also read in parallel chunks.
+class ETTraceAnalyzer {
+ public:
+  // num_threads == 0 picks the number of hardware threads
+  explicit ETTraceAnalyzer(size_t num_threads = 0);
+
+  // Throws std::runtime_error naming the trace if one cannot be read
+  ETTraceSummary analyze(const std::string& filename);
+  std::vector<ETTraceSummary> analyze(
+      const std::vector<std::string>& filenames);
+
+  // The summaries of the traces followed by their total
+  static void writeJson(
+      std::ostream& os,
+      const std::vector<ETTraceSummary>& summaries);
+  static void writeCsv(
+      std::ostream& os,
+      const std::vector<ETTraceSummary>& summaries);
+
+ private:
+  ETTraceSummary analyzeTrace(
+      const std::string& filename,
+      uint32_t decompression_threads);
+
+  ThreadPool thread_pool_;
+};
+
+} // namespace Chakra
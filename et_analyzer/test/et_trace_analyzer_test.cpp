@@ -0,0 +1,177 @@
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "et_analyzer/et_trace_analyzer.h"
+#include "et_feeder/et_trace_index.h"
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+static const uint64_t kNumNodes = kTestNumNodes;
+static const uint64_t kCollectiveBytes = 4 * 1024 * 1024;
+
+// Longest chain of every shape in nodes, and its number of dependencies;
+// every node runs for 1 us
+struct ExpectedSummary {
+  SyntheticTraceShape shape;
+  uint64_t critical_path_nodes;
+  uint64_t num_deps;
+};
+
+static const ExpectedSummary kExpectedSummaries[] = {
+    {SyntheticTraceShape::Chain, kNumNodes, kNumNodes - 1},
+    // Up the second chain, over to the first one and down that
+    {SyntheticTraceShape::LongRange, kNumNodes / 2 + 1, 3 * kNumNodes / 2 - 2},
+    {SyntheticTraceShape::Parallel,
+     kNumNodes / kSyntheticTraceWidth,
+     kNumNodes - kSyntheticTraceWidth},
+    // Down the chain of group starts and into the last group
+    {SyntheticTraceShape::FanOut,
+     kNumNodes / kSyntheticTraceWidth + 1,
+     kNumNodes - 1},
+    {SyntheticTraceShape::Collective, kNumNodes, kNumNodes - 1},
+    {SyntheticTraceShape::Iterations,
+     kNumNodes,
+     2 * kNumNodes - 1 - kSyntheticTraceWidth},
+    // A parent listed as data and control dependency counts once
+    {SyntheticTraceShape::CtrlDeps,
+     kNumNodes,
+     kNumNodes - 1 + kNumNodes / 4 - 1},
+};
+
+static string toJson(const ETTraceSummary& summary) {
+  ostringstream os;
+  ETTraceAnalyzer::writeJson(os, {summary});
+  return os.str();
+}
+
+static void checkShape(
+    const TestShape& shape,
+    const ExpectedSummary& expected) {
+  const string filename =
+      string("et_trace_analyzer_test_") + shape.name + ".et";
+  const string run = shape.name;
+  writeSyntheticTrace(filename, shape.shape, kNumNodes);
+  ETTraceAnalyzer sequential(1);
+  ETTraceSummary summary = sequential.analyze(filename);
+
+  check(summary.num_nodes == kNumNodes, run + ": number of nodes");
+  check(summary.num_deps == expected.num_deps, run + ": dependencies");
+  check(summary.missing_deps == 0, run + ": missing dependencies");
+  check(summary.cyclic_nodes == 0, run + ": cyclic nodes");
+  check(summary.total_runtime == kNumNodes, run + ": total runtime");
+  check(
+      (summary.critical_path_nodes == expected.critical_path_nodes) &&
+          (summary.critical_path_runtime == expected.critical_path_nodes),
+      run + ": critical path of " +
+          to_string(summary.critical_path_nodes) + " nodes");
+  check(
+      summary.max_depth == expected.critical_path_nodes - 1,
+      run + ": max depth");
+  uint64_t num_comm_nodes =
+      (shape.shape == SyntheticTraceShape::Collective) ? kNumNodes / 4 : 0;
+  check(
+      summary.node_types.at(ChakraProtoMsg::COMP_NODE).count ==
+          kNumNodes - num_comm_nodes,
+      run + ": compute nodes");
+  if (num_comm_nodes != 0) {
+    const ETTraceBreakdown& comm =
+        summary.node_types.at(ChakraProtoMsg::COMM_COLL_NODE);
+    const ETTraceBreakdown& all_reduce =
+        summary.comm_types.at(ChakraProtoMsg::ALL_REDUCE);
+    check(
+        (comm.count == num_comm_nodes) &&
+            (comm.bytes == num_comm_nodes * kCollectiveBytes) &&
+            (all_reduce.count == num_comm_nodes) &&
+            (all_reduce.bytes == comm.bytes),
+        run + ": collective nodes");
+  }
+  uint64_t num_histogram_nodes = 0;
+  for (uint64_t count : summary.depth_histogram) {
+    num_histogram_nodes += count;
+  }
+  check(num_histogram_nodes == kNumNodes, run + ": depth histogram");
+
+  // With an index, the trace is read in parallel chunks
+  const string index_filename = ETTraceIndex::defaultFilename(filename);
+  ETTraceIndex::build(filename, index_filename, 64);
+  ETTraceAnalyzer chunked(4);
+  check(
+      toJson(chunked.analyze(filename)) == toJson(summary),
+      run + ": chunked summary differs");
+  remove(index_filename.c_str());
+  remove(filename.c_str());
+}
+
+// A chain with a dependency on a node that is not in the trace, next to a
+// cycle of three nodes with a child below it
+static void checkBrokenDeps() {
+  const string filename = "et_trace_analyzer_test_broken.et";
+  {
+    ProtoOutputStream et(filename);
+    ChakraProtoMsg::GlobalMetadata metadata;
+    metadata.set_version("0.0.4");
+    et.write(metadata);
+    auto write = [&](uint64_t id, vector<uint64_t> parents) {
+      ChakraProtoMsg::Node node;
+      node.set_id(id);
+      node.set_name("COMP_NODE_" + to_string(id));
+      node.set_type(ChakraProtoMsg::COMP_NODE);
+      node.set_duration_micros(1);
+      for (uint64_t parent : parents) {
+        node.add_data_deps(parent);
+      }
+      et.write(node);
+    };
+    for (uint64_t id = 0; id < 10; ++id) {
+      write(id, id > 0 ? vector<uint64_t>{id - 1} : vector<uint64_t>{});
+    }
+    write(10, {9, 1000});
+    write(11, {10});
+    write(20, {22});
+    write(21, {20});
+    write(22, {21});
+    write(23, {22});
+  }
+  ETTraceSummary summary = ETTraceAnalyzer(1).analyze(filename);
+  check(summary.num_nodes == 16, "broken: number of nodes");
+  check(summary.num_deps == 15, "broken: dependencies");
+  check(summary.missing_deps == 1, "broken: missing dependencies");
+  check(summary.cyclic_nodes == 4, "broken: cyclic nodes");
+  check(
+      (summary.critical_path_nodes == 12) &&
+          (summary.critical_path_runtime == 12),
+      "broken: critical path");
+  check(summary.max_depth == 11, "broken: max depth");
+  remove(filename.c_str());
+}
+
+// Summaries of the synthetic shapes against their known critical paths and
+// counts, read sequentially and in chunks of an indexed trace
+int main() {
+  try {
+    for (const TestShape& shape : kTestShapes) {
+      bool found = false;
+      for (const ExpectedSummary& expected : kExpectedSummaries) {
+        if (expected.shape == shape.shape) {
+          checkShape(shape, expected);
+          found = true;
+        }
+      }
+      check(found, string(shape.name) + ": no expected summary");
+      cout << shape.name << ": ok" << endl;
+    }
+    checkBrokenDeps();
+    cout << "broken: ok" << endl;
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
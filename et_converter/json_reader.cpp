@@ -0,0 +1,359 @@
+#include "et_converter/json_reader.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace Chakra;
+
+const JsonValue* JsonValue::find(const string& key) const {
+  for (const auto& member : object) {
+    if (member.first == key) {
+      return &member.second;
+    }
+  }
+  return nullptr;
+}
+
+bool JsonValue::isInteger() const {
+  return (type == Type::Number) &&
+      (str.find_first_of(".eEIN") == string::npos);
+}
+
+int64_t JsonValue::asInt64() const {
+  if (!isInteger()) {
+    throw runtime_error("Expected an integer, got " + str);
+  }
+  try {
+    return stoll(str);
+  } catch (const exception&) {
+    throw runtime_error("Integer out of range: " + str);
+  }
+}
+
+uint64_t JsonValue::asUint64() const {
+  if (!isInteger() || (str[0] == '-')) {
+    throw runtime_error("Expected an unsigned integer, got " + str);
+  }
+  try {
+    return stoull(str);
+  } catch (const exception&) {
+    throw runtime_error("Integer out of range: " + str);
+  }
+}
+
+double JsonValue::asDouble() const {
+  if (type != Type::Number) {
+    throw runtime_error("Expected a number");
+  }
+  if (str.find('N') != string::npos) {
+    return strtod("nan", nullptr);
+  }
+  return strtod(str.c_str(), nullptr);
+}
+
+JsonReader::JsonReader(const string& filename, size_t buffer_size)
+    : filename_(filename), buffer_(buffer_size) {
+  file_ = fopen(filename.c_str(), "rb");
+  if (file_ == nullptr) {
+    throw runtime_error("Failed to open JSON file: " + filename);
+  }
+}
+
+JsonReader::~JsonReader() {
+  fclose(file_);
+}
+
+uint64_t JsonReader::tell() {
+  skipWhitespace();
+  return buffer_offset_ + pos_;
+}
+
+void JsonReader::seek(uint64_t offset) {
+  // Nodes read in order are often close to each other
+  if ((offset >= buffer_offset_) && (offset <= buffer_offset_ + end_)) {
+    pos_ = offset - buffer_offset_;
+    return;
+  }
+  if (fseeko(file_, static_cast<off_t>(offset), SEEK_SET) != 0) {
+    fail("seek failed");
+  }
+  buffer_offset_ = offset;
+  pos_ = 0;
+  end_ = 0;
+}
+
+bool JsonReader::fill() {
+  buffer_offset_ += end_;
+  pos_ = 0;
+  end_ = fread(buffer_.data(), 1, buffer_.size(), file_);
+  return end_ > 0;
+}
+
+int JsonReader::peek() {
+  if ((pos_ == end_) && !fill()) {
+    return EOF;
+  }
+  return static_cast<unsigned char>(buffer_[pos_]);
+}
+
+int JsonReader::get() {
+  if ((pos_ == end_) && !fill()) {
+    return EOF;
+  }
+  return static_cast<unsigned char>(buffer_[pos_++]);
+}
+
+int JsonReader::skipWhitespace() {
+  int c = peek();
+  while ((c == ' ') || (c == '\n') || (c == '\r') || (c == '\t')) {
+    ++pos_;
+    c = peek();
+  }
+  return c;
+}
+
+void JsonReader::fail(const string& what) {
+  throw runtime_error(
+      "Malformed JSON in " + filename_ + " at offset " +
+      to_string(buffer_offset_ + pos_) + ": " + what);
+}
+
+void JsonReader::expect(char c) {
+  if (skipWhitespace() != static_cast<unsigned char>(c)) {
+    fail(string("expected '") + c + "'");
+  }
+  ++pos_;
+}
+
+void JsonReader::expectLiteral(const char* literal) {
+  for (const char* p = literal; *p != '\0'; ++p) {
+    if (get() != static_cast<unsigned char>(*p)) {
+      fail(string("expected ") + literal);
+    }
+  }
+}
+
+void JsonReader::beginObject() {
+  expect('{');
+}
+
+bool JsonReader::nextMember(string& key) {
+  int c = skipWhitespace();
+  if (c == '}') {
+    ++pos_;
+    return false;
+  }
+  if (c == ',') {
+    ++pos_;
+    c = skipWhitespace();
+  }
+  if (c != '"') {
+    fail("expected a member name");
+  }
+  readString(key);
+  expect(':');
+  return true;
+}
+
+void JsonReader::beginArray() {
+  expect('[');
+}
+
+bool JsonReader::nextElement() {
+  int c = skipWhitespace();
+  if (c == ']') {
+    ++pos_;
+    return false;
+  }
+  if (c == ',') {
+    ++pos_;
+  }
+  return true;
+}
+
+uint32_t JsonReader::readHex4() {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    int c = get();
+    value <<= 4;
+    if ((c >= '0') && (c <= '9')) {
+      value |= c - '0';
+    } else if ((c >= 'a') && (c <= 'f')) {
+      value |= c - 'a' + 10;
+    } else if ((c >= 'A') && (c <= 'F')) {
+      value |= c - 'A' + 10;
+    } else {
+      fail("invalid \\u escape");
+    }
+  }
+  return value;
+}
+
+static void appendUtf8(string& str, uint32_t code_point) {
+  if (code_point < 0x80) {
+    str += static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    str += static_cast<char>(0xc0 | (code_point >> 6));
+    str += static_cast<char>(0x80 | (code_point & 0x3f));
+  } else if (code_point < 0x10000) {
+    str += static_cast<char>(0xe0 | (code_point >> 12));
+    str += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+    str += static_cast<char>(0x80 | (code_point & 0x3f));
+  } else {
+    str += static_cast<char>(0xf0 | (code_point >> 18));
+    str += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+    str += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+    str += static_cast<char>(0x80 | (code_point & 0x3f));
+  }
+}
+
+void JsonReader::readString(string& str) {
+  str.clear();
+  expect('"');
+  while (true) {
+    // Copy runs without quotes or escapes in one go
+    if ((pos_ == end_) && !fill()) {
+      fail("unterminated string");
+    }
+    const char* begin = buffer_.data() + pos_;
+    size_t run = 0;
+    while ((pos_ + run < end_) && (begin[run] != '"') &&
+           (begin[run] != '\\')) {
+      ++run;
+    }
+    str.append(begin, run);
+    pos_ += run;
+    if (pos_ == end_) {
+      continue;
+    }
+
+    char c = buffer_[pos_++];
+    if (c == '"') {
+      return;
+    }
+    int escaped = get();
+    switch (escaped) {
+      case '"':
+      case '\\':
+      case '/':
+        str += static_cast<char>(escaped);
+        break;
+      case 'b':
+        str += '\b';
+        break;
+      case 'f':
+        str += '\f';
+        break;
+      case 'n':
+        str += '\n';
+        break;
+      case 'r':
+        str += '\r';
+        break;
+      case 't':
+        str += '\t';
+        break;
+      case 'u': {
+        uint32_t code_point = readHex4();
+        // A surrogate pair encodes a code point beyond the BMP
+        if ((code_point >= 0xd800) && (code_point < 0xdc00) &&
+            (peek() == '\\')) {
+          ++pos_;
+          if (get() != 'u') {
+            fail("invalid surrogate pair");
+          }
+          uint32_t low = readHex4();
+          if ((low < 0xdc00) || (low >= 0xe000)) {
+            fail("invalid surrogate pair");
+          }
+          code_point =
+              0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+        }
+        appendUtf8(str, code_point);
+        break;
+      }
+      default:
+        fail("invalid escape");
+    }
+  }
+}
+
+void JsonReader::readNumber(string& str) {
+  str.clear();
+  // Python's json module writes non-finite floats as NaN and Infinity
+  if (peek() == '-') {
+    str += static_cast<char>(get());
+  }
+  if (peek() == 'I') {
+    expectLiteral("Infinity");
+    str += "Infinity";
+    return;
+  }
+  if ((peek() == 'N') && str.empty()) {
+    expectLiteral("NaN");
+    str = "NaN";
+    return;
+  }
+  int c = peek();
+  while (((c >= '0') && (c <= '9')) || (c == '.') || (c == 'e') ||
+         (c == 'E') || (c == '+') || (c == '-')) {
+    str += static_cast<char>(c);
+    ++pos_;
+    c = peek();
+  }
+  if (str.empty() || (str == "-")) {
+    fail("expected a value");
+  }
+}
+
+void JsonReader::readValue(JsonValue& value) {
+  value.str.clear();
+  value.array.clear();
+  value.object.clear();
+  int c = skipWhitespace();
+  switch (c) {
+    case '{': {
+      value.type = JsonValue::Type::Object;
+      beginObject();
+      string key;
+      while (nextMember(key)) {
+        value.object.emplace_back(move(key), JsonValue());
+        readValue(value.object.back().second);
+      }
+      break;
+    }
+    case '[':
+      value.type = JsonValue::Type::Array;
+      beginArray();
+      while (nextElement()) {
+        value.array.emplace_back();
+        readValue(value.array.back());
+      }
+      break;
+    case '"':
+      value.type = JsonValue::Type::String;
+      readString(value.str);
+      break;
+    case 't':
+      value.type = JsonValue::Type::Bool;
+      value.bool_val = true;
+      expectLiteral("true");
+      break;
+    case 'f':
+      value.type = JsonValue::Type::Bool;
+      value.bool_val = false;
+      expectLiteral("false");
+      break;
+    case 'n':
+      value.type = JsonValue::Type::Null;
+      expectLiteral("null");
+      break;
+    case EOF:
+      fail("unexpected end of file");
+    default:
+      value.type = JsonValue::Type::Number;
+      readNumber(value.str);
+  }
+}
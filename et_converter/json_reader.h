@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Chakra {
+
+// A parsed JSON value. Numbers keep their text, so that integers of any
+// size and the spelling of floats survive until they are used.
+struct JsonValue {
+  enum class Type { Null, Bool, Number, String, Array, Object };
+
+  Type type = Type::Null;
+  bool bool_val = false;
+  // Text of a number, or contents of a string
+  std::string str{};
+  std::vector<JsonValue> array{};
+  // Members in document order
+  std::vector<std::pair<std::string, JsonValue>> object{};
+
+  // Returns the member with the given key, or nullptr
+  const JsonValue* find(const std::string& key) const;
+  bool isInteger() const;
+  // Throw if the value is not an integer in range
+  int64_t asInt64() const;
+  uint64_t asUint64() const;
+  double asDouble() const;
+};
+
+// Pull parser over a JSON file read through a fixed-size buffer, so that
+// documents larger than memory can be walked one value at a time:
+//
+//   reader.beginObject();
+//   while (reader.nextMember(key)) {
+//     reader.readValue(value); // or walk the value further
+//   }
+//
+// tell() and seek() allow coming back to a value later. All calls throw
+// std::runtime_error on malformed input.
+class JsonReader {
+ public:
+  explicit JsonReader(
+      const std::string& filename,
+      size_t buffer_size = 1024 * 1024);
+  ~JsonReader();
+
+  // Offset of the next token
+  uint64_t tell();
+  void seek(uint64_t offset);
+
+  void beginObject();
+  // Reads the key of the next member, or returns false at the end of the
+  // object
+  bool nextMember(std::string& key);
+  void beginArray();
+  // Returns false at the end of the array
+  bool nextElement();
+  void readValue(JsonValue& value);
+
+ private:
+  JsonReader(const JsonReader&) = delete;
+  JsonReader& operator=(const JsonReader&) = delete;
+
+  int peek();
+  int get();
+  bool fill();
+  int skipWhitespace();
+  void expect(char c);
+  void expectLiteral(const char* literal);
+  void readString(std::string& str);
+  void readNumber(std::string& str);
+  uint32_t readHex4();
+  [[noreturn]] void fail(const std::string& what);
+
+  const std::string filename_;
+  FILE* file_{nullptr};
+  std::vector<char> buffer_;
+  // File offset of buffer_[0]
+  uint64_t buffer_offset_{0};
+  size_t pos_{0};
+  size_t end_{0};
+};
+
+} // namespace Chakra
@@ -0,0 +1,857 @@
+#include "et_converter/pytorch2chakra_converter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+#include "third_party/utils/protoio.hh"
+
+using namespace std;
+using namespace Chakra;
+
+// The converter writes lists and dicts of the PyTorch trace as strings
+// the way Python's str() formats them, so that traces converted by either
+// converter are identical
+
+static void appendPythonRepr(string& out, const string& str) {
+  char quote = '\'';
+  if ((str.find('\'') != string::npos) && (str.find('"') == string::npos)) {
+    quote = '"';
+  }
+  out += quote;
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char c = str[i];
+    char escaped[8];
+    if ((c == quote) || (c == '\\')) {
+      out += '\\';
+      out += static_cast<char>(c);
+    } else if (c == '\t') {
+      out += "\\t";
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c == '\r') {
+      out += "\\r";
+    } else if ((c < 0x20) || (c == 0x7f)) {
+      snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+      out += escaped;
+    } else if (
+        (c == 0xc2) && (i + 1 < str.size()) &&
+        ((static_cast<unsigned char>(str[i + 1]) <= 0xa0) ||
+         (static_cast<unsigned char>(str[i + 1]) == 0xad))) {
+      // U+0080 to U+00A0 and U+00AD are not printable either
+      snprintf(
+          escaped,
+          sizeof(escaped),
+          "\\x%02x",
+          static_cast<unsigned char>(str[++i]));
+      out += escaped;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  out += quote;
+}
+
+// repr() of a float: the shortest digits that read back as the same
+// double, in scientific notation for exponents below -4 or from 16 on
+static void appendPythonFloatRepr(string& out, double value) {
+  if (isnan(value)) {
+    out += "nan";
+    return;
+  }
+  if (isinf(value)) {
+    out += value < 0 ? "-inf" : "inf";
+    return;
+  }
+
+  char buffer[32];
+  for (int precision = 1; precision <= 17; ++precision) {
+    snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, value);
+    if (strtod(buffer, nullptr) == value) {
+      break;
+    }
+  }
+  string mantissa(buffer, strchr(buffer, 'e'));
+  int exponent = atoi(strchr(buffer, 'e') + 1);
+  if (mantissa[0] == '-') {
+    out += '-';
+    mantissa.erase(0, 1);
+  }
+  string digits = mantissa.substr(0, 1) +
+      (mantissa.size() > 2 ? mantissa.substr(2) : string());
+  while ((digits.size() > 1) && (digits.back() == '0')) {
+    digits.pop_back();
+  }
+
+  if ((exponent >= -4) && (exponent < 16)) {
+    if (exponent < 0) {
+      out += "0." + string(-exponent - 1, '0') + digits;
+    } else if (digits.size() <= static_cast<size_t>(exponent) + 1) {
+      out += digits + string(exponent + 1 - digits.size(), '0') + ".0";
+    } else {
+      out += digits.substr(0, exponent + 1) + "." +
+          digits.substr(exponent + 1);
+    }
+  } else {
+    out += digits.substr(0, 1);
+    if (digits.size() > 1) {
+      out += "." + digits.substr(1);
+    }
+    snprintf(
+        buffer,
+        sizeof(buffer),
+        "e%c%02d",
+        exponent < 0 ? '-' : '+',
+        abs(exponent));
+    out += buffer;
+  }
+}
+
+static void appendPythonRepr(string& out, const JsonValue& value) {
+  switch (value.type) {
+    case JsonValue::Type::Null:
+      out += "None";
+      break;
+    case JsonValue::Type::Bool:
+      out += value.bool_val ? "True" : "False";
+      break;
+    case JsonValue::Type::Number:
+      if (!value.isInteger()) {
+        appendPythonFloatRepr(out, value.asDouble());
+      } else if (value.str == "-0") {
+        out += "0";
+      } else {
+        out += value.str;
+      }
+      break;
+    case JsonValue::Type::String:
+      appendPythonRepr(out, value.str);
+      break;
+    case JsonValue::Type::Array:
+      out += '[';
+      for (size_t i = 0; i < value.array.size(); ++i) {
+        if (i > 0) {
+          out += ", ";
+        }
+        appendPythonRepr(out, value.array[i]);
+      }
+      out += ']';
+      break;
+    case JsonValue::Type::Object:
+      out += '{';
+      for (size_t i = 0; i < value.object.size(); ++i) {
+        if (i > 0) {
+          out += ", ";
+        }
+        appendPythonRepr(out, value.object[i].first);
+        out += ": ";
+        appendPythonRepr(out, value.object[i].second);
+      }
+      out += '}';
+      break;
+  }
+}
+
+static bool isTruthy(const JsonValue* value) {
+  if (value == nullptr) {
+    return false;
+  }
+  switch (value->type) {
+    case JsonValue::Type::Null:
+      return false;
+    case JsonValue::Type::Bool:
+      return value->bool_val;
+    case JsonValue::Type::Number:
+      return value->asDouble() != 0;
+    case JsonValue::Type::String:
+      return !value->str.empty();
+    case JsonValue::Type::Array:
+      return !value->array.empty();
+    case JsonValue::Type::Object:
+      return !value->object.empty();
+  }
+  return false;
+}
+
+static const JsonValue& getField(const JsonValue& node, const char* key) {
+  const JsonValue* value = node.find(key);
+  if (value == nullptr) {
+    const JsonValue* id = node.find("id");
+    throw runtime_error(
+        string("Node ") + (id != nullptr ? id->str : "?") + " has no " + key);
+  }
+  return *value;
+}
+
+static ChakraProtoMsg::CollectiveCommType getCollectiveCommType(
+    const string& name) {
+  if (name.find("all_reduce") != string::npos) {
+    return ChakraProtoMsg::ALL_REDUCE;
+  } else if (name.find("all_to_all") != string::npos) {
+    return ChakraProtoMsg::ALL_TO_ALL;
+  } else if (name.find("all_gather") != string::npos) {
+    return ChakraProtoMsg::ALL_GATHER;
+  } else if (name.find("reduce_scatter") != string::npos) {
+    return ChakraProtoMsg::REDUCE_SCATTER;
+  } else if (name.find("broadcast") != string::npos) {
+    return ChakraProtoMsg::BROADCAST;
+  }
+  throw runtime_error(name + " is not supported");
+}
+
+static int64_t getDataTypeSize(const string& data_type) {
+  static const unordered_map<string, int64_t> data_type_sizes = {
+      {"Tensor(float32)", 4},
+      {"Tensor(float)", 4},
+      {"Tensor(float64)", 8},
+      {"Tensor(double)", 8},
+      {"Tensor(float16)", 2},
+      {"Tensor(half)", 2},
+      {"Tensor(bfloat16)", 2},
+      {"Tensor(complex64)", 8},
+      {"Tensor(complex128)", 16},
+      {"Tensor(uint8)", 1},
+      {"Tensor(int8)", 1},
+      {"Tensor(int16)", 2},
+      {"Tensor(short)", 2},
+      {"Tensor(int32)", 4},
+      {"Tensor(int)", 4},
+      {"Tensor(int64)", 8},
+      {"Tensor(long)", 8},
+      {"Tensor(c10::Half)", 2},
+      {"Tensor(unsigned char)", 1},
+      {"Tensor(long int)", 8},
+  };
+  auto size = data_type_sizes.find(data_type);
+  if (size == data_type_sizes.end()) {
+    throw runtime_error(data_type + " is unsupported");
+  }
+  return size->second;
+}
+
+static int64_t getCommSize(const JsonValue& node) {
+  int64_t comm_size = 1;
+  for (const JsonValue& input_type : getField(node, "input_types").array) {
+    comm_size *= getDataTypeSize(input_type.str);
+  }
+  for (const JsonValue& input_shape : getField(node, "input_shapes").array) {
+    for (const JsonValue& dim : input_shape.array) {
+      comm_size *= dim.asInt64();
+    }
+  }
+  return comm_size;
+}
+
+void PyTorch2ChakraConverter::TensorMap::add(
+    int64_t tensor_id,
+    uint64_t node_id) {
+  auto ids = node_ids.find(tensor_id);
+  if (ids == node_ids.end()) {
+    ids = node_ids.emplace(tensor_id, vector<uint64_t>()).first;
+    order.push_back(tensor_id);
+  }
+  ids->second.push_back(node_id);
+}
+
+PyTorch2ChakraConverter::PyTorch2ChakraConverter(
+    string input_filename,
+    string output_filename,
+    uint32_t num_dims)
+    : input_filename_(move(input_filename)),
+      output_filename_(move(output_filename)),
+      num_dims_(num_dims) {}
+
+void PyTorch2ChakraConverter::convert() {
+  readTrace();
+  discoverCpuOps();
+  mergeGpuOpsWithCpuOps();
+  discoverCommOps();
+  convertNodes();
+  writeTrace();
+}
+
+uint64_t PyTorch2ChakraConverter::numNodes() const {
+  return num_nodes_;
+}
+
+void PyTorch2ChakraConverter::readTrace() {
+  JsonReader reader(input_filename_);
+  reader.beginObject();
+  string key;
+  while (reader.nextMember(key)) {
+    if (key != "nodes") {
+      reader.readValue(metadata_[key]);
+      continue;
+    }
+    reader.beginArray();
+    JsonValue node;
+    while (reader.nextElement()) {
+      uint64_t offset = reader.tell();
+      reader.readValue(node);
+      addPyTorchNode(node, offset);
+    }
+  }
+}
+
+void PyTorch2ChakraConverter::addPyTorchNode(
+    const JsonValue& node,
+    uint64_t offset) {
+  if (node.type != JsonValue::Type::Object) {
+    throw runtime_error(
+        "Node at offset " + to_string(offset) + " of " + input_filename_ +
+        " is not an object");
+  }
+  PyTorchNode pytorch_node;
+  pytorch_node.id = getField(node, "id").asUint64();
+  pytorch_node.chakra_id = pytorch_node.id;
+  pytorch_node.parent = getField(node, "parent").asUint64();
+  pytorch_node.ts = getField(node, "ts").asInt64();
+  const JsonValue* dur = node.find("dur");
+  pytorch_node.has_dur = dur != nullptr;
+  pytorch_node.dur = pytorch_node.has_dur ? dur->asInt64() : 0;
+  pytorch_node.offset = offset;
+
+  const string& name = getField(node, "name").str;
+  bool has_cat = node.find("cat") != nullptr;
+  const JsonValue* op_schema = node.find("op_schema");
+  const JsonValue* outputs = node.find("outputs");
+  bool is_comm = (name.find("c10d::") != string::npos) ||
+      (name.find("nccl:") != string::npos);
+  if (has_cat) {
+    pytorch_node.pytorch_type = PyTorchNodeType::GPU_OP;
+  } else if (isTruthy(op_schema) || isTruthy(outputs) || is_comm) {
+    pytorch_node.pytorch_type = PyTorchNodeType::CPU_OP;
+  } else {
+    pytorch_node.pytorch_type = PyTorchNodeType::LABEL;
+  }
+
+  if (has_cat && (name.find("ncclKernel") != string::npos)) {
+    pytorch_node.type = ChakraProtoMsg::COMM_COLL_NODE;
+  } else if (has_cat) {
+    pytorch_node.type = ChakraProtoMsg::COMP_NODE;
+  } else if (is_comm) {
+    pytorch_node.type = ChakraProtoMsg::COMM_COLL_NODE;
+  } else if (
+      ((op_schema != nullptr) &&
+       !((op_schema->type == JsonValue::Type::String) &&
+         op_schema->str.empty())) ||
+      isTruthy(outputs)) {
+    pytorch_node.type = ChakraProtoMsg::COMP_NODE;
+  } else {
+    pytorch_node.type = ChakraProtoMsg::INVALID_NODE;
+  }
+
+  pytorch_node.is_thread_root =
+      (name.find("[pytorch|profiler|execution_graph|thread]") !=
+       string::npos) ||
+      (name.find("[pytorch|profiler|execution_trace|thread]") !=
+       string::npos);
+  pytorch_node.is_record_param_comms =
+      name.find("record_param_comms") != string::npos;
+  pytorch_node.is_nccl = name.find("nccl:") != string::npos;
+
+  // Only operators take part in the dependency discovery, and only CPU
+  // operators as producers
+  addTensors(
+      pytorch_node.pytorch_type != PyTorchNodeType::LABEL
+          ? node.find("inputs")
+          : nullptr,
+      pytorch_node.inputs_begin,
+      pytorch_node.inputs_end);
+  addTensors(
+      pytorch_node.pytorch_type == PyTorchNodeType::CPU_OP ? outputs : nullptr,
+      pytorch_node.outputs_begin,
+      pytorch_node.outputs_end);
+
+  if (!pytorch_node_index_.emplace(pytorch_node.id, pytorch_nodes_.size())
+           .second) {
+    throw runtime_error("Duplicate node ID " + to_string(pytorch_node.id));
+  }
+  pytorch_nodes_.push_back(pytorch_node);
+}
+
+void PyTorch2ChakraConverter::addTensors(
+    const JsonValue* values,
+    uint32_t& begin,
+    uint32_t& end) {
+  begin = tensors_.size();
+  if ((values != nullptr) && (values->type == JsonValue::Type::Array)) {
+    // A tensor is written as [tensor_id, storage_id, offset, num_elem,
+    // elem_bytes, device]
+    for (const JsonValue& value : values->array) {
+      if ((value.type != JsonValue::Type::Array) ||
+          (value.array.size() != 6) || !value.array[0].isInteger() ||
+          !value.array[1].isInteger()) {
+        continue;
+      }
+      int64_t storage_id = value.array[1].asInt64();
+      if (storage_id > 0) {
+        tensors_.push_back({storage_id, true});
+      } else {
+        tensors_.push_back({value.array[0].asInt64(), false});
+      }
+    }
+  }
+  end = tensors_.size();
+}
+
+void PyTorch2ChakraConverter::discoverCpuOps() {
+  // Nodes with earlier timestamps go first
+  order_.resize(pytorch_nodes_.size());
+  for (uint32_t i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+  stable_sort(order_.begin(), order_.end(), [this](uint32_t a, uint32_t b) {
+    return pytorch_nodes_[a].ts < pytorch_nodes_[b].ts;
+  });
+
+  // Children in a flat array, grouped by parent in timestamp order
+  vector<uint32_t> parent_index(pytorch_nodes_.size(), kNone);
+  children_begin_.assign(pytorch_nodes_.size() + 1, 0);
+  for (uint32_t i = 0; i < pytorch_nodes_.size(); ++i) {
+    auto parent = pytorch_node_index_.find(pytorch_nodes_[i].parent);
+    if ((parent != pytorch_node_index_.end()) && (parent->second != i)) {
+      parent_index[i] = parent->second;
+      ++children_begin_[parent->second + 1];
+    }
+  }
+  for (size_t i = 1; i < children_begin_.size(); ++i) {
+    children_begin_[i] += children_begin_[i - 1];
+  }
+  children_.resize(children_begin_.back());
+  vector<uint32_t> next_child(
+      children_begin_.begin(), children_begin_.end() - 1);
+  for (uint32_t index : order_) {
+    if (parent_index[index] != kNone) {
+      children_[next_child[parent_index[index]]++] = index;
+    }
+  }
+
+  unordered_set<uint64_t> root_ids;
+  for (const PyTorchNode& node : pytorch_nodes_) {
+    if (node.is_thread_root) {
+      root_ids.insert(node.id);
+    }
+  }
+  if (root_ids.empty()) {
+    throw runtime_error("Cannot find a root node in " + input_filename_);
+  }
+
+  // Every child of a root starts a phase
+  is_cpu_op_.assign(pytorch_nodes_.size(), false);
+  for (uint32_t index : order_) {
+    if (root_ids.count(pytorch_nodes_[index].parent) != 0) {
+      int64_t largest_id = dfs(index);
+      if (largest_id != -1) {
+        inter_phase_dependency_.push_back(largest_id);
+      }
+    }
+  }
+}
+
+int64_t PyTorch2ChakraConverter::dfs(uint32_t index) {
+  const PyTorchNode& node = pytorch_nodes_[index];
+  switch (node.pytorch_type) {
+    case PyTorchNodeType::GPU_OP:
+      return -1;
+    case PyTorchNodeType::CPU_OP:
+      if (!is_cpu_op_[index]) {
+        is_cpu_op_[index] = true;
+        cpu_ops_.push_back(index);
+        findChildrenGpuOps(index, index);
+      }
+      return node.id;
+    case PyTorchNodeType::LABEL:
+      break;
+  }
+  int64_t largest_id = -1;
+  for (uint32_t i = children_begin_[index]; i < children_begin_[index + 1];
+       ++i) {
+    largest_id = max(largest_id, dfs(children_[i]));
+  }
+  return largest_id;
+}
+
+void PyTorch2ChakraConverter::findChildrenGpuOps(
+    uint32_t root_cpu_op,
+    uint32_t index) {
+  for (uint32_t i = children_begin_[index]; i < children_begin_[index + 1];
+       ++i) {
+    uint32_t child = children_[i];
+    if (pytorch_nodes_[child].pytorch_type == PyTorchNodeType::GPU_OP) {
+      gpu_ops_[root_cpu_op].push_back(child);
+    } else {
+      findChildrenGpuOps(root_cpu_op, child);
+    }
+  }
+}
+
+uint64_t PyTorch2ChakraConverter::assignChakraId(uint64_t id) {
+  // Operators split into several nodes take the next free IDs, so that
+  // operators that run first keep smaller IDs
+  uint64_t chakra_id = id;
+  while (!total_assigned_ids_.insert(chakra_id).second) {
+    ++chakra_id;
+  }
+  assigned_ids_[id].push_back(chakra_id);
+  return chakra_id;
+}
+
+void PyTorch2ChakraConverter::mergeGpuOpsWithCpuOps() {
+  for (uint32_t index : cpu_ops_) {
+    PyTorchNode& cpu_op = pytorch_nodes_[index];
+    auto gpu_ops = gpu_ops_.find(index);
+    if (gpu_ops == gpu_ops_.end()) {
+      cpu_op.chakra_id = assignChakraId(cpu_op.id);
+      nodes_.push_back(
+          {cpu_op.chakra_id, index, -1, static_cast<uint64_t>(cpu_op.dur),
+           kNone, {}});
+      node_gpu_op_.push_back(kNone);
+      node_prev_part_.push_back(kNone);
+      continue;
+    }
+
+    // A CPU operator launching GPU operators is split into one part
+    // before each of them, plus one after the last one, so that the CPU
+    // and the GPU can run at the same time
+    vector<uint32_t>& launched = gpu_ops->second;
+    stable_sort(
+        launched.begin(), launched.end(), [this](uint32_t a, uint32_t b) {
+          return pytorch_nodes_[a].ts < pytorch_nodes_[b].ts;
+        });
+    string where = " under CPU operator " + to_string(cpu_op.id);
+    if (!cpu_op.has_dur) {
+      throw runtime_error("No duration" + where);
+    }
+    for (uint32_t gpu_op : launched) {
+      if (cpu_op.ts + cpu_op.dur <= pytorch_nodes_[gpu_op].ts) {
+        throw runtime_error("GPU operator launched after the end" + where);
+      }
+    }
+
+    int64_t last_ts = cpu_op.ts;
+    for (size_t i = 0; i <= launched.size(); ++i) {
+      uint64_t chakra_id = assignChakraId(cpu_op.id);
+      uint32_t gpu_op = kNone;
+      int64_t ts;
+      int64_t dur;
+      if (i < launched.size()) {
+        gpu_op = launched[i];
+        PyTorchNode& gpu_node = pytorch_nodes_[gpu_op];
+        gpu_node.chakra_id = assignChakraId(gpu_node.id);
+        if (gpu_node.ts <= cpu_op.ts) {
+          throw runtime_error(
+              "GPU operator launched before the start" + where);
+        }
+        ts = last_ts;
+        dur = gpu_node.ts - last_ts;
+        last_ts = gpu_node.ts;
+      } else {
+        dur = cpu_op.dur - (last_ts - cpu_op.ts);
+        ts = last_ts;
+        last_ts = ts + dur;
+      }
+      if ((ts < 0) || (dur <= 0)) {
+        throw runtime_error("Invalid timestamps" + where);
+      }
+
+      uint32_t prev_part = kNone;
+      if (i > 0) {
+        prev_part = nodes_.size() - 1;
+      }
+      nodes_.push_back(
+          {chakra_id, index, static_cast<int32_t>(i),
+           static_cast<uint64_t>(dur), kNone, {}});
+      node_gpu_op_.push_back(gpu_op);
+      node_prev_part_.push_back(prev_part);
+    }
+  }
+}
+
+void PyTorch2ChakraConverter::discoverCommOps() {
+  // Communication nodes are looked up by the IDs their parent got in the
+  // merge; later nodes take precedence
+  auto add = [this](
+                 unordered_map<uint64_t, uint32_t>& comm_nodes,
+                 uint32_t index) {
+    uint64_t parent = pytorch_nodes_[index].parent;
+    auto assigned = assigned_ids_.find(parent);
+    if (assigned == assigned_ids_.end()) {
+      comm_nodes[parent] = index;
+      return;
+    }
+    for (uint64_t id : assigned->second) {
+      comm_nodes[id] = index;
+    }
+  };
+  for (uint32_t index : order_) {
+    if (pytorch_nodes_[index].is_record_param_comms) {
+      add(record_param_comms_nodes_, index);
+    }
+    if (pytorch_nodes_[index].is_nccl) {
+      add(nccl_nodes_, index);
+    }
+  }
+
+  // Phases end with the last part of their largest operator
+  for (uint64_t& id : inter_phase_dependency_) {
+    id = assigned_ids_.at(id).back();
+  }
+  sort(inter_phase_dependency_.begin(), inter_phase_dependency_.end());
+}
+
+uint32_t PyTorch2ChakraConverter::getNcclNode(uint64_t chakra_id) const {
+  // The NCCL node is either a child of a record_param_comms node under the
+  // operator, or directly under the operator
+  auto record_param_comms = record_param_comms_nodes_.find(chakra_id);
+  if (record_param_comms != record_param_comms_nodes_.end()) {
+    uint64_t id = pytorch_nodes_[record_param_comms->second].chakra_id;
+    auto nccl = nccl_nodes_.find(id);
+    if (nccl == nccl_nodes_.end()) {
+      throw runtime_error(
+          "Node " + to_string(chakra_id) +
+          " has a record_param_comms node but no NCCL node");
+    }
+    return nccl->second;
+  }
+  auto nccl = nccl_nodes_.find(chakra_id);
+  if (nccl == nccl_nodes_.end()) {
+    throw runtime_error(
+        "Node " + to_string(chakra_id) +
+        " has neither a record_param_comms node nor an NCCL node");
+  }
+  return nccl->second;
+}
+
+void PyTorch2ChakraConverter::convertNodes() {
+  TensorMap input_storage_ids;
+  TensorMap output_storage_ids;
+  TensorMap input_tensor_ids;
+  TensorMap output_tensor_ids;
+  auto add = [this](
+                 TensorMap& storage_ids,
+                 TensorMap& tensor_ids,
+                 uint32_t begin,
+                 uint32_t end,
+                 uint64_t node_id) {
+    for (uint32_t i = begin; i < end; ++i) {
+      (tensors_[i].is_storage_id ? storage_ids : tensor_ids)
+          .add(tensors_[i].id, node_id);
+    }
+  };
+
+  size_t num_cpu_nodes = nodes_.size();
+  for (size_t i = 0; i < num_cpu_nodes; ++i) {
+    uint64_t id = nodes_[i].id;
+    const PyTorchNode& cpu_op = pytorch_nodes_[nodes_[i].pytorch_node];
+    add(input_storage_ids,
+        input_tensor_ids,
+        cpu_op.inputs_begin,
+        cpu_op.inputs_end,
+        id);
+    add(output_storage_ids,
+        output_tensor_ids,
+        cpu_op.outputs_begin,
+        cpu_op.outputs_end,
+        id);
+
+    uint32_t gpu_op = node_gpu_op_[i];
+    if (gpu_op != kNone) {
+      // GPU operators are assumed to read what their CPU operator reads;
+      // what they write is ignored, as GPU to CPU dependencies would
+      // serialize the CPU behind the GPU
+      const PyTorchNode& gpu_node = pytorch_nodes_[gpu_op];
+      add(input_storage_ids,
+          input_tensor_ids,
+          gpu_node.inputs_begin,
+          gpu_node.inputs_end,
+          gpu_node.chakra_id);
+      uint32_t nccl_node = kNone;
+      if (cpu_op.type == ChakraProtoMsg::COMM_COLL_NODE) {
+        nccl_node = getNcclNode(id);
+      }
+      nodes_.push_back(
+          {gpu_node.chakra_id, gpu_op, -1,
+           static_cast<uint64_t>(gpu_node.dur), nccl_node, {id}});
+    }
+
+    vector<uint64_t>& data_deps = nodes_[i].data_deps;
+    auto phase = lower_bound(
+        inter_phase_dependency_.begin(), inter_phase_dependency_.end(), id);
+    if (phase != inter_phase_dependency_.begin()) {
+      data_deps.push_back(*(phase - 1));
+    }
+    if (node_prev_part_[i] != kNone) {
+      data_deps.push_back(nodes_[node_prev_part_[i]].id);
+    }
+  }
+  vector<TensorRef>().swap(tensors_);
+
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    node_index_.emplace(nodes_[i].id, i);
+  }
+  identifyDataDependency(input_storage_ids, output_storage_ids);
+  identifyDataDependency(input_tensor_ids, output_tensor_ids);
+
+  // A dependency found more than once is kept where it was first found
+  unordered_set<uint64_t> seen;
+  for (ChakraNode& node : nodes_) {
+    seen.clear();
+    auto end = remove_if(
+        node.data_deps.begin(), node.data_deps.end(), [&seen](uint64_t id) {
+          return !seen.insert(id).second;
+        });
+    node.data_deps.erase(end, node.data_deps.end());
+  }
+}
+
+void PyTorch2ChakraConverter::identifyDataDependency(
+    const TensorMap& inputs,
+    const TensorMap& outputs) {
+  // A node depends on every earlier node writing a tensor it reads
+  for (int64_t tensor_id : inputs.order) {
+    auto parent_ids = outputs.node_ids.find(tensor_id);
+    if (parent_ids == outputs.node_ids.end()) {
+      continue;
+    }
+    for (uint64_t child_id : inputs.node_ids.at(tensor_id)) {
+      vector<uint64_t>& data_deps = nodes_[node_index_.at(child_id)].data_deps;
+      for (uint64_t parent_id : parent_ids->second) {
+        if (parent_id < child_id) {
+          data_deps.push_back(parent_id);
+        }
+      }
+    }
+  }
+}
+
+void PyTorch2ChakraConverter::convertNode(
+    const ChakraNode& node,
+    const JsonValue& pytorch_node,
+    ChakraProtoMsg::Node& chakra_node) const {
+  const PyTorchNode& info = pytorch_nodes_[node.pytorch_node];
+  chakra_node.set_id(node.id);
+  string name = getField(pytorch_node, "name").str;
+  if (node.part != -1) {
+    name += "(" + to_string(node.part) + ")";
+  }
+  chakra_node.set_name(name);
+  chakra_node.set_type(info.type);
+  chakra_node.add_ctrl_deps(info.parent);
+  for (uint64_t dep : node.data_deps) {
+    chakra_node.add_data_deps(dep);
+  }
+  chakra_node.set_duration_micros(node.duration);
+
+  const pair<ChakraProtoMsg::IOInfo*, const char*> io_infos[] = {
+      {chakra_node.mutable_inputs(), "input"},
+      {chakra_node.mutable_outputs(), "output"},
+  };
+  for (const auto& io_info : io_infos) {
+    string prefix = io_info.second;
+    string str;
+    appendPythonRepr(str, getField(pytorch_node, (prefix + "s").c_str()));
+    io_info.first->set_values(str);
+    str.clear();
+    appendPythonRepr(
+        str, getField(pytorch_node, (prefix + "_shapes").c_str()));
+    io_info.first->set_shapes(str);
+    str.clear();
+    appendPythonRepr(str, getField(pytorch_node, (prefix + "_types").c_str()));
+    io_info.first->set_types(str);
+  }
+
+  ChakraProtoMsg::AttributeProto* attr = chakra_node.add_attr();
+  attr->set_name("is_cpu_op");
+  attr->set_bool_val(info.pytorch_type == PyTorchNodeType::CPU_OP);
+  for (const char* key : {"fw_parent", "fw_tid", "op_schema", "seq_id",
+                          "rf_id", "scope", "tid"}) {
+    const JsonValue* value = pytorch_node.find(key);
+    if (value == nullptr) {
+      continue;
+    }
+    attr = chakra_node.add_attr();
+    attr->set_name(key);
+    if (value->type == JsonValue::Type::String) {
+      attr->set_string_val(value->str);
+    } else {
+      attr->set_int64_val(value->asInt64());
+    }
+  }
+}
+
+void PyTorch2ChakraConverter::writeTrace() {
+  // ProtoOutputStream panics if it cannot open the file
+  if (!ofstream(output_filename_, ios::binary)) {
+    throw runtime_error("Failed to open output file: " + output_filename_);
+  }
+  ProtoOutputStream output(output_filename_);
+
+  ChakraProtoMsg::GlobalMetadata metadata;
+  const pair<const char*, bool> metadata_keys[] = {
+      {"schema", true},
+      {"pid", false},
+      {"time", true},
+      {"start_ts", false},
+      {"finish_ts", false},
+  };
+  for (const auto& key : metadata_keys) {
+    auto value = metadata_.find(key.first);
+    if (value == metadata_.end()) {
+      throw runtime_error(
+          string("No ") + key.first + " in " + input_filename_);
+    }
+    ChakraProtoMsg::AttributeProto* attr = metadata.add_attr();
+    attr->set_name(key.first);
+    if (key.second) {
+      attr->set_string_val(value->second.str);
+    } else {
+      attr->set_uint64_val(value->second.asUint64());
+    }
+  }
+  output.write(metadata);
+
+  vector<uint32_t> order(nodes_.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return nodes_[a].id < nodes_[b].id;
+  });
+
+  // Nodes are mostly written in the order they appear in the trace, a
+  // small buffer serves most reads
+  JsonReader reader(input_filename_, 64 * 1024);
+  JsonValue pytorch_node;
+  JsonValue nccl_node;
+  ChakraProtoMsg::Node chakra_node;
+  for (uint32_t index : order) {
+    const ChakraNode& node = nodes_[index];
+    reader.seek(pytorch_nodes_[node.pytorch_node].offset);
+    reader.readValue(pytorch_node);
+    chakra_node.Clear();
+    convertNode(node, pytorch_node, chakra_node);
+
+    if (node.nccl_node != kNone) {
+      reader.seek(pytorch_nodes_[node.nccl_node].offset);
+      reader.readValue(nccl_node);
+      ChakraProtoMsg::AttributeProto* attr = chakra_node.add_attr();
+      attr->set_name("comm_type");
+      attr->set_int64_val(
+          getCollectiveCommType(getField(nccl_node, "name").str));
+      attr = chakra_node.add_attr();
+      attr->set_name("comm_size");
+      attr->set_int64_val(getCommSize(nccl_node));
+      attr = chakra_node.add_attr();
+      attr->set_name("involved_dim");
+      for (uint32_t i = 0; i < num_dims_; ++i) {
+        attr->mutable_bool_list()->add_values(true);
+      }
+    }
+    output.write(chakra_node);
+  }
+  num_nodes_ = nodes_.size();
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "et_converter/json_reader.h"
+#include "et_def/et_def.pb.h"
+
+namespace Chakra {
+
+// Converts a PyTorch execution trace (JSON) to a Chakra execution trace
+// with the same nodes as PyTorch2ChakraConverter in
+// pytorch2chakra_converter.py: CPU operators are split around the GPU
+// operators they launch, and data dependencies are found from the storage
+// and tensor IDs operators read and write.
+//
+// The JSON document is never held in memory. A first pass keeps a few
+// fields of every node (IDs, timestamps, how the node is classified, and
+// the tensors it reads and writes), which is all the merge of CPU and GPU
+// operators and the dependency discovery need; a second pass reads back
+// the nodes to write, one at a time, from their offset in the file.
+// Instances are independent, so ranks can be converted in parallel.
+class PyTorch2ChakraConverter {
+ public:
+  PyTorch2ChakraConverter(
+      std::string input_filename,
+      std::string output_filename,
+      uint32_t num_dims);
+
+  // Throws std::runtime_error if the trace cannot be read or converted
+  void convert();
+  // Number of nodes written by convert()
+  uint64_t numNodes() const;
+
+ private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  enum class PyTorchNodeType : uint8_t { CPU_OP, GPU_OP, LABEL };
+
+  // What the first pass keeps of a PyTorch node
+  struct PyTorchNode {
+    uint64_t id;
+    // ID after the merge of CPU and GPU operators, which renumbers the
+    // operators that are not split (the split ones are copied)
+    uint64_t chakra_id;
+    uint64_t parent;
+    int64_t ts;
+    int64_t dur;
+    bool has_dur;
+    PyTorchNodeType pytorch_type;
+    ChakraProtoMsg::NodeType type;
+    bool is_thread_root;
+    bool is_record_param_comms;
+    bool is_nccl;
+    uint64_t offset;
+    // Ranges of tensors_
+    uint32_t inputs_begin;
+    uint32_t inputs_end;
+    uint32_t outputs_begin;
+    uint32_t outputs_end;
+  };
+
+  // A tensor is identified by its storage ID if that is valid (positive),
+  // by its tensor ID otherwise
+  struct TensorRef {
+    int64_t id;
+    bool is_storage_id;
+  };
+
+  // Tensor ID to the IDs of the nodes using it, with the tensor IDs in
+  // the order they were first seen, which decides the order of the
+  // dependencies found
+  struct TensorMap {
+    std::unordered_map<int64_t, std::vector<uint64_t>> node_ids;
+    std::vector<int64_t> order;
+
+    void add(int64_t tensor_id, uint64_t node_id);
+  };
+
+  // A Chakra node to write
+  struct ChakraNode {
+    uint64_t id;
+    uint32_t pytorch_node;
+    // Index of the part of a split CPU operator, appended to its name
+    int32_t part;
+    uint64_t duration;
+    // For GPU operators of collectives, the NCCL node giving the
+    // collective type and size
+    uint32_t nccl_node;
+    std::vector<uint64_t> data_deps;
+  };
+
+  void readTrace();
+  void addPyTorchNode(const JsonValue& node, uint64_t offset);
+  void addTensors(const JsonValue* values, uint32_t& begin, uint32_t& end);
+  void discoverCpuOps();
+  int64_t dfs(uint32_t index);
+  void findChildrenGpuOps(uint32_t root_cpu_op, uint32_t index);
+  void mergeGpuOpsWithCpuOps();
+  uint64_t assignChakraId(uint64_t id);
+  void discoverCommOps();
+  uint32_t getNcclNode(uint64_t chakra_id) const;
+  void convertNodes();
+  void identifyDataDependency(
+      const TensorMap& inputs,
+      const TensorMap& outputs);
+  void writeTrace();
+  void convertNode(
+      const ChakraNode& node,
+      const JsonValue& pytorch_node,
+      ChakraProtoMsg::Node& chakra_node) const;
+
+  const std::string input_filename_;
+  const std::string output_filename_;
+  const uint32_t num_dims_;
+
+  std::vector<PyTorchNode> pytorch_nodes_{};
+  std::vector<TensorRef> tensors_{};
+  std::unordered_map<uint64_t, uint32_t> pytorch_node_index_{};
+  std::unordered_map<std::string, JsonValue> metadata_{};
+
+  // Node indices sorted by timestamp, and children of every node in that
+  // order
+  std::vector<uint32_t> order_{};
+  std::vector<uint32_t> children_begin_{};
+  std::vector<uint32_t> children_{};
+
+  // Top-level CPU operators, and the GPU operators under each of them
+  std::vector<uint32_t> cpu_ops_{};
+  std::vector<bool> is_cpu_op_{};
+  std::unordered_map<uint32_t, std::vector<uint32_t>> gpu_ops_{};
+  // Largest CPU operator ID of every phase of the iteration; a phase
+  // starts after all operators of the previous phases
+  std::vector<uint64_t> inter_phase_dependency_{};
+
+  // IDs given to every PyTorch operator by the merge, and all IDs taken
+  std::unordered_map<uint64_t, std::vector<uint64_t>> assigned_ids_{};
+  std::unordered_set<uint64_t> total_assigned_ids_{};
+  // CPU operators after the merge, then their GPU operators. Parts of a
+  // split CPU operator have the GPU operator they launch and depend on
+  // the previous part.
+  std::vector<ChakraNode> nodes_{};
+  std::vector<uint32_t> node_gpu_op_{};
+  std::vector<uint32_t> node_prev_part_{};
+
+  std::unordered_map<uint64_t, uint32_t> record_param_comms_nodes_{};
+  std::unordered_map<uint64_t, uint32_t> nccl_nodes_{};
+  std::unordered_map<uint64_t, uint32_t> node_index_{};
+  uint64_t num_nodes_{0};
+};
+
+} // namespace Chakra
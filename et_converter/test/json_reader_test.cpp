@@ -0,0 +1,89 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "et_converter/json_reader.h"
+
+using namespace std;
+using namespace Chakra;
+
+static const char* const kFilename = "json_reader_test.json";
+
+static void check(bool condition, const string& message) {
+  if (!condition) {
+    throw runtime_error(message);
+  }
+}
+
+static JsonValue parse(const string& json, size_t buffer_size) {
+  ofstream(kFilename, ios::binary) << json;
+  JsonReader reader(kFilename, buffer_size);
+  JsonValue value;
+  reader.readValue(value);
+  return value;
+}
+
+static bool rejects(const string& json) {
+  try {
+    parse(json, 4);
+  } catch (const runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+// Escapes, surrogate pairs, and the non-finite floats Python writes, read
+// through a buffer small enough for every token to straddle a refill and
+// through the default one; malformed input has to be rejected
+int main() {
+  try {
+    for (size_t buffer_size : {size_t(4), size_t(1024 * 1024)}) {
+      const string run = "buffer of " + to_string(buffer_size) + " bytes: ";
+      JsonValue value = parse(
+          R"([ "q\"b\\s\/", "\b\f\n\r\t", "A\u00e9\u20AC",)"
+          R"( "\ud83d\ude00!", NaN, Infinity, -Infinity, -1.5e3 ])",
+          buffer_size);
+      check(
+          (value.type == JsonValue::Type::Array) && (value.array.size() == 8),
+          run + "array");
+      check(value.array[0].str == "q\"b\\s/", run + "quote escapes");
+      check(value.array[1].str == "\b\f\n\r\t", run + "control escapes");
+      check(
+          value.array[2].str == "A\xc3\xa9\xe2\x82\xac", run + "\\u escapes");
+      check(
+          value.array[3].str == "\xf0\x9f\x98\x80!", run + "surrogate pair");
+      check(std::isnan(value.array[4].asDouble()), run + "NaN");
+      check(value.array[5].asDouble() == HUGE_VAL, run + "Infinity");
+      check(value.array[6].asDouble() == -HUGE_VAL, run + "-Infinity");
+      check(value.array[7].asDouble() == -1500.0, run + "float");
+      for (size_t i = 4; i < 7; ++i) {
+        check(!value.array[i].isInteger(), run + "non-finite integer");
+      }
+    }
+
+    const char* const malformed[] = {
+        R"("\x")",
+        R"("\u00g0")",
+        R"("\ud83d\u0041")",
+        R"("unterminated)",
+        "-NaN",
+        "Inf",
+        "-",
+    };
+    for (const char* json : malformed) {
+      check(rejects(json), string("accepted ") + json);
+    }
+    cout << "json reader: ok" << endl;
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    remove(kFilename);
+    return EXIT_FAILURE;
+  }
+  remove(kFilename);
+  return EXIT_SUCCESS;
+}
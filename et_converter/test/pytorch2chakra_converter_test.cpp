@@ -0,0 +1,71 @@
+#include <google/protobuf/util/message_differencer.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "et_converter/pytorch2chakra_converter.h"
+#include "third_party/utils/protoio.hh"
+
+using namespace std;
+using namespace Chakra;
+using google::protobuf::util::MessageDifferencer;
+
+static void check(bool condition, const string& message) {
+  if (!condition) {
+    throw runtime_error(message);
+  }
+}
+
+// Converts a PyTorch trace and compares the result node for node with the
+// trace pytorch2chakra_converter.py writes for it. The fixture has split
+// CPU operators, collectives with and without record_param_comms, and
+// operator inputs with escaped strings and non-finite floats.
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    cerr << "usage: " << argv[0] << " <test data directory>" << endl;
+    return EXIT_FAILURE;
+  }
+  const string data_dir = argv[1];
+  const string output_filename = "pytorch2chakra_converter_test.et";
+  try {
+    PyTorch2ChakraConverter converter(
+        data_dir + "/pytorch_trace.json", output_filename, 2);
+    converter.convert();
+
+    ProtoInputStream expected(data_dir + "/pytorch_trace.et");
+    ProtoInputStream output(output_filename);
+    ChakraProtoMsg::GlobalMetadata expected_metadata;
+    ChakraProtoMsg::GlobalMetadata metadata;
+    check(expected.read(expected_metadata), "Missing expected metadata");
+    check(output.read(metadata), "Missing global metadata");
+    check(
+        MessageDifferencer::Equals(expected_metadata, metadata),
+        "Global metadata differs");
+
+    ChakraProtoMsg::Node expected_node;
+    ChakraProtoMsg::Node node;
+    uint64_t num_nodes = 0;
+    while (expected.read(expected_node)) {
+      const string position = "node " + to_string(num_nodes);
+      check(output.read(node), position + " missing");
+      check(
+          MessageDifferencer::Equals(expected_node, node),
+          position + " differs: expected\n" + expected_node.DebugString() +
+              "got\n" + node.DebugString());
+      ++num_nodes;
+    }
+    check(!output.read(node), "More nodes than expected");
+    check(converter.numNodes() == num_nodes, "Wrong number of nodes");
+    cout << "converted " << num_nodes << " nodes: ok" << endl;
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    remove(output_filename.c_str());
+    return EXIT_FAILURE;
+  }
+  remove(output_filename.c_str());
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "et_feeder/benchmark/synthetic_trace.h"
+#include "et_feeder/et_feeder.h"
+
+using namespace std;
+using namespace Chakra;
+
+// Regression suite for trace reading and the feeder. Every benchmark runs
+// on each of the synthetic trace shapes below.
+
+static const uint64_t kNumNodes = 1 << 17;
+
+struct TraceShape {
+  const char* name;
+  SyntheticTraceShape shape;
+};
+
+static const TraceShape kShapes[] = {
+    {"chain", SyntheticTraceShape::Chain},
+    {"fan_out", SyntheticTraceShape::FanOut},
+    {"long_range", SyntheticTraceShape::LongRange},
+    {"collective", SyntheticTraceShape::Collective},
+};
+
+// Raw message throughput of ProtoInputStream, without any feeder work
+static void BM_ProtoInputStreamRead(
+    benchmark::State& state,
+    SyntheticTraceShape shape,
+    bool gzip) {
+  const string filename =
+      gzip ? "et_feeder_benchmark.et.gz" : "et_feeder_benchmark.et";
+  writeSyntheticTrace(filename, shape, kNumNodes);
+
+  uint64_t num_bytes = 0;
+  for (auto _ : state) {
+    ProtoInputStream et(filename);
+    ChakraProtoMsg::GlobalMetadata metadata;
+    et.read(metadata);
+    ChakraProtoMsg::Node node;
+    uint64_t num_nodes = 0;
+    while (et.read(node)) {
+      ++num_nodes;
+    }
+    benchmark::DoNotOptimize(num_nodes);
+    num_bytes = et.tell();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kNumNodes);
+  state.SetBytesProcessed(state.iterations() * num_bytes);
+  remove(filename.c_str());
+}
+
+// Feeder construction with the whole trace in the first window. The time
+// beyond BM_ProtoInputStreamRead of the same shape goes to building nodes
+// and linking their dependencies.
+static void BM_ETFeederDependencyResolution(
+    benchmark::State& state,
+    SyntheticTraceShape shape) {
+  const string filename = "et_feeder_benchmark.et";
+  writeSyntheticTrace(filename, shape, kNumNodes);
+
+  ETFeederOptions options;
+  options.window_size = kNumNodes;
+  for (auto _ : state) {
+    ETFeeder feeder(filename, options);
+    benchmark::DoNotOptimize(feeder.hasNodesToIssue());
+  }
+
+  state.SetItemsProcessed(state.iterations() * kNumNodes);
+  remove(filename.c_str());
+}
+
+// Issues and completes every node of the trace in batches, with a window
+// much smaller than the trace, and reports how many nodes and how much
+// memory the feeder held at most
+static void BM_ETFeederIssueComplete(
+    benchmark::State& state,
+    SyntheticTraceShape shape) {
+  const string filename = "et_feeder_benchmark.et";
+  writeSyntheticTrace(filename, shape, kNumNodes);
+
+  ETFeederOptions options;
+  options.window_size = 16384;
+  ETFeederWindowStats stats;
+  vector<shared_ptr<ETFeederNode>> nodes(1024);
+  vector<uint64_t> node_ids(nodes.size());
+  for (auto _ : state) {
+    ETFeeder feeder(filename, options);
+    while (feeder.hasNodesToIssue()) {
+      size_t num_nodes =
+          feeder.getNextIssuableNodes(nodes.data(), nodes.size());
+      for (size_t i = 0; i < num_nodes; ++i) {
+        node_ids[i] = nodes[i]->id();
+        nodes[i].reset();
+      }
+      feeder.completeNodes(node_ids.data(), num_nodes);
+    }
+    stats = feeder.getWindowStats();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kNumNodes);
+  state.counters["peak_live_nodes"] = stats.peak_live_nodes;
+  state.counters["peak_live_bytes"] = stats.peak_live_bytes;
+  remove(filename.c_str());
+}
+
+int main(int argc, char** argv) {
+  for (const TraceShape& shape : kShapes) {
+    string suffix = string("/") + shape.name;
+    benchmark::RegisterBenchmark(
+        ("BM_ProtoInputStreamRead" + suffix).c_str(),
+        BM_ProtoInputStreamRead,
+        shape.shape,
+        false)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(
+        ("BM_ProtoInputStreamRead" + suffix + "/gzip").c_str(),
+        BM_ProtoInputStreamRead,
+        shape.shape,
+        true)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(
+        ("BM_ETFeederDependencyResolution" + suffix).c_str(),
+        BM_ETFeederDependencyResolution,
+        shape.shape)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(
+        ("BM_ETFeederIssueComplete" + suffix).c_str(),
+        BM_ETFeederIssueComplete,
+        shape.shape)
+        ->Unit(benchmark::kMillisecond);
+  }
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
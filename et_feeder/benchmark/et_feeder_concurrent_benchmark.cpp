@@ -0,0 +1,119 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "et_feeder/benchmark/synthetic_trace.h"
+#include "et_feeder/concurrent_et_feeder.h"
+#include "et_feeder/et_feeder.h"
+
+using namespace std;
+using namespace Chakra;
+
+static const uint64_t kNumNodes = 1 << 18;
+static const char* const kTraceFilename = "et_feeder_concurrent_benchmark.et";
+
+// Stands in for the time a simulator worker spends on a node
+static void simulateNode(const shared_ptr<ETFeederNode>& node) {
+  uint64_t x = node->id();
+  for (int i = 0; i < 256; ++i) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  benchmark::DoNotOptimize(x);
+}
+
+// Replays a trace with 256 independent chains on N worker threads that
+// issue and complete nodes through the concurrent feeder
+static void BM_ConcurrentETFeeder(benchmark::State& state) {
+  writeSyntheticTrace(
+      kTraceFilename, SyntheticTraceShape::Parallel, kNumNodes);
+  const uint32_t num_workers = static_cast<uint32_t>(state.range(0));
+
+  for (auto _ : state) {
+    ConcurrentETFeederOptions options;
+    options.num_workers = num_workers;
+    options.window_size = 16384;
+    ConcurrentETFeeder feeder(kTraceFilename, options);
+
+    vector<thread> workers;
+    for (uint32_t worker = 0; worker < num_workers; ++worker) {
+      workers.emplace_back([&feeder, worker] {
+        while (feeder.hasNodesToIssue()) {
+          shared_ptr<ETFeederNode> node = feeder.getNextIssuableNode(worker);
+          if (node == nullptr) {
+            this_thread::yield();
+            continue;
+          }
+          simulateNode(node);
+          feeder.completeNode(worker, node);
+        }
+      });
+    }
+    for (auto& t : workers) {
+      t.join();
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kNumNodes);
+  remove(kTraceFilename);
+}
+
+// The same replay with an ETFeeder behind one mutex, as parallel
+// simulators had to do before
+static void BM_LockedETFeeder(benchmark::State& state) {
+  writeSyntheticTrace(
+      kTraceFilename, SyntheticTraceShape::Parallel, kNumNodes);
+  const uint32_t num_workers = static_cast<uint32_t>(state.range(0));
+
+  for (auto _ : state) {
+    ETFeederOptions options;
+    options.window_size = 16384;
+    ETFeeder feeder(kTraceFilename, options);
+    mutex feeder_mutex;
+
+    vector<thread> workers;
+    for (uint32_t worker = 0; worker < num_workers; ++worker) {
+      workers.emplace_back([&feeder, &feeder_mutex] {
+        while (true) {
+          shared_ptr<ETFeederNode> node;
+          {
+            lock_guard<mutex> lock(feeder_mutex);
+            if (!feeder.hasNodesToIssue()) {
+              return;
+            }
+            node = feeder.getNextIssuableNode();
+          }
+          if (node == nullptr) {
+            this_thread::yield();
+            continue;
+          }
+          simulateNode(node);
+          uint64_t node_id = node->id();
+          lock_guard<mutex> lock(feeder_mutex);
+          feeder.completeNodes(&node_id, 1);
+        }
+      });
+    }
+    for (auto& t : workers) {
+      t.join();
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kNumNodes);
+  remove(kTraceFilename);
+}
+
+BENCHMARK(BM_ConcurrentETFeeder)
+    ->RangeMultiplier(2)
+    ->Range(1, 32)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_LockedETFeeder)
+    ->RangeMultiplier(2)
+    ->Range(1, 32)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
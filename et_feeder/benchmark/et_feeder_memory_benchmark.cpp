@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+
+#include <cstdio>
+
+#include "et_feeder/benchmark/synthetic_trace.h"
+#include "et_feeder/et_feeder.h"
+
+using namespace std;
+using namespace Chakra;
+
+static size_t heapBytesInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+// Reports the heap bytes held per node once the whole trace sits in the
+// first window, for the default, arena-backed, and lean node storage.
+static void BM_ETFeederMemoryPerNode(
+    benchmark::State& state,
+    bool arena,
+    bool lean) {
+  const uint64_t num_nodes = static_cast<uint64_t>(state.range(0));
+  const string filename = "et_feeder_memory_benchmark.et";
+  writeSyntheticTrace(filename, SyntheticTraceShape::Chain, num_nodes);
+
+  ETFeederOptions options;
+  options.arena_storage = arena;
+  options.lean_nodes = lean;
+
+  double bytes_per_node = 0.0;
+  for (auto _ : state) {
+    malloc_trim(0);
+    size_t heap_before = heapBytesInUse();
+    ETFeeder feeder(filename, options);
+    size_t heap_after = heapBytesInUse();
+    bytes_per_node =
+        static_cast<double>(heap_after - heap_before) / num_nodes;
+    benchmark::DoNotOptimize(feeder.hasNodesToIssue());
+  }
+
+  state.counters["bytes_per_node"] = bytes_per_node;
+  remove(filename.c_str());
+}
+
+BENCHMARK_CAPTURE(BM_ETFeederMemoryPerNode, default_storage, false, false)
+    ->Arg(1 << 18)
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ETFeederMemoryPerNode, arena_storage, true, false)
+    ->Arg(1 << 18)
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ETFeederMemoryPerNode, lean_nodes, false, true)
+    ->Arg(1 << 18)
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,45 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+
+#include "et_feeder/benchmark/synthetic_trace.h"
+#include "et_feeder/et_feeder.h"
+
+using namespace std;
+using namespace Chakra;
+
+// Measures ETFeeder construction (global metadata plus the first window) on
+// traces that fit in one window. Startup time should grow linearly with the
+// number of nodes, also when half of the nodes wait on far-away parents.
+static void BM_ETFeederStartup(
+    benchmark::State& state,
+    SyntheticTraceShape shape) {
+  const uint64_t num_nodes = static_cast<uint64_t>(state.range(0));
+  const string filename = "et_feeder_startup_benchmark.et";
+  writeSyntheticTrace(filename, shape, num_nodes);
+
+  for (auto _ : state) {
+    ETFeeder feeder(filename);
+    benchmark::DoNotOptimize(feeder.hasNodesToIssue());
+  }
+
+  state.SetComplexityN(state.range(0));
+  state.SetItemsProcessed(state.iterations() * num_nodes);
+  remove(filename.c_str());
+}
+
+BENCHMARK_CAPTURE(BM_ETFeederStartup, chain, SyntheticTraceShape::Chain)
+    ->RangeMultiplier(2)
+    ->Range(1 << 14, 1 << 18)
+    ->Unit(benchmark::kMillisecond)
+    ->Complexity(benchmark::oN);
+BENCHMARK_CAPTURE(
+    BM_ETFeederStartup,
+    long_range,
+    SyntheticTraceShape::LongRange)
+    ->RangeMultiplier(2)
+    ->Range(1 << 14, 1 << 18)
+    ->Unit(benchmark::kMillisecond)
+    ->Complexity(benchmark::oN);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "et_def/et_def.pb.h"
+#include "third_party/utils/protoio.hh"
+
+namespace Chakra {
+
+enum class SyntheticTraceShape {
+  // Every node depends on the previous one
+  Chain,
+  // Two chains written one after the other, where every node of the first
+  // chain also depends on the node at the same position in the second one
+  LongRange,
+  // kSyntheticTraceWidth chains interleaved node by node, so that that many
+  // nodes are issuable at any time
+  Parallel,
+  // Groups of kSyntheticTraceWidth nodes where all nodes of a group depend
+  // on its first node, and first nodes form a chain
+  FanOut,
+  // Chain where every fourth node is a collective with comm attributes
+  Collective,
+  // Iterations of kSyntheticTraceWidth nodes that repeat node for node:
+  // a chain where every node also depends on its counterpart in the
+  // previous iteration, so that the trace folds
+  Iterations,
+  // Iterations of kSyntheticTraceWidth nodes that repeat node for node,
+  // chained by control dependencies only; every fourth node also lists the
+  // node two before it both as a data and as a control parent
+  CtrlDeps,
+};
+
+static const uint64_t kSyntheticTraceWidth = 256;
+
+// Gzip traces (.gz) are written in independent blocks unless block_gzip is
+// false, which writes a single gzip stream
+inline void writeSyntheticTrace(
+    const std::string& filename,
+    SyntheticTraceShape shape,
+    uint64_t num_nodes,
+    bool block_gzip = true) {
+  ProtoOutputStream et(filename, block_gzip);
+
+  ChakraProtoMsg::GlobalMetadata metadata;
+  metadata.set_version("0.0.4");
+  et.write(metadata);
+
+  ChakraProtoMsg::Node node;
+  for (uint64_t id = 0; id < num_nodes; ++id) {
+    node.Clear();
+    node.set_id(id);
+    node.set_name("COMP_NODE_" + std::to_string(id));
+    node.set_type(ChakraProtoMsg::COMP_NODE);
+    node.set_duration_micros(1);
+
+    ChakraProtoMsg::AttributeProto* attr = node.add_attr();
+    attr->set_name("is_cpu_op");
+    attr->set_bool_val(false);
+
+    switch (shape) {
+      case SyntheticTraceShape::Chain:
+        if (id > 0) {
+          node.add_data_deps(id - 1);
+        }
+        break;
+      case SyntheticTraceShape::LongRange:
+        if ((id > 0) && (id != num_nodes / 2)) {
+          node.add_data_deps(id - 1);
+        }
+        if (id < num_nodes / 2) {
+          node.add_data_deps(id + num_nodes / 2);
+        }
+        break;
+      case SyntheticTraceShape::Parallel:
+        if (id >= kSyntheticTraceWidth) {
+          node.add_data_deps(id - kSyntheticTraceWidth);
+        }
+        break;
+      case SyntheticTraceShape::FanOut: {
+        uint64_t group_start = id - id % kSyntheticTraceWidth;
+        if (id != group_start) {
+          node.add_data_deps(group_start);
+        } else if (id > 0) {
+          node.add_data_deps(id - kSyntheticTraceWidth);
+        }
+        break;
+      }
+      case SyntheticTraceShape::Collective:
+        if (id > 0) {
+          node.add_data_deps(id - 1);
+        }
+        if (id % 4 == 3) {
+          node.set_name("COMM_COLL_NODE_" + std::to_string(id));
+          node.set_type(ChakraProtoMsg::COMM_COLL_NODE);
+          attr = node.add_attr();
+          attr->set_name("comm_type");
+          attr->set_int64_val(ChakraProtoMsg::ALL_REDUCE);
+          attr = node.add_attr();
+          attr->set_name("comm_size");
+          attr->set_int64_val(4 * 1024 * 1024);
+          attr = node.add_attr();
+          attr->set_name("involved_dim");
+          attr->mutable_bool_list()->add_values(true);
+          attr->mutable_bool_list()->add_values(false);
+        }
+        break;
+      case SyntheticTraceShape::Iterations:
+        node.set_name(
+            "COMP_NODE_" + std::to_string(id % kSyntheticTraceWidth));
+        if (id > 0) {
+          node.add_data_deps(id - 1);
+        }
+        if (id >= kSyntheticTraceWidth) {
+          node.add_data_deps(id - kSyntheticTraceWidth);
+        }
+        break;
+      case SyntheticTraceShape::CtrlDeps:
+        node.set_name(
+            "COMP_NODE_" + std::to_string(id % kSyntheticTraceWidth));
+        if (id > 0) {
+          node.add_ctrl_deps(id - 1);
+        }
+        if ((id % 4 == 0) && (id >= 2)) {
+          node.add_data_deps(id - 2);
+          node.add_ctrl_deps(id - 2);
+        }
+        break;
+    }
+    et.write(node);
+  }
+}
+
+} // namespace Chakra
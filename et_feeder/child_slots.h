@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace Chakra {
+
+// Slots of the children of a node. Most nodes have one or two children,
+// which are kept inline in the space of the pointer to a larger array, so
+// such nodes take no allocation for their children.
+class ChildSlots {
+ public:
+  ChildSlots() = default;
+  // Deep copy, for forked nodes
+  ChildSlots(const ChildSlots& other) {
+    for (uint32_t slot : other) {
+      push_back(slot);
+    }
+  }
+  ~ChildSlots() {
+    clear();
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  uint32_t size() const {
+    return size_;
+  }
+
+  const uint32_t* begin() const {
+    return capacity_ > kInlineSlots ? slots_ : inline_slots_;
+  }
+
+  const uint32_t* end() const {
+    return begin() + size_;
+  }
+
+  uint32_t back() const {
+    return begin()[size_ - 1];
+  }
+
+  void push_back(uint32_t slot) {
+    if (size_ == capacity_) {
+      grow();
+    }
+    (capacity_ > kInlineSlots ? slots_ : inline_slots_)[size_++] = slot;
+  }
+
+  // Also frees a larger array
+  void clear() {
+    if (capacity_ > kInlineSlots) {
+      delete[] slots_;
+    }
+    size_ = 0;
+    capacity_ = kInlineSlots;
+  }
+
+ private:
+  ChildSlots& operator=(const ChildSlots&) = delete;
+
+  static const uint32_t kInlineSlots = 2;
+
+  void grow() {
+    uint32_t* slots = new uint32_t[uint64_t(capacity_) * 2];
+    std::copy(begin(), end(), slots);
+    if (capacity_ > kInlineSlots) {
+      delete[] slots_;
+    }
+    slots_ = slots;
+    capacity_ *= 2;
+  }
+
+  union {
+    uint32_t inline_slots_[kInlineSlots];
+    uint32_t* slots_;
+  };
+  uint32_t size_{0};
+  uint32_t capacity_{kInlineSlots};
+};
+
+} // namespace Chakra
@@ -0,0 +1,264 @@
+#include "et_feeder/concurrent_et_feeder.h"
+
+#include <stdexcept>
+
+using namespace std;
+using namespace Chakra;
+
+// Completed nodes are dropped from the dependency graph every this many
+// nodes read, so that a long refill does not hold on to them
+static const uint64_t kRetireInterval = 4096;
+
+ConcurrentETFeeder::ConcurrentETFeeder(
+    string filename,
+    ConcurrentETFeederOptions options)
+    : trace_(filename, options.decompression_threads),
+      reader_(filename, trace_),
+      options_(options) {
+  if (!trace_.is_open()) {
+    throw runtime_error("Failed to open trace file: " + filename);
+  }
+  if ((options_.num_workers == 0) || (options_.window_size == 0)) {
+    throw invalid_argument(
+        "Concurrent feeder needs at least one worker and a non-empty window");
+  }
+
+  ChakraProtoMsg::GlobalMetadata metadata;
+  reader_.readGlobalMetadata(metadata);
+
+  for (uint32_t i = 0; i < options_.num_workers; ++i) {
+    workers_.emplace_back(make_unique<Worker>());
+  }
+  // The first window is read up front, so read errors surface here
+  readNextWindow();
+  refill_thread_ = thread(&ConcurrentETFeeder::refillLoop, this);
+}
+
+ConcurrentETFeeder::~ConcurrentETFeeder() {
+  {
+    lock_guard<mutex> lock(refill_mutex_);
+    refill_stop_ = true;
+  }
+  refill_cv_.notify_one();
+  if (refill_thread_.joinable()) {
+    refill_thread_.join();
+  }
+}
+
+uint32_t ConcurrentETFeeder::numWorkers() const {
+  return options_.num_workers;
+}
+
+bool ConcurrentETFeeder::hasNodesToIssue() const {
+  // et_complete_ is set after the last node has been counted as live
+  return !et_complete_.load(memory_order_acquire) ||
+      (num_live_nodes_.load(memory_order_acquire) != 0);
+}
+
+shared_ptr<ETFeederNode> ConcurrentETFeeder::getNextIssuableNode(
+    uint32_t worker) {
+  checkWorker(worker);
+  if (num_ready_nodes_.load(memory_order_relaxed) != 0) {
+    // Own nodes are handed out in the order they became issuable, other
+    // workers steal the most recent ones from the other end
+    {
+      Worker& own = *workers_[worker];
+      lock_guard<mutex> lock(own.mutex);
+      if (!own.ready_nodes.empty()) {
+        shared_ptr<ETFeederNode> node = move(own.ready_nodes.front());
+        own.ready_nodes.pop_front();
+        num_ready_nodes_.fetch_sub(1, memory_order_relaxed);
+        return node;
+      }
+    }
+    for (uint32_t i = 1; i < workers_.size(); ++i) {
+      Worker& victim = *workers_[(worker + i) % workers_.size()];
+      lock_guard<mutex> lock(victim.mutex);
+      if (!victim.ready_nodes.empty()) {
+        shared_ptr<ETFeederNode> node = move(victim.ready_nodes.back());
+        victim.ready_nodes.pop_back();
+        num_ready_nodes_.fetch_sub(1, memory_order_relaxed);
+        num_steals_.fetch_add(1, memory_order_relaxed);
+        return node;
+      }
+    }
+  }
+
+  if (et_complete_.load(memory_order_acquire) && (refill_error_ != nullptr)) {
+    rethrow_exception(refill_error_);
+  }
+  return nullptr;
+}
+
+void ConcurrentETFeeder::completeNode(
+    uint32_t worker,
+    const shared_ptr<ETFeederNode>& node) {
+  checkWorker(worker);
+  vector<uint32_t> child_slots;
+  if (!node->finish(child_slots)) {
+    return;
+  }
+
+  // Children freed by this node are queued with the worker that is likely
+  // to still have the node's data in cache
+  size_t num_ready = 0;
+  for (uint32_t child_slot : child_slots) {
+    if (nodes_.get(child_slot)->finishParent()) {
+      child_slots[num_ready++] = child_slot;
+    }
+  }
+  {
+    Worker& own = *workers_[worker];
+    lock_guard<mutex> lock(own.mutex);
+    for (size_t i = 0; i < num_ready; ++i) {
+      own.ready_nodes.emplace_back(nodes_.get(child_slots[i]));
+    }
+    own.completed_node_ids.push_back(node->id());
+  }
+  num_ready_nodes_.fetch_add(num_ready, memory_order_relaxed);
+
+  // Wake the refill thread once half of the window has been completed;
+  // it sleeps for good once the whole trace has been read
+  uint64_t num_live = num_live_nodes_.fetch_sub(1, memory_order_acq_rel) - 1;
+  if ((num_live == options_.window_size / 2) &&
+      !et_complete_.load(memory_order_acquire)) {
+    {
+      lock_guard<mutex> lock(refill_mutex_);
+      refill_requested_ = true;
+    }
+    refill_cv_.notify_one();
+  }
+}
+
+ConcurrentETFeederStats ConcurrentETFeeder::getStats() const {
+  ConcurrentETFeederStats stats;
+  stats.nodes_read = num_read_nodes_.load(memory_order_relaxed);
+  stats.live_nodes = num_live_nodes_.load(memory_order_relaxed);
+  stats.ready_nodes = num_ready_nodes_.load(memory_order_relaxed);
+  stats.steals = num_steals_.load(memory_order_relaxed);
+  stats.refills = num_refills_.load(memory_order_relaxed);
+  return stats;
+}
+
+void ConcurrentETFeeder::checkWorker(uint32_t worker) const {
+  if (worker >= workers_.size()) {
+    throw out_of_range(
+        "Worker " + to_string(worker) + " out of range, the feeder has " +
+        to_string(workers_.size()) + " workers");
+  }
+}
+
+void ConcurrentETFeeder::pushReadyNode(
+    uint32_t worker,
+    shared_ptr<ETFeederNode> node) {
+  {
+    lock_guard<mutex> lock(workers_[worker]->mutex);
+    workers_[worker]->ready_nodes.emplace_back(move(node));
+  }
+  num_ready_nodes_.fetch_add(1, memory_order_relaxed);
+}
+
+void ConcurrentETFeeder::linkNode(ETTraceNode& trace_node) {
+  shared_ptr<ETFeederNode>& node = trace_node.node;
+  // Parents link to the node by its slot, so it is held first
+  dep_graph_.emplace(node->id(), nodes_.add(node));
+
+  // Workers may finish parents while the node is being linked; an extra
+  // count held until the end keeps it from becoming issuable halfway
+  node->addUnfinishedParent();
+  for (uint64_t parent_id : trace_node.parent_ids) {
+    if (finished_node_ids_.contains(parent_id)) {
+      continue;
+    }
+    node->addUnfinishedParent();
+    auto parent_node = dep_graph_.find(parent_id);
+    if (parent_node == dep_graph_.end()) {
+      dep_unresolved_children_[parent_id].push_back(node->slot());
+    } else if (!nodes_.get(parent_node->second)->addChildIfUnfinished(node)) {
+      // Completed, but not retired yet
+      node->finishParent();
+    }
+  }
+
+  num_live_nodes_.fetch_add(1, memory_order_acq_rel);
+  num_read_nodes_.fetch_add(1, memory_order_relaxed);
+
+  // No worker can finish the node before it has been issued, so its
+  // waiting children are added without taking its lock
+  auto waiting = dep_unresolved_children_.find(node->id());
+  if (waiting != dep_unresolved_children_.end()) {
+    for (uint32_t child_slot : waiting->second) {
+      node->addChild(nodes_.get(child_slot));
+    }
+    dep_unresolved_children_.erase(waiting);
+  }
+
+  if (node->finishParent()) {
+    pushReadyNode(next_refill_worker_, move(node));
+    next_refill_worker_ = (next_refill_worker_ + 1) % workers_.size();
+  }
+}
+
+void ConcurrentETFeeder::retireCompletedNodes() {
+  vector<uint64_t> node_ids;
+  for (auto& worker : workers_) {
+    {
+      lock_guard<mutex> lock(worker->mutex);
+      node_ids.swap(worker->completed_node_ids);
+    }
+    for (uint64_t node_id : node_ids) {
+      auto node = dep_graph_.find(node_id);
+      if (node != dep_graph_.end()) {
+        nodes_.remove(node->second);
+        dep_graph_.erase(node);
+      }
+      finished_node_ids_.insert(node_id);
+    }
+    node_ids.clear();
+  }
+}
+
+void ConcurrentETFeeder::readNextWindow() {
+  retireCompletedNodes();
+  ETTraceNode trace_node;
+  uint64_t num_read = 0;
+  while (!et_complete_.load(memory_order_relaxed) &&
+         ((num_live_nodes_.load(memory_order_relaxed) < options_.window_size) ||
+          !dep_unresolved_children_.empty())) {
+    if (!reader_.readNode(trace_node)) {
+      et_complete_.store(true, memory_order_release);
+      break;
+    }
+    linkNode(trace_node);
+    if (++num_read % kRetireInterval == 0) {
+      retireCompletedNodes();
+    }
+  }
+  if (num_read != 0) {
+    num_refills_.fetch_add(1, memory_order_relaxed);
+  }
+}
+
+void ConcurrentETFeeder::refillLoop() {
+  try {
+    unique_lock<mutex> lock(refill_mutex_);
+    while (!refill_stop_) {
+      refill_cv_.wait(lock, [this]() {
+        return refill_stop_ ||
+            (refill_requested_ && !et_complete_.load(memory_order_relaxed));
+      });
+      if (refill_stop_) {
+        break;
+      }
+      // Completions during the refill ask for the next one
+      refill_requested_ = false;
+      lock.unlock();
+      readNextWindow();
+      lock.lock();
+    }
+  } catch (...) {
+    // Workers rethrow the error once they run out of issuable nodes
+    refill_error_ = current_exception();
+    et_complete_.store(true, memory_order_release);
+  }
+}
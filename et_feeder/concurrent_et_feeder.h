@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "et_feeder/et_feeder_node.h"
+#include "et_feeder/et_node_slab.h"
+#include "et_feeder/et_trace_reader.h"
+#include "et_feeder/node_id_bitmap.h"
+#include "third_party/utils/protoio.hh"
+
+namespace Chakra {
+
+struct ConcurrentETFeederOptions {
+  // Number of worker threads issuing and completing nodes
+  uint32_t num_workers = 1;
+  // Nodes held by the feeder at a time; the refill thread tops the window
+  // up once half of it has been completed, and reads past it while held
+  // nodes wait for parents that have not been read yet
+  uint32_t window_size = 4096 * 256;
+  // Threads decompressing block gzip traces (1 decompresses on the refill
+  // thread, 0 uses one per core); ignored for other traces
+  uint32_t decompression_threads = 1;
+};
+
+struct ConcurrentETFeederStats {
+  // Nodes read from the trace so far
+  uint64_t nodes_read = 0;
+  // Nodes read but not completed yet
+  uint64_t live_nodes = 0;
+  // Issuable nodes waiting for a worker
+  uint64_t ready_nodes = 0;
+  // Nodes a worker took from the queue of another worker
+  uint64_t steals = 0;
+  // Number of times the refill thread read nodes
+  uint64_t refills = 0;
+};
+
+// Feeds the nodes of a trace in dependency order to several worker threads
+// at once. Every worker is identified by an index below num_workers and
+// may call getNextIssuableNode() and completeNode() concurrently with the
+// others. Issuable nodes are kept in one queue per worker: nodes freed by
+// a completion stay with the worker that completed the parent, and workers
+// that run dry steal from the others. Parents are counted down atomically
+// per node, so completions only synchronize when they free the same child.
+// Reading and linking new nodes is left to a dedicated refill thread.
+class ConcurrentETFeeder {
+ public:
+  ConcurrentETFeeder(
+      std::string filename,
+      ConcurrentETFeederOptions options = ConcurrentETFeederOptions());
+  ~ConcurrentETFeeder();
+
+  uint32_t numWorkers() const;
+  // False once every node of the trace has been completed
+  bool hasNodesToIssue() const;
+  // Returns nullptr when no node is issuable at the moment
+  std::shared_ptr<ETFeederNode> getNextIssuableNode(uint32_t worker);
+  // Frees the children of an issued node and drops it from the feeder
+  void completeNode(uint32_t worker, const std::shared_ptr<ETFeederNode>& node);
+  ConcurrentETFeederStats getStats() const;
+
+ private:
+  ConcurrentETFeeder(const ConcurrentETFeeder&) = delete;
+  ConcurrentETFeeder& operator=(const ConcurrentETFeeder&) = delete;
+
+  struct alignas(64) Worker {
+    std::mutex mutex;
+    std::deque<std::shared_ptr<ETFeederNode>> ready_nodes;
+    // Nodes completed by the worker that the refill thread still has to
+    // drop from the dependency graph
+    std::vector<uint64_t> completed_node_ids;
+  };
+
+  void checkWorker(uint32_t worker) const;
+  void pushReadyNode(uint32_t worker, std::shared_ptr<ETFeederNode> node);
+  void linkNode(ETTraceNode& trace_node);
+  void retireCompletedNodes();
+  void readNextWindow();
+  void refillLoop();
+
+  ProtoInputStream trace_;
+  ETTraceReader reader_;
+  const ConcurrentETFeederOptions options_;
+
+  std::vector<std::unique_ptr<Worker>> workers_{};
+  std::atomic<uint64_t> num_ready_nodes_{0};
+  std::atomic<uint64_t> num_live_nodes_{0};
+  std::atomic<uint64_t> num_steals_{0};
+
+  // Owned by the refill thread (and the constructor before it starts),
+  // except that workers look up the slots of the children they free, which
+  // stay put until the children have been completed
+  ETNodeSlab nodes_{};
+  std::unordered_map<uint64_t, uint32_t> dep_graph_{};
+  std::unordered_map<uint64_t, std::vector<uint32_t>>
+      dep_unresolved_children_{};
+  NodeIdBitmap finished_node_ids_{};
+  uint32_t next_refill_worker_{0};
+
+  std::thread refill_thread_{};
+  std::mutex refill_mutex_{};
+  std::condition_variable refill_cv_{};
+  // Set by the worker that completes half of the window
+  bool refill_requested_{false};
+  bool refill_stop_{false};
+  std::atomic<bool> et_complete_{false};
+  std::atomic<uint64_t> num_read_nodes_{0};
+  std::atomic<uint64_t> num_refills_{0};
+  // Set by the refill thread before et_complete_, rethrown to the workers
+  std::exception_ptr refill_error_{};
+};
+
+} // namespace Chakra
@@ -0,0 +1,399 @@
+#include "et_feeder/et_compiled_trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "third_party/utils/protoio.hh"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ET_COMPILED_TRACE_HAVE_MMAP 1
+#endif
+
+using namespace std;
+using namespace Chakra;
+
+static const char kMagic[8] = {'C', 'H', 'K', 'R', 'C', 'E', 'T', '\0'};
+static const uint32_t kVersion = 2;
+
+namespace {
+
+// Column data accumulated by the compiler before it is written out
+struct ColumnBuffer {
+  template <typename T>
+  void append(const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+  }
+
+  vector<char> data{};
+};
+
+} // namespace
+
+bool ETCompiledTrace::isCompiledTrace(const string& filename) {
+  ifstream file(filename, ios::in | ios::binary);
+  char magic[sizeof(kMagic)];
+  if (!file.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+void ETCompiledTrace::compile(
+    const string& et_filename,
+    const string& compiled_filename) {
+  ProtoInputStream et(et_filename);
+  if (!et.is_open()) {
+    throw runtime_error("Failed to open trace file: " + et_filename);
+  }
+
+  ChakraProtoMsg::GlobalMetadata metadata;
+  if (!et.read(metadata)) {
+    throw runtime_error("Failed to read global metadata: " + et_filename);
+  }
+
+  ColumnBuffer columns[kNumColumns];
+  unordered_map<string, uint32_t> string_ids;
+  uint64_t num_nodes = 0;
+  uint64_t num_involved_dims = 0;
+  uint64_t num_data_deps = 0;
+  uint64_t num_ctrl_deps = 0;
+  uint64_t string_data_size = 0;
+
+  columns[kColumnInvolvedDimOffset].append<uint64_t>(0);
+  columns[kColumnDataDepOffset].append<uint64_t>(0);
+  columns[kColumnCtrlDepOffset].append<uint64_t>(0);
+  columns[kColumnStringOffset].append<uint64_t>(0);
+
+  ChakraProtoMsg::Node node;
+  while (et.read(node)) {
+    auto string_id = string_ids.find(node.name());
+    if (string_id == string_ids.end()) {
+      string_id =
+          string_ids
+              .emplace(node.name(), static_cast<uint32_t>(string_ids.size()))
+              .first;
+      columns[kColumnStringData].data.insert(
+          columns[kColumnStringData].data.end(),
+          node.name().begin(),
+          node.name().end());
+      string_data_size += node.name().size();
+      columns[kColumnStringOffset].append<uint64_t>(string_data_size);
+    }
+
+    ETFeederNodeAttrs attrs;
+    ETFeederNode::decodeAttrs(node, attrs);
+
+    columns[kColumnId].append<uint64_t>(node.id());
+    columns[kColumnName].append<uint32_t>(string_id->second);
+    columns[kColumnType].append<uint32_t>(node.type());
+    columns[kColumnRuntime].append<uint64_t>(node.duration_micros());
+    columns[kColumnIsCpuOp].append<uint8_t>(attrs.is_cpu_op);
+    columns[kColumnNumOps].append<uint64_t>(attrs.num_ops);
+    columns[kColumnTensorLoc].append<uint32_t>(attrs.tensor_loc);
+    columns[kColumnTensorSize].append<uint64_t>(attrs.tensor_size);
+    columns[kColumnCommType].append<uint32_t>(attrs.comm_type);
+    columns[kColumnCommPriority].append<uint32_t>(attrs.comm_priority);
+    columns[kColumnCommSize].append<uint64_t>(attrs.comm_size);
+    columns[kColumnCommSrc].append<uint32_t>(attrs.comm_src);
+    columns[kColumnCommDst].append<uint32_t>(attrs.comm_dst);
+    columns[kColumnCommTag].append<uint32_t>(attrs.comm_tag);
+    columns[kColumnRemainingRuntime].append<uint64_t>(attrs.remaining_runtime);
+
+    for (bool involved : attrs.involved_dim) {
+      columns[kColumnInvolvedDim].append<uint8_t>(involved);
+    }
+    num_involved_dims += attrs.involved_dim.size();
+    columns[kColumnInvolvedDimOffset].append<uint64_t>(num_involved_dims);
+
+    for (uint64_t dep : node.data_deps()) {
+      columns[kColumnDataDep].append<uint64_t>(dep);
+    }
+    num_data_deps += node.data_deps_size();
+    columns[kColumnDataDepOffset].append<uint64_t>(num_data_deps);
+
+    for (uint64_t dep : node.ctrl_deps()) {
+      columns[kColumnCtrlDep].append<uint64_t>(dep);
+    }
+    num_ctrl_deps += node.ctrl_deps_size();
+    columns[kColumnCtrlDepOffset].append<uint64_t>(num_ctrl_deps);
+
+    ++num_nodes;
+  }
+
+  string serialized_metadata;
+  metadata.SerializeToString(&serialized_metadata);
+  columns[kColumnMetadata].data.assign(
+      serialized_metadata.begin(), serialized_metadata.end());
+
+  ETCompiledTraceHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_columns = kNumColumns;
+  header.num_nodes = num_nodes;
+  header.num_strings = string_ids.size();
+  header.num_involved_dims = num_involved_dims;
+  header.num_data_deps = num_data_deps;
+  header.num_ctrl_deps = num_ctrl_deps;
+  header.string_data_size = string_data_size;
+  header.metadata_size = serialized_metadata.size();
+
+  uint64_t offset = sizeof(header);
+  for (uint32_t col = 0; col < kNumColumns; ++col) {
+    offset = (offset + 7) & ~static_cast<uint64_t>(7);
+    header.column_offset[col] = offset;
+    offset += columns[col].data.size();
+  }
+
+  ofstream out(compiled_filename, ios::out | ios::binary | ios::trunc);
+  if (!out.good()) {
+    throw runtime_error("Failed to open output file: " + compiled_filename);
+  }
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint64_t written = sizeof(header);
+  const char padding[8] = {};
+  for (uint32_t col = 0; col < kNumColumns; ++col) {
+    out.write(padding, header.column_offset[col] - written);
+    out.write(columns[col].data.data(), columns[col].data.size());
+    written = header.column_offset[col] + columns[col].data.size();
+  }
+  if (!out.good()) {
+    throw runtime_error("Failed to write output file: " + compiled_filename);
+  }
+}
+
+ETCompiledTrace::ETCompiledTrace(const string& filename)
+    : filename_(filename) {
+#ifdef ET_COMPILED_TRACE_HAVE_MMAP
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(addr);
+        size_ = st.st_size;
+        mapped_ = true;
+      }
+    }
+    close(fd);
+  }
+#endif
+
+  if (!mapped_) {
+    ifstream file(filename, ios::in | ios::binary | ios::ate);
+    if (!file.good()) {
+      throw runtime_error("Failed to open compiled trace: " + filename);
+    }
+    buffer_.resize(file.tellg());
+    file.seekg(0);
+    file.read(buffer_.data(), buffer_.size());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+  }
+
+  if (size_ < sizeof(ETCompiledTraceHeader)) {
+    throw runtime_error("Truncated compiled trace: " + filename);
+  }
+  header_ = reinterpret_cast<const ETCompiledTraceHeader*>(data_);
+  if ((memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0) ||
+      (header_->version != kVersion) ||
+      (header_->num_columns != kNumColumns)) {
+    throw runtime_error("Unsupported compiled trace: " + filename);
+  }
+  validate();
+}
+
+ETCompiledTrace::~ETCompiledTrace() {
+#ifdef ET_COMPILED_TRACE_HAVE_MMAP
+  if (mapped_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+#endif
+}
+
+// Checks everything readNode() and findNode() index with, so that a
+// truncated or corrupt trace is rejected here rather than read out of bounds
+void ETCompiledTrace::validate() const {
+  const uint64_t num_nodes = header_->num_nodes;
+  // Also keeps the counts plus one below from overflowing
+  if ((num_nodes >= size_) || (header_->num_strings >= size_)) {
+    throw runtime_error("Corrupt compiled trace: " + filename_);
+  }
+  validateColumn(kColumnId, num_nodes, sizeof(uint64_t));
+  validateColumn(kColumnName, num_nodes, sizeof(uint32_t));
+  validateColumn(kColumnType, num_nodes, sizeof(uint32_t));
+  validateColumn(kColumnRuntime, num_nodes, sizeof(uint64_t));
+  validateColumn(kColumnIsCpuOp, num_nodes, sizeof(uint8_t));
+  validateColumn(kColumnNumOps, num_nodes, sizeof(uint64_t));
+  validateColumn(kColumnTensorLoc, num_nodes, sizeof(uint32_t));
+  validateColumn(kColumnTensorSize, num_nodes, sizeof(uint64_t));
+  validateColumn(kColumnCommType, num_nodes, sizeof(uint32_t));
+  validateColumn(kColumnCommPriority, num_nodes, sizeof(uint32_t));
+  validateColumn(kColumnCommSize, num_nodes, sizeof(uint64_t));
+  validateColumn(kColumnCommSrc, num_nodes, sizeof(uint32_t));
+  validateColumn(kColumnCommDst, num_nodes, sizeof(uint32_t));
+  validateColumn(kColumnCommTag, num_nodes, sizeof(uint32_t));
+  validateColumn(kColumnRemainingRuntime, num_nodes, sizeof(uint64_t));
+  validateColumn(kColumnInvolvedDimOffset, num_nodes + 1, sizeof(uint64_t));
+  validateColumn(
+      kColumnInvolvedDim, header_->num_involved_dims, sizeof(uint8_t));
+  validateColumn(kColumnDataDepOffset, num_nodes + 1, sizeof(uint64_t));
+  validateColumn(kColumnDataDep, header_->num_data_deps, sizeof(uint64_t));
+  validateColumn(kColumnCtrlDepOffset, num_nodes + 1, sizeof(uint64_t));
+  validateColumn(kColumnCtrlDep, header_->num_ctrl_deps, sizeof(uint64_t));
+  validateColumn(
+      kColumnStringOffset, header_->num_strings + 1, sizeof(uint64_t));
+  validateColumn(
+      kColumnStringData, header_->string_data_size, sizeof(char));
+  validateColumn(kColumnMetadata, header_->metadata_size, sizeof(char));
+
+  validateOffsets(
+      kColumnInvolvedDimOffset, num_nodes + 1, header_->num_involved_dims);
+  validateOffsets(kColumnDataDepOffset, num_nodes + 1, header_->num_data_deps);
+  validateOffsets(kColumnCtrlDepOffset, num_nodes + 1, header_->num_ctrl_deps);
+  validateOffsets(
+      kColumnStringOffset,
+      header_->num_strings + 1,
+      header_->string_data_size);
+
+  const uint32_t* names = column<uint32_t>(kColumnName);
+  for (uint64_t i = 0; i < num_nodes; ++i) {
+    if (names[i] >= header_->num_strings) {
+      throw runtime_error(
+          "Corrupt compiled trace: name of node " + to_string(i) +
+          " out of range in " + filename_);
+    }
+  }
+}
+
+// The column has to start at an aligned offset past the header and hold
+// num_values values of value_size bytes within the file
+void ETCompiledTrace::validateColumn(
+    ETCompiledTraceColumn col,
+    uint64_t num_values,
+    uint64_t value_size) const {
+  uint64_t offset = header_->column_offset[col];
+  if ((offset < sizeof(ETCompiledTraceHeader)) || (offset > size_) ||
+      (offset % sizeof(uint64_t) != 0) ||
+      (num_values > (size_ - offset) / value_size)) {
+    throw runtime_error(
+        "Truncated compiled trace: column " + to_string(col) +
+        " out of bounds in " + filename_);
+  }
+}
+
+// Offsets into a values column have to start at 0, never decrease, and end
+// at the number of values in the column
+void ETCompiledTrace::validateOffsets(
+    ETCompiledTraceColumn col,
+    uint64_t num_offsets,
+    uint64_t end) const {
+  const uint64_t* offsets = column<uint64_t>(col);
+  bool valid = (offsets[0] == 0) && (offsets[num_offsets - 1] == end);
+  for (uint64_t i = 1; valid && (i < num_offsets); ++i) {
+    valid = offsets[i - 1] <= offsets[i];
+  }
+  if (!valid) {
+    throw runtime_error(
+        "Corrupt compiled trace: offsets in column " + to_string(col) +
+        " out of order in " + filename_);
+  }
+}
+
+uint64_t ETCompiledTrace::numNodes() const {
+  return header_->num_nodes;
+}
+
+uint64_t ETCompiledTrace::findNode(uint64_t node_id) const {
+  const uint64_t* ids = column<uint64_t>(kColumnId);
+  return find(ids, ids + header_->num_nodes, node_id) - ids;
+}
+
+bool ETCompiledTrace::readGlobalMetadata(
+    ChakraProtoMsg::GlobalMetadata& metadata) const {
+  return metadata.ParseFromArray(
+      column<char>(kColumnMetadata), header_->metadata_size);
+}
+
+shared_ptr<ETFeederNode> ETCompiledTrace::readNode(
+    uint64_t index,
+    shared_ptr<ETNodeSource> source) const {
+  ETFeederNodeAttrs attrs;
+  attrs.is_cpu_op = column<uint8_t>(kColumnIsCpuOp)[index] != 0;
+  attrs.num_ops = column<uint64_t>(kColumnNumOps)[index];
+  attrs.tensor_loc = column<uint32_t>(kColumnTensorLoc)[index];
+  attrs.tensor_size = column<uint64_t>(kColumnTensorSize)[index];
+  attrs.comm_type = static_cast<ChakraProtoMsg::CollectiveCommType>(
+      column<uint32_t>(kColumnCommType)[index]);
+  attrs.comm_priority = column<uint32_t>(kColumnCommPriority)[index];
+  attrs.comm_size = column<uint64_t>(kColumnCommSize)[index];
+  attrs.comm_src = column<uint32_t>(kColumnCommSrc)[index];
+  attrs.comm_dst = column<uint32_t>(kColumnCommDst)[index];
+  attrs.comm_tag = column<uint32_t>(kColumnCommTag)[index];
+  attrs.remaining_runtime = column<uint64_t>(kColumnRemainingRuntime)[index];
+
+  const uint64_t* involved_dim_offset =
+      column<uint64_t>(kColumnInvolvedDimOffset);
+  const uint8_t* involved_dim = column<uint8_t>(kColumnInvolvedDim);
+  attrs.involved_dim.assign(
+      involved_dim + involved_dim_offset[index],
+      involved_dim + involved_dim_offset[index + 1]);
+
+  return make_shared<ETFeederNode>(
+      column<uint64_t>(kColumnId)[index],
+      static_cast<ChakraProtoMsg::NodeType>(
+          column<uint32_t>(kColumnType)[index]),
+      column<uint64_t>(kColumnRuntime)[index],
+      attrs,
+      move(source),
+      index);
+}
+
+vector<uint64_t> ETCompiledTrace::readParentIDs(uint64_t index) const {
+  const uint64_t* data_dep_offset = column<uint64_t>(kColumnDataDepOffset);
+  const uint64_t* ctrl_dep_offset = column<uint64_t>(kColumnCtrlDepOffset);
+  return getParentIDs(
+      column<uint64_t>(kColumnDataDep) + data_dep_offset[index],
+      data_dep_offset[index + 1] - data_dep_offset[index],
+      column<uint64_t>(kColumnCtrlDep) + ctrl_dep_offset[index],
+      ctrl_dep_offset[index + 1] - ctrl_dep_offset[index]);
+}
+
+void ETCompiledTrace::readMessage(uint64_t index, ChakraProtoMsg::Node& node)
+    const {
+  node.set_id(column<uint64_t>(kColumnId)[index]);
+  node.set_type(static_cast<ChakraProtoMsg::NodeType>(
+      column<uint32_t>(kColumnType)[index]));
+  node.set_duration_micros(column<uint64_t>(kColumnRuntime)[index]);
+  node.set_name(readName(index));
+
+  const uint64_t* data_dep_offset = column<uint64_t>(kColumnDataDepOffset);
+  const uint64_t* data_deps = column<uint64_t>(kColumnDataDep);
+  node.mutable_data_deps()->Add(
+      data_deps + data_dep_offset[index],
+      data_deps + data_dep_offset[index + 1]);
+
+  const uint64_t* ctrl_dep_offset = column<uint64_t>(kColumnCtrlDepOffset);
+  const uint64_t* ctrl_deps = column<uint64_t>(kColumnCtrlDep);
+  node.mutable_ctrl_deps()->Add(
+      ctrl_deps + ctrl_dep_offset[index],
+      ctrl_deps + ctrl_dep_offset[index + 1]);
+}
+
+string ETCompiledTrace::readName(uint64_t index) const {
+  uint32_t name = column<uint32_t>(kColumnName)[index];
+  const uint64_t* string_offset = column<uint64_t>(kColumnStringOffset);
+  return string(
+      column<char>(kColumnStringData) + string_offset[name],
+      string_offset[name + 1] - string_offset[name]);
+}
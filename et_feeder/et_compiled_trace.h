@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "et_def/et_def.pb.h"
+#include "et_feeder/et_feeder_node.h"
+
+namespace Chakra {
+
+class ETNodeSource;
+
+// A compiled trace is a precompiled, fixed-layout image of an .et file that
+// can be replayed without protobuf parsing or attribute decoding. Every
+// per-node field is stored as a fixed-width column (struct of arrays),
+// dependencies as packed CSR adjacency arrays, and node names as indices
+// into an interned string table. All values use the host byte order.
+//
+// File layout: an ETCompiledTraceHeader followed by the columns listed in
+// ETCompiledTraceColumn, each starting at an 8-byte aligned offset.
+enum ETCompiledTraceColumn : uint32_t {
+  kColumnId = 0, // uint64_t[num_nodes]
+  kColumnName, // uint32_t[num_nodes], string table index
+  kColumnType, // uint32_t[num_nodes], ChakraProtoMsg::NodeType
+  kColumnRuntime, // uint64_t[num_nodes]
+  kColumnIsCpuOp, // uint8_t[num_nodes]
+  kColumnNumOps, // uint64_t[num_nodes]
+  kColumnTensorLoc, // uint32_t[num_nodes]
+  kColumnTensorSize, // uint64_t[num_nodes]
+  kColumnCommType, // uint32_t[num_nodes]
+  kColumnCommPriority, // uint32_t[num_nodes]
+  kColumnCommSize, // uint64_t[num_nodes]
+  kColumnCommSrc, // uint32_t[num_nodes]
+  kColumnCommDst, // uint32_t[num_nodes]
+  kColumnCommTag, // uint32_t[num_nodes]
+  kColumnRemainingRuntime, // uint64_t[num_nodes]
+  kColumnInvolvedDimOffset, // uint64_t[num_nodes + 1]
+  kColumnInvolvedDim, // uint8_t[num_involved_dims]
+  kColumnDataDepOffset, // uint64_t[num_nodes + 1]
+  kColumnDataDep, // uint64_t[num_data_deps]
+  kColumnCtrlDepOffset, // uint64_t[num_nodes + 1]
+  kColumnCtrlDep, // uint64_t[num_ctrl_deps]
+  kColumnStringOffset, // uint64_t[num_strings + 1]
+  kColumnStringData, // char[string_data_size]
+  kColumnMetadata, // serialized ChakraProtoMsg::GlobalMetadata
+  kNumColumns
+};
+
+struct ETCompiledTraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_columns;
+  uint64_t num_nodes;
+  uint64_t num_strings;
+  uint64_t num_involved_dims;
+  uint64_t num_data_deps;
+  uint64_t num_ctrl_deps;
+  uint64_t string_data_size;
+  uint64_t metadata_size;
+  uint64_t column_offset[kNumColumns];
+};
+
+class ETCompiledTrace {
+ public:
+  static bool isCompiledTrace(const std::string& filename);
+  // Converts an .et file (plain or gzip) into a compiled trace
+  static void compile(
+      const std::string& et_filename,
+      const std::string& compiled_filename);
+
+  ETCompiledTrace(const std::string& filename);
+  ~ETCompiledTrace();
+
+  uint64_t numNodes() const;
+  // Position of the first node with the given ID, numNodes() if there is none
+  uint64_t findNode(uint64_t node_id) const;
+  bool readGlobalMetadata(ChakraProtoMsg::GlobalMetadata& metadata) const;
+  // Decodes the node at the given position straight from the columns,
+  // without a message; the node reads its name and message from source
+  // when asked for them
+  std::shared_ptr<ETFeederNode> readNode(
+      uint64_t index,
+      std::shared_ptr<ETNodeSource> source) const;
+  std::vector<uint64_t> readParentIDs(uint64_t index) const;
+  // The message carries id, name, type, duration and dependencies but no
+  // attr list; attribute values only live in the node
+  void readMessage(uint64_t index, ChakraProtoMsg::Node& node) const;
+  std::string readName(uint64_t index) const;
+
+ private:
+  ETCompiledTrace(const ETCompiledTrace&) = delete;
+  ETCompiledTrace& operator=(const ETCompiledTrace&) = delete;
+
+  void validate() const;
+  void validateColumn(
+      ETCompiledTraceColumn col,
+      uint64_t num_values,
+      uint64_t value_size) const;
+  void validateOffsets(
+      ETCompiledTraceColumn col,
+      uint64_t num_offsets,
+      uint64_t end) const;
+
+  template <typename T>
+  const T* column(ETCompiledTraceColumn col) const {
+    return reinterpret_cast<const T*>(data_ + header_->column_offset[col]);
+  }
+
+  const std::string filename_;
+  const char* data_{nullptr};
+  size_t size_{0};
+  bool mapped_{false};
+  std::vector<char> buffer_{};
+  const ETCompiledTraceHeader* header_{nullptr};
+};
+
+} // namespace Chakra
@@ -1,168 +1,776 @@
 #include "et_feeder/et_feeder.h"
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
 using namespace std;
 using namespace Chakra;
 
-ETFeeder::ETFeeder(string filename)
-    : trace_(filename), window_size_(4096 * 256), et_complete_(false) {
+// Every n-th node read is measured to estimate the memory held per node
+static const uint64_t kNodeBytesSampleInterval = 64;
+// Window size cap in adaptive mode when no node budget is set, as a
+// multiple of the initial window size
+static const uint64_t kMaxWindowGrowth = 64;
+// Distance between inflate checkpoints recorded for forks, which inflate
+// up to this much of a gzip trace to reach their read position
+static const uint64_t kForkCheckpointSpan = 8 * 1024 * 1024;
+
+template <typename IssuePolicy>
+BasicETFeeder<IssuePolicy>::BasicETFeeder(
+    string filename,
+    ETFeederOptions options)
+    : filename_(filename),
+      options_(options),
+      trace_(filename, options.decompression_threads),
+      reader_(
+          filename,
+          trace_,
+          options.arena_storage,
+          options.lean_nodes
+              ? make_shared<ETNodeSource>(filename, indexFilename(filename))
+              : nullptr),
+      window_size_(options.window_size),
+      et_complete_(false),
+      start_node_id_(options.start_node_id) {
   if (!trace_.is_open()) { // Assuming a method to check if file is open
     throw std::runtime_error("Failed to open trace file: " + filename);
   }
+  if (options_.prefetch && (options_.prefetch_queue_size == 0)) {
+    throw invalid_argument("Prefetching needs a non-empty prefetch queue");
+  }
 
   try {
+    if (!reader_.isCompiled() && options_.fork_checkpoints &&
+        indexFilename(filename).empty()) {
+      // Has no effect on plain traces
+      fork_checkpoints_ = make_shared<ProtoStreamIndex>();
+      trace_.recordCheckpoints(fork_checkpoints_.get(), kForkCheckpointSpan);
+    }
     readGlobalMetadata();
+    if (reader_.isFolded() && (start_node_id_ != 0)) {
+      throw runtime_error(
+          "Starting at a node is not supported for folded traces: " +
+          filename);
+    }
+    if (start_node_id_ != 0) {
+      seekToNode(filename, start_node_id_);
+    }
+    if (options_.prefetch) {
+      prefetch_queue_ =
+          make_unique<SPSCQueue<ETTraceNode>>(options_.prefetch_queue_size);
+      startPrefetch();
+    }
     readNextWindow();
   } catch (const std::exception& e) {
     cerr << "Error in constructor: " << e.what() << endl;
+    stopPrefetch();
     throw; // Rethrow the exception for caller to handle
   }
 }
 
-ETFeeder::~ETFeeder() {}
+// Copies the state of a parent whose prefetch thread is stopped, with the
+// nodes it had prefetched but not read yet
+template <typename IssuePolicy>
+BasicETFeeder<IssuePolicy>::BasicETFeeder(
+    BasicETFeeder& parent,
+    const vector<ETTraceNode>& prefetched)
+    : filename_(parent.filename_),
+      options_(parent.options_),
+      trace_(parent.filename_, parent.options_.decompression_threads),
+      reader_(parent.reader_, trace_),
+      window_size_(parent.window_size_),
+      et_complete_(parent.et_complete_),
+      start_node_id_(parent.start_node_id_),
+      topological_order_(parent.topological_order_),
+      max_back_reach_(parent.max_back_reach_),
+      nodes_(
+          parent.nodes_,
+          [](const shared_ptr<ETFeederNode>& node) { return node->fork(); }),
+      dep_graph_(parent.dep_graph_),
+      num_dep_unresolved_nodes_(parent.num_dep_unresolved_nodes_),
+      dep_unresolved_children_(parent.dep_unresolved_children_),
+      finished_node_ids_(parent.finished_node_ids_),
+      prefetch_error_(parent.prefetch_error_),
+      prefetch_complete_(parent.prefetch_complete_),
+      nodes_prefetched_(parent.nodes_prefetched_.load()),
+      producer_stalls_(parent.producer_stalls_.load()),
+      producer_stall_ns_(parent.producer_stall_ns_.load()),
+      consumer_stalls_(parent.consumer_stalls_),
+      consumer_stall_ns_(parent.consumer_stall_ns_),
+      num_issued_nodes_(parent.num_issued_nodes_),
+      num_sampled_nodes_(parent.num_sampled_nodes_),
+      sampled_node_bytes_(parent.sampled_node_bytes_),
+      node_bytes_(parent.node_bytes_),
+      peak_live_nodes_(parent.peak_live_nodes_),
+      max_dep_distance_(parent.max_dep_distance_),
+      budget_overruns_(parent.budget_overruns_) {
+  if (!trace_.is_open()) {
+    throw runtime_error("Failed to open trace file: " + filename_);
+  }
+  if (!reader_.isCompiled()) {
+    uint64_t position = parent.trace_.tell();
+    // A stale index only makes seeking slower; forks of this feeder seek
+    // with the same one
+    trace_index_ = parent.forkIndex(position);
+    if (trace_index_ != nullptr) {
+      trace_.setIndex(trace_index_);
+    }
+    if (!trace_.seek(position)) {
+      throw runtime_error("Failed to seek in trace file: " + filename_);
+    }
+  }
+
+  // Popping a copy of the queue keeps the issue order; held nodes are
+  // replaced by their copies in the same slot
+  IssuePolicy issuable = parent.dep_free_node_queue_;
+  while (!issuable.empty()) {
+    shared_ptr<ETFeederNode> node = issuable.pop();
+    dep_free_node_queue_.push(
+        parent.nodes_.holds(node) ? nodes_.get(node->slot()) : node->fork());
+  }
+
+  if (parent.prefetch_queue_ != nullptr) {
+    prefetch_queue_ =
+        make_unique<SPSCQueue<ETTraceNode>>(options_.prefetch_queue_size);
+    // Prefetched nodes are not linked yet, a nullptr node is the end marker
+    auto copy_prefetched = [](const ETTraceNode& trace_node) {
+      ETTraceNode trace_node_copy = trace_node;
+      if (trace_node.node != nullptr) {
+        trace_node_copy.node = trace_node.node->fork();
+      }
+      return trace_node_copy;
+    };
+    for (const auto& trace_node : prefetched) {
+      prefetch_queue_->push(copy_prefetched(trace_node));
+    }
+    if (parent.prefetch_pending_) {
+      prefetch_pending_node_ = copy_prefetched(parent.prefetch_pending_node_);
+      prefetch_pending_ = true;
+    }
+    startPrefetch();
+  }
+}
+
+template <typename IssuePolicy>
+BasicETFeeder<IssuePolicy>::~BasicETFeeder() {
+  stopPrefetch();
+}
 
-void ETFeeder::addNode(shared_ptr<ETFeederNode> node) {
-  dep_graph_[node->getChakraNode()->id()] = node;
+template <typename IssuePolicy>
+unique_ptr<BasicETFeeder<IssuePolicy>> BasicETFeeder<IssuePolicy>::fork() {
+  // The prefetch thread moves the read position and the fold along, so it
+  // rests while they are copied
+  vector<ETTraceNode> prefetched;
+  if (prefetch_queue_ != nullptr) {
+    stopPrefetch();
+    ETTraceNode trace_node;
+    while (prefetch_queue_->pop(trace_node)) {
+      prefetched.emplace_back(move(trace_node));
+    }
+    for (const auto& prefetched_node : prefetched) {
+      trace_node = prefetched_node;
+      prefetch_queue_->push(move(trace_node));
+    }
+  }
+  unique_ptr<BasicETFeeder> feeder;
+  try {
+    feeder.reset(new BasicETFeeder(*this, prefetched));
+  } catch (...) {
+    if (prefetch_queue_ != nullptr) {
+      startPrefetch();
+    }
+    throw;
+  }
+  if (prefetch_queue_ != nullptr) {
+    startPrefetch();
+  }
+  return feeder;
+}
+
+// The trace index if there is one, or else the last checkpoint recorded
+// before the position; nullptr if neither is available
+template <typename IssuePolicy>
+shared_ptr<const ProtoStreamIndex> BasicETFeeder<IssuePolicy>::forkIndex(
+    uint64_t position) {
+  if ((trace_index_ == nullptr) && (fork_checkpoints_ == nullptr)) {
+    string index_filename = indexFilename(filename_);
+    if (!index_filename.empty()) {
+      trace_index_ = ETTraceIndex::load(index_filename);
+    }
+  }
+  if ((trace_index_ != nullptr) || (fork_checkpoints_ == nullptr)) {
+    return trace_index_;
+  }
+  // Checkpoints keep being recorded, so the fork gets a copy of the one it
+  // needs
+  shared_ptr<ProtoStreamIndex> index = make_shared<ProtoStreamIndex>();
+  index->fileSize = fork_checkpoints_->fileSize;
+  const ProtoStreamIndex::Checkpoint* checkpoint =
+      fork_checkpoints_->floorCheckpoint(position);
+  if (checkpoint != nullptr) {
+    index->checkpoints.push_back(*checkpoint);
+  }
+  return index;
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::addNode(shared_ptr<ETFeederNode> node) {
+  auto held = dep_graph_.find(node->id());
+  if (held != dep_graph_.end()) {
+    eraseNode(held);
+  }
+  uint64_t node_id = node->id();
+  dep_graph_.emplace(node_id, nodes_.add(move(node)));
 }
 
-void ETFeeder::removeNode(uint64_t node_id) {
-  dep_graph_.erase(node_id);
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::removeNode(uint64_t node_id) {
+  auto node = dep_graph_.find(node_id);
+  if (node != dep_graph_.end()) {
+    eraseNode(node);
+  }
+  // Removed nodes are expected to have been issued
+  if (num_issued_nodes_ != 0) {
+    --num_issued_nodes_;
+  }
 
-  if (!et_complete_ && (dep_free_node_queue_.size() < window_size_)) {
+  if (needsRefill()) {
     readNextWindow();
   }
 }
 
-bool ETFeeder::hasNodesToIssue() {
+template <typename IssuePolicy>
+bool BasicETFeeder<IssuePolicy>::hasNodesToIssue() {
   return !(dep_graph_.empty() && dep_free_node_queue_.empty());
 }
 
-shared_ptr<ETFeederNode> ETFeeder::getNextIssuableNode() {
-  if (dep_free_node_queue_.size() != 0) {
-    shared_ptr<ETFeederNode> node = dep_free_node_queue_.top();
-    dep_free_node_id_set_.erase(node->getChakraNode()->id());
-    dep_free_node_queue_.pop();
+template <typename IssuePolicy>
+shared_ptr<ETFeederNode> BasicETFeeder<IssuePolicy>::getNextIssuableNode() {
+  CHAKRA_PROFILE_SCOPE(profiler_, profiler_.profile().issue);
+  if (!dep_free_node_queue_.empty()) {
+    shared_ptr<ETFeederNode> node = dep_free_node_queue_.pop();
+    ++num_issued_nodes_;
+    CHAKRA_PROFILE_STMT(++profiler_.profile().nodes_issued);
     return node;
   } else {
     return nullptr;
   }
 }
 
-void ETFeeder::pushBackIssuableNode(uint64_t node_id) {
-  shared_ptr<ETFeederNode> node = dep_graph_[node_id];
-  dep_free_node_id_set_.emplace(node_id);
-  dep_free_node_queue_.emplace(node);
+template <typename IssuePolicy>
+size_t BasicETFeeder<IssuePolicy>::getNextIssuableNodes(
+    shared_ptr<ETFeederNode>* nodes,
+    size_t max_nodes) {
+  CHAKRA_PROFILE_SCOPE(profiler_, profiler_.profile().issue);
+  size_t num_nodes = 0;
+  while ((num_nodes < max_nodes) && !dep_free_node_queue_.empty()) {
+    nodes[num_nodes++] = dep_free_node_queue_.pop();
+  }
+  num_issued_nodes_ += num_nodes;
+  CHAKRA_PROFILE_STMT(profiler_.profile().nodes_issued += num_nodes);
+  return num_nodes;
 }
 
-shared_ptr<ETFeederNode> ETFeeder::lookupNode(uint64_t node_id) {
-  return dep_graph_[node_id];
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::pushBackIssuableNode(uint64_t node_id) {
+  auto node = dep_graph_.find(node_id);
+  if (node != dep_graph_.end()) {
+    dep_free_node_queue_.push(nodes_.get(node->second));
+  }
 }
 
-void ETFeeder::freeChildrenNodes(uint64_t node_id) {
-  shared_ptr<ETFeederNode> node = dep_graph_[node_id];
-  for (auto child : node->getChildren()) {
-    auto child_chakra = child->getChakraNode();
-    for (auto it = child_chakra->mutable_data_deps()->begin();
-         it != child_chakra->mutable_data_deps()->end();
-         ++it) {
-      if (*it == node_id) {
-        child_chakra->mutable_data_deps()->erase(it);
-        break;
-      }
+template <typename IssuePolicy>
+shared_ptr<ETFeederNode> BasicETFeeder<IssuePolicy>::lookupNode(
+    uint64_t node_id) {
+  auto node = dep_graph_.find(node_id);
+  return node != dep_graph_.end() ? nodes_.get(node->second) : nullptr;
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::freeChildrenNodes(uint64_t node_id) {
+  auto node = dep_graph_.find(node_id);
+  if (node != dep_graph_.end()) {
+    finishNode(*nodes_.get(node->second));
+  }
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::completeNodes(
+    const uint64_t* node_ids,
+    size_t num_nodes) {
+  for (size_t i = 0; i < num_nodes; ++i) {
+    auto node = dep_graph_.find(node_ids[i]);
+    if (node == dep_graph_.end()) {
+      continue;
+    }
+    finishNode(*nodes_.get(node->second));
+    eraseNode(node);
+    if (num_issued_nodes_ != 0) {
+      --num_issued_nodes_;
     }
-    if (child_chakra->data_deps().size() == 0) {
-      dep_free_node_id_set_.emplace(child_chakra->id());
-      dep_free_node_queue_.emplace(child);
+  }
+
+  // One refill for the whole batch
+  if (needsRefill()) {
+    readNextWindow();
+  }
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::finishNode(ETFeederNode& node) {
+  // A parent finishes only once, even if its children are freed again
+  if (finished_node_ids_.contains(node.id())) {
+    return;
+  }
+  CHAKRA_PROFILE_SCOPE(profiler_, profiler_.profile().complete);
+  CHAKRA_PROFILE_STMT(++profiler_.profile().nodes_completed);
+  // Children read from now on must not wait for this node
+  finished_node_ids_.insert(node.id());
+  for (uint32_t child_slot : node.getChildSlots()) {
+    const shared_ptr<ETFeederNode>& child = nodes_.get(child_slot);
+    if (child->finishParent()) {
+      dep_free_node_queue_.push(child);
     }
   }
+  node.clearChildren();
 }
 
-void ETFeeder::readGlobalMetadata() {
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::eraseNode(
+    unordered_map<uint64_t, uint32_t>::iterator node) {
+  // Links to the node's children must not outlive its slot
+  nodes_.get(node->second)->clearChildren();
+  nodes_.remove(node->second);
+  dep_graph_.erase(node);
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::readGlobalMetadata() {
   if (!trace_.is_open()) {
     throw runtime_error(
         "Trace file closed unexpectedly during reading global metadata.");
   }
   shared_ptr<ChakraProtoMsg::GlobalMetadata> pkt_msg =
       make_shared<ChakraProtoMsg::GlobalMetadata>();
-  trace_.read(*pkt_msg);
+  reader_.readGlobalMetadata(*pkt_msg);
+  if (options_.trust_topological_order) {
+    topological_order_ =
+        ETTraceReorder::isTopologicallyOrdered(*pkt_msg, max_back_reach_);
+  }
+}
+
+// The index given in the options, or else the default sidecar index if the
+// trace has one; empty if there is no index
+template <typename IssuePolicy>
+string BasicETFeeder<IssuePolicy>::indexFilename(const string& filename) const {
+  if (!options_.index_filename.empty()) {
+    return options_.index_filename;
+  }
+  string index_filename = ETTraceIndex::defaultFilename(filename);
+  if (!ifstream(index_filename).good()) {
+    index_filename.clear();
+  }
+  return index_filename;
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::seekToNode(
+    const string& filename,
+    uint64_t node_id) {
+  if (reader_.isCompiled()) {
+    if (!reader_.seekCompiledNode(node_id)) {
+      throw runtime_error(
+          "Start node " + to_string(node_id) + " not found in " + filename);
+    }
+    return;
+  }
+
+  string index_filename = indexFilename(filename);
+  if (!index_filename.empty()) {
+    shared_ptr<ProtoStreamIndex> index = ETTraceIndex::load(index_filename);
+    if ((index == nullptr) || !trace_.setIndex(index)) {
+      throw runtime_error(
+          "Invalid or stale trace index " + index_filename + " for " +
+          filename);
+    }
+    trace_index_ = index;
+    const ProtoStreamIndex::Entry* entry = index->floorEntry(node_id);
+    if ((entry != nullptr) && !trace_.seek(entry->offset)) {
+      throw runtime_error("Failed to seek in trace file: " + filename);
+    }
+  }
+
+  // Skip ahead to the start node, then step back so that it is the next
+  // node to be read
+  ChakraProtoMsg::Node node;
+  uint64_t offset = trace_.tell();
+  while (trace_.read(node)) {
+    if (node.id() == node_id) {
+      if (!trace_.seek(offset)) {
+        throw runtime_error("Failed to seek in trace file: " + filename);
+      }
+      return;
+    }
+    offset = trace_.tell();
+  }
+  throw runtime_error(
+      "Start node " + to_string(node_id) + " not found in " + filename);
 }
 
-shared_ptr<ETFeederNode> ETFeeder::readNode() {
-  shared_ptr<ChakraProtoMsg::Node> pkt_msg =
-      make_shared<ChakraProtoMsg::Node>();
-  if (!trace_.read(*pkt_msg)) {
+template <typename IssuePolicy>
+bool BasicETFeeder<IssuePolicy>::parseNode(ETTraceNode& trace_node) {
+  if (!reader_.readNode(trace_node)) {
+    trace_node.node = nullptr;
+    return false;
+  }
+  CHAKRA_PROFILE_STMT(profiler_.sampleTrace(trace_.tell(), trace_.stats()));
+  return true;
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::startPrefetch() {
+  if (prefetch_complete_) {
+    return;
+  }
+  prefetch_stop_.store(false, memory_order_relaxed);
+  prefetch_thread_ = thread(&BasicETFeeder::prefetchNodes, this);
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::prefetchNodes() {
+  try {
+    while (!prefetch_complete_ && !prefetch_stop_.load(memory_order_relaxed)) {
+      // A node left over from before a stop goes first
+      ETTraceNode trace_node;
+      bool et_complete;
+      if (prefetch_pending_) {
+        trace_node = move(prefetch_pending_node_);
+        prefetch_pending_ = false;
+        et_complete = (trace_node.node == nullptr);
+      } else {
+        et_complete = !parseNode(trace_node);
+      }
+      if (!pushPrefetched(trace_node)) {
+        return;
+      }
+      prefetch_complete_ = et_complete;
+      if (!et_complete) {
+        nodes_prefetched_.fetch_add(1, memory_order_relaxed);
+      }
+    }
+  } catch (...) {
+    // Hand the error to the feeder thread, which rethrows it when it
+    // reaches the end marker
+    prefetch_error_ = current_exception();
+    ETTraceNode end;
+    prefetch_complete_ = pushPrefetched(end);
+  }
+}
+
+// Returns false if the prefetch thread is stopped before there is space
+// for the node, which is then kept for the next start
+template <typename IssuePolicy>
+bool BasicETFeeder<IssuePolicy>::pushPrefetched(ETTraceNode& trace_node) {
+  if (prefetch_queue_->push(move(trace_node))) {
+    return true;
+  }
+  auto stall_start = chrono::steady_clock::now();
+  while (!prefetch_queue_->push(move(trace_node))) {
+    if (prefetch_stop_.load(memory_order_relaxed)) {
+      prefetch_pending_node_ = move(trace_node);
+      prefetch_pending_ = true;
+      return false;
+    }
+    // The feeder drains the queue in whole windows, so there is no
+    // point in waking up for every single free slot
+    this_thread::sleep_for(chrono::microseconds(50));
+  }
+  producer_stalls_.fetch_add(1, memory_order_relaxed);
+  producer_stall_ns_.fetch_add(
+      chrono::duration_cast<chrono::nanoseconds>(
+          chrono::steady_clock::now() - stall_start)
+          .count(),
+      memory_order_relaxed);
+  return true;
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::stopPrefetch() {
+  prefetch_stop_.store(true, memory_order_relaxed);
+  if (prefetch_thread_.joinable()) {
+    prefetch_thread_.join();
+  }
+}
+
+template <typename IssuePolicy>
+bool BasicETFeeder<IssuePolicy>::fetchNode(ETTraceNode& trace_node) {
+  CHAKRA_PROFILE_SCOPE(profiler_, profiler_.profile().read);
+  if (prefetch_queue_ == nullptr) {
+    return parseNode(trace_node);
+  }
+
+  if (!prefetch_queue_->pop(trace_node)) {
+    auto stall_start = chrono::steady_clock::now();
+    while (!prefetch_queue_->pop(trace_node)) {
+      this_thread::yield();
+    }
+    ++consumer_stalls_;
+    consumer_stall_ns_ += chrono::duration_cast<chrono::nanoseconds>(
+                              chrono::steady_clock::now() - stall_start)
+                              .count();
+  }
+  if (trace_node.node == nullptr && prefetch_error_ != nullptr) {
+    rethrow_exception(prefetch_error_);
+  }
+  return trace_node.node != nullptr;
+}
+
+template <typename IssuePolicy>
+ETFeederPrefetchStats BasicETFeeder<IssuePolicy>::getPrefetchStats() const {
+  ETFeederPrefetchStats stats;
+  stats.nodes_prefetched = nodes_prefetched_.load(memory_order_relaxed);
+  stats.consumer_stalls = consumer_stalls_;
+  stats.consumer_stall_ns = consumer_stall_ns_;
+  stats.producer_stalls = producer_stalls_.load(memory_order_relaxed);
+  stats.producer_stall_ns = producer_stall_ns_.load(memory_order_relaxed);
+  if (prefetch_queue_ != nullptr) {
+    stats.queue_depth = prefetch_queue_->size();
+  }
+  return stats;
+}
+
+template <typename IssuePolicy>
+shared_ptr<ETFeederNode> BasicETFeeder<IssuePolicy>::readNode() {
+  ETTraceNode trace_node;
+  if (!fetchNode(trace_node)) {
     return nullptr;
   }
-  shared_ptr<ETFeederNode> node = make_shared<ETFeederNode>(pkt_msg);
+  CHAKRA_PROFILE_STMT(++profiler_.profile().nodes_read);
+  shared_ptr<ETFeederNode>& node = trace_node.node;
+  // Parents link to the node by its slot, so it is held first
+  addNode(node);
 
   bool dep_unresolved = false;
-  for (int i = 0; i < pkt_msg->data_deps_size(); ++i) {
-    auto parent_node = dep_graph_.find(pkt_msg->data_deps(i));
+  for (uint64_t parent_id : trace_node.parent_ids) {
+    max_dep_distance_ = max(
+        max_dep_distance_,
+        parent_id < node->id() ? node->id() - parent_id
+                               : parent_id - node->id());
+    // Nodes before the start node are never read, treat them as finished
+    if ((parent_id < start_node_id_) ||
+        finished_node_ids_.contains(parent_id)) {
+      continue;
+    }
+    auto parent_node = dep_graph_.find(parent_id);
+    // In a topologically ordered trace a parent that is not held has been
+    // read before the start node or removed already
+    if (topological_order_ && (parent_node == dep_graph_.end())) {
+      continue;
+    }
+    node->addUnfinishedParent();
     if (parent_node != dep_graph_.end()) {
-      parent_node->second->addChild(node);
+      nodes_.get(parent_node->second)->addChild(node);
     } else {
       dep_unresolved = true;
-      node->addDepUnresolvedParentID(pkt_msg->data_deps(i));
+      node->addDepUnresolvedParentID(parent_id);
+      dep_unresolved_children_[parent_id].push_back(node->slot());
     }
   }
 
   if (dep_unresolved) {
-    dep_unresolved_node_set_.emplace(node);
+    ++num_dep_unresolved_nodes_;
   }
-
   return node;
 }
 
-void ETFeeder::resolveDep() {
-  for (auto it = dep_unresolved_node_set_.begin();
-       it != dep_unresolved_node_set_.end();) {
-    shared_ptr<ETFeederNode> node = *it;
-    vector<uint64_t> dep_unresolved_parent_ids =
-        node->getDepUnresolvedParentIDs();
-    for (auto inner_it = dep_unresolved_parent_ids.begin();
-         inner_it != dep_unresolved_parent_ids.end();) {
-      auto parent_node = dep_graph_.find(*inner_it);
-      if (parent_node != dep_graph_.end()) {
-        parent_node->second->addChild(node);
-        inner_it = dep_unresolved_parent_ids.erase(inner_it);
-      } else {
-        ++inner_it;
-      }
-    }
-    if (dep_unresolved_parent_ids.size() == 0) {
-      it = dep_unresolved_node_set_.erase(it);
-    } else {
-      node->setDepUnresolvedParentIDs(dep_unresolved_parent_ids);
-      ++it;
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::resolveDep(
+    const shared_ptr<ETFeederNode>& parent) {
+  CHAKRA_PROFILE_SCOPE(profiler_, profiler_.profile().resolve_dep);
+  auto waiting = dep_unresolved_children_.find(parent->id());
+  if (waiting == dep_unresolved_children_.end()) {
+    return;
+  }
+
+  for (uint32_t child_slot : waiting->second) {
+    const shared_ptr<ETFeederNode>& child = nodes_.get(child_slot);
+    parent->addChild(child);
+    if (child->removeDepUnresolvedParentID(parent->id())) {
+      --num_dep_unresolved_nodes_;
     }
   }
+  dep_unresolved_children_.erase(waiting);
 }
 
-void ETFeeder::readNextWindow() {
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::readNextWindow() {
   if (!trace_.is_open()) {
     throw runtime_error(
         "Trace file closed unexpectedly during reading next window.");
   }
+  CHAKRA_PROFILE_STMT(uint64_t refill_start = profiler_.now());
+  // Without an issuable or in-flight node the feeder would stall, so the
+  // budget is exceeded until one shows up
+  bool can_progress = !dep_free_node_queue_.empty() || (num_issued_nodes_ != 0);
   uint32_t num_read = 0;
-  do {
+  while (true) {
+    // Adaptive windows top up the nodes held, fixed ones read a batch
+    bool window_full = options_.adaptive_window
+        ? (dep_graph_.size() >= window_size_)
+        : (num_read >= window_size_);
+    bool over_budget = dep_graph_.size() >= windowNodeBudget();
+    bool dep_unresolved = num_dep_unresolved_nodes_ != 0;
+    if (window_full || over_budget) {
+      if ((dep_unresolved && !options_.bounded_window) || !can_progress) {
+        budget_overruns_ += over_budget ? 1 : 0;
+      } else {
+        break;
+      }
+    }
+
     shared_ptr<ETFeederNode> new_node = readNode();
     if (new_node == nullptr) {
       et_complete_ = true;
       break;
     }
 
-    addNode(new_node);
     ++num_read;
+    sampleNodeBytes(new_node);
+    // Nodes become issuable either here or once their last parent is freed
+    if (new_node->getNumUnfinishedParents() == 0) {
+      dep_free_node_queue_.push(new_node);
+      can_progress = true;
+    }
 
-    resolveDep();
-  } while ((num_read < window_size_) || (dep_unresolved_node_set_.size() != 0));
-
-  for (auto node_id_node : dep_graph_) {
-    uint64_t node_id = node_id_node.first;
-    shared_ptr<ETFeederNode> node = node_id_node.second;
-    if ((dep_free_node_id_set_.count(node_id) == 0) &&
-        (node->getChakraNode()->data_deps().size() == 0)) {
-      dep_free_node_id_set_.emplace(node_id);
-      dep_free_node_queue_.emplace(node);
+    if (!topological_order_) {
+      resolveDep(new_node);
     }
   }
+  peak_live_nodes_ = max<uint64_t>(peak_live_nodes_, dep_graph_.size());
+  CHAKRA_PROFILE_STMT(profiler_.addRefill(
+      refill_start,
+      profiler_.now(),
+      num_read,
+      dep_graph_.size(),
+      num_dep_unresolved_nodes_,
+      dep_free_node_queue_.size()));
+
+  // Dependencies reached further than the window, so cover that distance
+  // right away next time
+  if (options_.adaptive_window && (dep_graph_.size() > window_size_)) {
+    setWindowSize(dep_graph_.size());
+  }
+}
+
+template <typename IssuePolicy>
+bool BasicETFeeder<IssuePolicy>::needsRefill() {
+  if (et_complete_) {
+    return false;
+  }
+  // Nothing can be read within the budget while the consumer has work
+  if ((dep_graph_.size() >= windowNodeBudget()) &&
+      (options_.bounded_window || (num_dep_unresolved_nodes_ == 0)) &&
+      (!dep_free_node_queue_.empty() || (num_issued_nodes_ != 0))) {
+    return false;
+  }
+  if (!options_.adaptive_window) {
+    return dep_free_node_queue_.size() < window_size_;
+  }
+
+  if (dep_free_node_queue_.empty()) {
+    // The consumer ran dry, look further ahead
+    setWindowSize(uint64_t(window_size_) * 2);
+    return true;
+  }
+  if (dep_graph_.size() >= window_size_ / 2) {
+    return false;
+  }
+  // More than half of the window is still issuable when the consumer
+  // has used up the other half, so a smaller one does as well
+  if (dep_free_node_queue_.size() > window_size_ / 4) {
+    setWindowSize(window_size_ / 2);
+  }
+  return true;
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::setWindowSize(uint64_t window_size) {
+  // The node budget caps the window even below the minimum size
+  uint64_t min_window_size =
+      min<uint64_t>(options_.min_window_size, windowNodeBudget());
+  uint64_t max_window_size = min(
+      windowNodeBudget(),
+      max<uint64_t>(options_.window_size, min_window_size) *
+          kMaxWindowGrowth);
+  window_size = min(window_size, max_window_size);
+  window_size = max(window_size, min_window_size);
+  window_size_ = static_cast<uint32_t>(min<uint64_t>(window_size, UINT32_MAX));
+}
+
+template <typename IssuePolicy>
+uint64_t BasicETFeeder<IssuePolicy>::windowNodeBudget() const {
+  uint64_t budget = UINT64_MAX;
+  if (options_.max_window_nodes != 0) {
+    budget = options_.max_window_nodes;
+  }
+  if ((options_.max_window_bytes != 0) && (node_bytes_ != 0)) {
+    budget = min(
+        budget, max<uint64_t>(1, options_.max_window_bytes / node_bytes_));
+  }
+  return budget;
 }
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::sampleNodeBytes(
+    const shared_ptr<ETFeederNode>& node) {
+  if (num_sampled_nodes_++ % kNodeBytesSampleInterval != 0) {
+    return;
+  }
+  // The node, its decoded fields and message, its slot, and roughly one
+  // child slot and one hash map entry for it
+  sampled_node_bytes_ += sizeof(ETFeederNode) + sizeof(ETFeederNodeData) +
+      node->messageBytes() + sizeof(shared_ptr<ETFeederNode>) +
+      sizeof(uint32_t) + sizeof(pair<uint64_t, uint32_t>) +
+      2 * sizeof(void*);
+  node_bytes_ = sampled_node_bytes_ /
+      ((num_sampled_nodes_ + kNodeBytesSampleInterval - 1) /
+       kNodeBytesSampleInterval);
+}
+
+template <typename IssuePolicy>
+ETFeederWindowStats BasicETFeeder<IssuePolicy>::getWindowStats() const {
+  ETFeederWindowStats stats;
+  stats.window_size = window_size_;
+  stats.live_nodes = dep_graph_.size();
+  stats.peak_live_nodes = peak_live_nodes_;
+  stats.node_bytes = node_bytes_;
+  stats.live_bytes = stats.live_nodes * node_bytes_;
+  stats.peak_live_bytes = peak_live_nodes_ * node_bytes_;
+  stats.max_dep_distance = max_dep_distance_;
+  stats.unresolved_parents = dep_unresolved_children_.size();
+  stats.budget_overruns = budget_overruns_;
+  stats.topological_order = topological_order_;
+  stats.max_back_reach = max_back_reach_;
+  return stats;
+}
+
+template <typename IssuePolicy>
+ETFeederProfile BasicETFeeder<IssuePolicy>::getProfile() const {
+  return profiler_.snapshot();
+}
+
+template <typename IssuePolicy>
+void BasicETFeeder<IssuePolicy>::writeChromeTrace(
+    const string& filename,
+    uint32_t pid) const {
+  profiler_.writeChromeTrace(filename, pid);
+}
+
+namespace Chakra {
+template class BasicETFeeder<IdOrderPolicy>;
+template class BasicETFeeder<FifoPolicy>;
+template class BasicETFeeder<CommPriorityPolicy>;
+template class BasicETFeeder<RemainingRuntimePolicy>;
+} // namespace Chakra
@@ -1,57 +1,258 @@
 #pragma once
 
+#include <atomic>
+#include <exception>
 #include <memory>
-#include <queue>
+#include <string>
+#include <thread>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
+#include "et_feeder/et_compiled_trace.h"
 #include "et_feeder/et_feeder_node.h"
+#include "et_feeder/et_feeder_profiler.h"
+#include "et_feeder/et_iteration_fold.h"
+#include "et_feeder/et_node_slab.h"
+#include "et_feeder/et_node_source.h"
+#include "et_feeder/et_trace_index.h"
+#include "et_feeder/et_trace_reader.h"
+#include "et_feeder/et_trace_reorder.h"
+#include "et_feeder/issue_policy.h"
+#include "et_feeder/node_id_bitmap.h"
+#include "et_feeder/spsc_queue.h"
 #include "third_party/utils/protoio.hh"
 
 namespace Chakra {
-struct CompareNodes : public std::binary_function<
-                          std::shared_ptr<ETFeederNode>,
-                          std::shared_ptr<ETFeederNode>,
-                          bool> {
-  bool operator()(
-      const std::shared_ptr<ETFeederNode> lhs,
-      const std::shared_ptr<ETFeederNode> rhs) const {
-    return lhs->getChakraNode()->id() > rhs->getChakraNode()->id();
-  }
+struct ETFeederOptions {
+  // Minimum number of nodes read ahead per window refill, and the initial
+  // window size in adaptive mode
+  uint32_t window_size = 4096 * 256;
+  // Keep the number of nodes held around the window size instead of
+  // reading a whole window per refill, and adapt the window: grow it when
+  // the consumer runs out of issuable nodes or dependencies reach beyond
+  // it, and shrink it when many nodes are still issuable at a refill
+  bool adaptive_window = false;
+  // Lower bound of the window size in adaptive mode
+  uint32_t min_window_size = 1024;
+  // Budget of nodes held by the feeder at a time (0 means unlimited)
+  uint64_t max_window_nodes = 0;
+  // Budget of memory held by nodes, estimated from sampled node sizes (0
+  // means unlimited)
+  uint64_t max_window_bytes = 0;
+  // Stop reading at the budget even while dependencies are unresolved;
+  // the budget is only exceeded when nothing could be issued otherwise.
+  // Without this the feeder reads past the budget until all dependencies
+  // of the nodes it holds are resolved.
+  bool bounded_window = false;
+  // Read and decode nodes on a background thread ahead of consumption so
+  // that window refills only link dependencies
+  bool prefetch = false;
+  // Maximum number of decoded nodes buffered by the prefetch thread, at
+  // least 1
+  uint32_t prefetch_queue_size = 65536;
+  // Keep the decoded fields and the encoded message of nodes in protobuf
+  // arenas shared by consecutive nodes; an arena is released in bulk once
+  // all of its nodes are gone. getChakraNode() parses a new message from
+  // the encoding on every call.
+  bool arena_storage = false;
+  // Lean node mode: drop the message of a node as soon as the feeder has
+  // decoded the fields it needs (ID, name, type, runtime, attributes, and
+  // dependencies). Names are interned, and getChakraNode() reads the
+  // message again from the trace, which for gzip traces is only fast with
+  // a trace index. Takes precedence over arena_storage.
+  bool lean_nodes = false;
+  // Threads decompressing block gzip traces (1 decompresses on the reading
+  // thread, 0 uses one per core); ignored for other traces. Every feeder
+  // and fork has its own threads, so more than one only pays off with few
+  // feeders per process.
+  uint32_t decompression_threads = 1;
+  // Start feeding at the node with this ID instead of at the beginning of
+  // the trace (0 starts at the beginning). Dependencies on nodes with a
+  // smaller ID count as satisfied.
+  uint64_t start_node_id = 0;
+  // Trace index used to find the start node; an empty name picks up the
+  // default sidecar index of the trace if there is one, without an index
+  // the trace is scanned from the beginning
+  std::string index_filename = "";
+  // Trust traces marked as topologically ordered by et_reorder: every
+  // parent comes before its children, so a parent the feeder does not hold
+  // counts as finished, and dependencies never keep the feeder reading
+  // past the window or budget
+  bool trust_topological_order = true;
+  // Record inflate checkpoints while reading a gzip trace without a trace
+  // index, so that fork() restarts inflating close to the read position
+  // rather than at the start of the trace
+  bool fork_checkpoints = false;
 };
 
-class ETFeeder {
+struct ETFeederPrefetchStats {
+  // Nodes decoded by the prefetch thread so far
+  uint64_t nodes_prefetched = 0;
+  // Number of times and total time the feeder waited for decoded nodes
+  uint64_t consumer_stalls = 0;
+  uint64_t consumer_stall_ns = 0;
+  // Number of times and total time the prefetch thread waited for space
+  uint64_t producer_stalls = 0;
+  uint64_t producer_stall_ns = 0;
+  // Decoded nodes currently buffered
+  uint64_t queue_depth = 0;
+};
+
+struct ETFeederWindowStats {
+  // Current window size
+  uint64_t window_size = 0;
+  // Nodes held by the feeder now and at most
+  uint64_t live_nodes = 0;
+  uint64_t peak_live_nodes = 0;
+  // Estimated memory per node, and held by all nodes now and at most
+  uint64_t node_bytes = 0;
+  uint64_t live_bytes = 0;
+  uint64_t peak_live_bytes = 0;
+  // Largest ID distance between a node and any of its parents, i.e. how
+  // far back (or ahead) dependencies reach
+  uint64_t max_dep_distance = 0;
+  // Parents referenced by held nodes that have not been read yet
+  uint64_t unresolved_parents = 0;
+  // Nodes read while the budget was already used up
+  uint64_t budget_overruns = 0;
+  // Set when the trace is trusted to be topologically ordered, along with
+  // how far back (in nodes) its dependencies reach
+  bool topological_order = false;
+  uint64_t max_back_reach = 0;
+};
+
+// Feeds the nodes of a trace in dependency order. IssuePolicy is the queue of
+// issuable nodes and decides the issue order, see issue_policy.h.
+template <typename IssuePolicy>
+class BasicETFeeder {
  public:
-  ETFeeder(std::string filename);
-  ~ETFeeder();
+  BasicETFeeder(
+      std::string filename,
+      ETFeederOptions options = ETFeederOptions());
+  ~BasicETFeeder();
 
   void addNode(std::shared_ptr<ETFeederNode> node);
   void removeNode(uint64_t node_id);
   bool hasNodesToIssue();
   std::shared_ptr<ETFeederNode> getNextIssuableNode();
+  // Hands out up to max_nodes issuable nodes in issue order, returns how
+  // many were written to nodes
+  size_t getNextIssuableNodes(
+      std::shared_ptr<ETFeederNode>* nodes,
+      size_t max_nodes);
   void pushBackIssuableNode(uint64_t node_id);
+  // Returns nullptr for nodes the feeder does not hold
   std::shared_ptr<ETFeederNode> lookupNode(uint64_t node_id);
   void freeChildrenNodes(uint64_t node_id);
+  // Same as freeChildrenNodes() followed by removeNode() for every node,
+  // with a single window refill at the end
+  void completeNodes(const uint64_t* node_ids, size_t num_nodes);
+  ETFeederPrefetchStats getPrefetchStats() const;
+  ETFeederWindowStats getWindowStats() const;
+  // Hot-path counters and timers; empty unless built with CHAKRA_PROFILE
+  ETFeederProfile getProfile() const;
+  // Writes the window refills and the profile as a Chrome trace
+  void writeChromeTrace(const std::string& filename, uint32_t pid = 0) const;
+  // Returns a feeder that continues independently from the current state
+  // of this one: it holds copies of the same nodes, including those issued
+  // and not removed yet, and reads on from the same place in the trace.
+  // The decoded fields and messages of the nodes are shared with the fork;
+  // their dependency and completion state and child links are copied
+  // into the same slots, so that the dependency graph is copied as is and
+  // only the issue queue rebuilt. A fork still takes time and memory
+  // linear in the number of nodes held. A fork that is
+  // never advanced serves as a snapshot to fork branches from.
+  std::unique_ptr<BasicETFeeder> fork();
 
  private:
+  BasicETFeeder(
+      BasicETFeeder& parent,
+      const std::vector<ETTraceNode>& prefetched);
   void readGlobalMetadata();
+  std::string indexFilename(const std::string& filename) const;
+  void seekToNode(const std::string& filename, uint64_t node_id);
+  bool parseNode(ETTraceNode& trace_node);
+  bool fetchNode(ETTraceNode& trace_node);
   std::shared_ptr<ETFeederNode> readNode();
+  void startPrefetch();
+  void prefetchNodes();
+  bool pushPrefetched(ETTraceNode& trace_node);
+  void stopPrefetch();
+  std::shared_ptr<const ProtoStreamIndex> forkIndex(uint64_t position);
   void readNextWindow();
-  void resolveDep();
+  bool needsRefill();
+  void setWindowSize(uint64_t window_size);
+  uint64_t windowNodeBudget() const;
+  void sampleNodeBytes(const std::shared_ptr<ETFeederNode>& node);
+  void resolveDep(const std::shared_ptr<ETFeederNode>& parent);
+  void finishNode(ETFeederNode& node);
+  void eraseNode(std::unordered_map<uint64_t, uint32_t>::iterator node);
 
+  const std::string filename_;
+  const ETFeederOptions options_;
   ProtoInputStream trace_;
-  const uint32_t window_size_;
+  // Trace index and inflate checkpoints that forks seek with
+  std::shared_ptr<const ProtoStreamIndex> trace_index_{};
+  std::shared_ptr<ProtoStreamIndex> fork_checkpoints_{};
+  ETTraceReader reader_;
+  uint32_t window_size_;
   bool et_complete_;
+  const uint64_t start_node_id_;
+  // Set by the global metadata of topologically ordered traces
+  bool topological_order_{false};
+  uint64_t max_back_reach_{0};
+
+  // Held nodes, and their slots keyed by node ID
+  ETNodeSlab nodes_{};
+  std::unordered_map<uint64_t, uint32_t> dep_graph_{};
+  IssuePolicy dep_free_node_queue_{};
+  // Held nodes with a parent that has not been read yet
+  uint64_t num_dep_unresolved_nodes_{0};
+  // Slots of the children waiting for such a parent, keyed by the missing
+  // parent ID
+  std::unordered_map<uint64_t, std::vector<uint32_t>>
+      dep_unresolved_children_{};
+  // Nodes whose children have been freed
+  NodeIdBitmap finished_node_ids_{};
 
-  std::unordered_map<uint64_t, std::shared_ptr<ETFeederNode>> dep_graph_{};
-  std::unordered_set<uint64_t> dep_free_node_id_set_{};
-  std::priority_queue<
-      std::shared_ptr<ETFeederNode>,
-      std::vector<std::shared_ptr<ETFeederNode>>,
-      CompareNodes>
-      dep_free_node_queue_{};
-  std::unordered_set<std::shared_ptr<ETFeederNode>> dep_unresolved_node_set_{};
+  // Decoded nodes handed from the prefetch thread to the feeder, a nullptr
+  // node marks the end of the trace
+  std::unique_ptr<SPSCQueue<ETTraceNode>> prefetch_queue_{};
+  std::thread prefetch_thread_{};
+  std::atomic<bool> prefetch_stop_{false};
+  std::exception_ptr prefetch_error_{};
+  // Node the prefetch thread could not queue before it was stopped, and
+  // whether the end marker has been queued
+  bool prefetch_pending_{false};
+  ETTraceNode prefetch_pending_node_{};
+  bool prefetch_complete_{false};
+
+  std::atomic<uint64_t> nodes_prefetched_{0};
+  std::atomic<uint64_t> producer_stalls_{0};
+  std::atomic<uint64_t> producer_stall_ns_{0};
+  uint64_t consumer_stalls_{0};
+  uint64_t consumer_stall_ns_{0};
+
+  // Window sizing and memory budget bookkeeping
+  uint64_t num_issued_nodes_{0};
+  uint64_t num_sampled_nodes_{0};
+  uint64_t sampled_node_bytes_{0};
+  uint64_t node_bytes_{0};
+  uint64_t peak_live_nodes_{0};
+  uint64_t max_dep_distance_{0};
+  uint64_t budget_overruns_{0};
+
+  ETFeederProfiler profiler_{};
 };
 
+using ETFeeder = BasicETFeeder<IdOrderPolicy>;
+using FifoETFeeder = BasicETFeeder<FifoPolicy>;
+using CommPriorityETFeeder = BasicETFeeder<CommPriorityPolicy>;
+using RemainingRuntimeETFeeder = BasicETFeeder<RemainingRuntimePolicy>;
+
+extern template class BasicETFeeder<IdOrderPolicy>;
+extern template class BasicETFeeder<FifoPolicy>;
+extern template class BasicETFeeder<CommPriorityPolicy>;
+extern template class BasicETFeeder<RemainingRuntimePolicy>;
+
 } // namespace Chakra
@@ -0,0 +1,56 @@
+#include "et_feeder/et_feeder_group.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+using namespace Chakra;
+
+ETFeederGroup::ETFeederGroup(
+    const vector<string>& filenames,
+    ETFeederGroupOptions options,
+    shared_ptr<ThreadPool> thread_pool)
+    : thread_pool_(thread_pool), feeders_(filenames.size()) {
+  if (thread_pool_ == nullptr) {
+    thread_pool_ = make_shared<ThreadPool>(options.num_threads);
+  }
+
+  ETFeederOptions feeder_options = options.feeder_options;
+  if ((options.max_total_window_nodes != 0) && !filenames.empty()) {
+    uint64_t window_size = max<uint64_t>(
+        1, options.max_total_window_nodes / filenames.size());
+    feeder_options.window_size = static_cast<uint32_t>(
+        min<uint64_t>(feeder_options.window_size, window_size));
+    // The window size is only how far ahead a feeder reads; the node
+    // budget also stops reading past it for unresolved dependencies and
+    // caps adaptive windows
+    if ((feeder_options.max_window_nodes == 0) ||
+        (feeder_options.max_window_nodes > window_size)) {
+      feeder_options.max_window_nodes = window_size;
+    }
+    feeder_options.bounded_window = true;
+  }
+  // Ranks are already read in parallel, share the cores among them
+  if ((feeder_options.decompression_threads == 0) && !filenames.empty()) {
+    feeder_options.decompression_threads = max<uint32_t>(
+        1, thread::hardware_concurrency() / filenames.size());
+  }
+
+  // Every task only touches its own slot, the first error is rethrown
+  // once all ranks are done
+  thread_pool_->parallelFor(filenames.size(), [&](size_t rank) {
+    feeders_[rank] = make_shared<ETFeeder>(filenames[rank], feeder_options);
+  });
+}
+
+size_t ETFeederGroup::size() const {
+  return feeders_.size();
+}
+
+shared_ptr<ETFeeder> ETFeederGroup::getFeeder(size_t rank) const {
+  return feeders_.at(rank);
+}
+
+shared_ptr<ThreadPool> ETFeederGroup::getThreadPool() const {
+  return thread_pool_;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "et_feeder/et_feeder.h"
+#include "et_feeder/thread_pool.h"
+
+namespace Chakra {
+
+struct ETFeederGroupOptions {
+  // Options every rank's feeder is created with
+  ETFeederOptions feeder_options{};
+  // Upper bound on the nodes held by all ranks together, split evenly
+  // across ranks into their window size and a bounded node budget; 0 keeps
+  // feeder_options as they are for every rank
+  uint64_t max_total_window_nodes = 0;
+  // Threads of the pool created when no pool is passed in, 0 picks the
+  // number of hardware threads
+  size_t num_threads = 0;
+};
+
+// Opens the traces of many ranks at once. Global metadata and the initial
+// window of every rank are read concurrently on a shared work-stealing
+// thread pool, which can be reused by the caller afterwards.
+class ETFeederGroup {
+ public:
+  ETFeederGroup(
+      const std::vector<std::string>& filenames,
+      ETFeederGroupOptions options = ETFeederGroupOptions(),
+      std::shared_ptr<ThreadPool> thread_pool = nullptr);
+
+  size_t size() const;
+  std::shared_ptr<ETFeeder> getFeeder(size_t rank) const;
+  std::shared_ptr<ThreadPool> getThreadPool() const;
+
+ private:
+  std::shared_ptr<ThreadPool> thread_pool_;
+  std::vector<std::shared_ptr<ETFeeder>> feeders_;
+};
+
+} // namespace Chakra
@@ -1,57 +1,229 @@
 #include "et_feeder/et_feeder_node.h"
 
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include "et_feeder/et_node_slab.h"
+#include "et_feeder/et_node_source.h"
+
 using namespace std;
 using namespace Chakra;
 
-ETFeederNode::ETFeederNode(std::shared_ptr<ChakraProtoMsg::Node> node) {
-  this->node_ = node;
-  this->id_ = node->id();
-  this->name_ = node->name();
-  this->runtime_ = node->duration_micros();
-  this->is_cpu_op_ = true;
-  for (int i = 0; i < node->attr_size(); i++) {
-    string attr_name = node->attr(i).name();
+namespace Chakra {
+vector<uint64_t> getParentIDs(const ChakraProtoMsg::Node& node) {
+  return getParentIDs(
+      node.data_deps().data(),
+      node.data_deps_size(),
+      node.ctrl_deps().data(),
+      node.ctrl_deps_size());
+}
+
+vector<uint64_t> getParentIDs(
+    const uint64_t* data_deps,
+    size_t num_data_deps,
+    const uint64_t* ctrl_deps,
+    size_t num_ctrl_deps) {
+  vector<uint64_t> parent_ids;
+  parent_ids.reserve(num_data_deps + num_ctrl_deps);
+  parent_ids.insert(parent_ids.end(), data_deps, data_deps + num_data_deps);
+  parent_ids.insert(parent_ids.end(), ctrl_deps, ctrl_deps + num_ctrl_deps);
+  if (parent_ids.size() > 1) {
+    sort(parent_ids.begin(), parent_ids.end());
+    parent_ids.erase(
+        unique(parent_ids.begin(), parent_ids.end()), parent_ids.end());
+  }
+  return parent_ids;
+}
+} // namespace Chakra
+
+static ETFeederNodeAttrs decodedAttrs(const ChakraProtoMsg::Node& node) {
+  ETFeederNodeAttrs attrs;
+  ETFeederNode::decodeAttrs(node, attrs);
+  return attrs;
+}
+
+ETFeederNodeData::ETFeederNodeData(shared_ptr<ChakraProtoMsg::Node> node)
+    : ETFeederNodeData(node, decodedAttrs(*node)) {}
+
+ETFeederNodeData::ETFeederNodeData(
+    shared_ptr<ChakraProtoMsg::Node> node,
+    const ETFeederNodeAttrs& attrs)
+    : node(node),
+      id(node->id()),
+      runtime(node->duration_micros()),
+      type(node->type()),
+      attrs(attrs) {}
+
+ETFeederNodeData::ETFeederNodeData(
+    const ChakraProtoMsg::Node& node,
+    const ETFeederNodeAttrs& attrs,
+    shared_ptr<ETNodeSource> source,
+    uint64_t position)
+    : source(source),
+      source_position(position),
+      name_data(source->internName(node.name())->data()),
+      id(node.id()),
+      runtime(node.duration_micros()),
+      type(node.type()),
+      name_size(static_cast<uint32_t>(node.name().size())),
+      attrs(attrs) {}
+
+ETFeederNodeData::ETFeederNodeData(
+    const ChakraProtoMsg::Node& node,
+    const ETFeederNodeAttrs& attrs,
+    const char* message_data,
+    uint32_t message_size,
+    const char* name_data)
+    : message_data(message_data),
+      name_data(name_data),
+      id(node.id()),
+      runtime(node.duration_micros()),
+      type(node.type()),
+      message_size(message_size),
+      name_size(static_cast<uint32_t>(node.name().size())),
+      attrs(attrs) {}
+
+ETFeederNodeData::ETFeederNodeData(
+    uint64_t id,
+    ChakraProtoMsg::NodeType type,
+    uint64_t runtime,
+    const ETFeederNodeAttrs& attrs,
+    shared_ptr<ETNodeSource> source,
+    uint64_t position)
+    : source(move(source)),
+      source_position(position),
+      id(id),
+      runtime(runtime),
+      type(type),
+      attrs(attrs) {}
+
+ETFeederNode::ETFeederNode(shared_ptr<ChakraProtoMsg::Node> node)
+    : data_(make_shared<ETFeederNodeData>(move(node))) {}
+
+ETFeederNode::ETFeederNode(
+    shared_ptr<ChakraProtoMsg::Node> node,
+    const ETFeederNodeAttrs& attrs)
+    : data_(make_shared<ETFeederNodeData>(move(node), attrs)) {}
+
+ETFeederNode::ETFeederNode(
+    uint64_t id,
+    ChakraProtoMsg::NodeType type,
+    uint64_t runtime,
+    const ETFeederNodeAttrs& attrs,
+    shared_ptr<ETNodeSource> source,
+    uint64_t position)
+    : data_(make_shared<ETFeederNodeData>(
+          id,
+          type,
+          runtime,
+          attrs,
+          move(source),
+          position)) {}
+
+ETFeederNode::ETFeederNode(shared_ptr<const ETFeederNodeData> data)
+    : data_(move(data)) {}
+
+ETFeederNode::ETFeederNode(const ETFeederNode& other)
+    : data_(other.data_),
+      children_(other.children_),
+      dep_unresolved_parent_ids_(other.dep_unresolved_parent_ids_),
+      slot_(other.slot_),
+      num_unfinished_parents_(
+          other.num_unfinished_parents_.load(memory_order_acquire)),
+      finished_(other.finished_) {}
+
+shared_ptr<ETFeederNode> ETFeederNode::fork() const {
+  return shared_ptr<ETFeederNode>(new ETFeederNode(*this));
+}
+
+void ETFeederNode::decodeAttrs(
+    const ChakraProtoMsg::Node& node,
+    ETFeederNodeAttrs& attrs) {
+  for (int i = 0; i < node.attr_size(); i++) {
+    const ChakraProtoMsg::AttributeProto& attr = node.attr(i);
+    const string& attr_name = attr.name();
     if (attr_name == "is_cpu_op") {
-      assign_attr_val(node, i, (void*)(&is_cpu_op_));
+      attrs.is_cpu_op = attr_int_val(attr) != 0;
     } else if (attr_name == "num_ops") {
-      assign_attr_val(node, i, (void*)(&num_ops_));
+      attrs.num_ops = attr_int_val(attr);
     } else if (attr_name == "tensor_size") {
-      assign_attr_val(node, i, (void*)(&tensor_size_));
+      attrs.tensor_size = attr_int_val(attr);
     } else if (attr_name == "comm_type") {
-      assign_attr_val(node, i, (void*)(&comm_type_));
+      attrs.comm_type =
+          static_cast<ChakraProtoMsg::CollectiveCommType>(attr_int_val(attr));
     } else if (attr_name == "involved_dim") {
-      assign_attr_val(node, i, (void*)(&involved_dim_));
-      involved_dim_size_ = node->attr(i).bool_list().values_size();
+      attr_bool_list_val(attr, attrs.involved_dim);
     } else if (attr_name == "comm_priority") {
-      assign_attr_val(node, i, (void*)(&comm_priority_));
+      attrs.comm_priority = attr_int_val(attr);
     } else if (attr_name == "comm_size") {
-      assign_attr_val(node, i, (void*)(&comm_size_));
+      attrs.comm_size = attr_int_val(attr);
     } else if (attr_name == "comm_src") {
-      assign_attr_val(node, i, (void*)(&comm_src_));
+      attrs.comm_src = attr_int_val(attr);
     } else if (attr_name == "comm_dst") {
-      assign_attr_val(node, i, (void*)(&comm_dst_));
+      attrs.comm_dst = attr_int_val(attr);
     } else if (attr_name == "comm_tag") {
-      assign_attr_val(node, i, (void*)(&comm_tag_));
+      attrs.comm_tag = attr_int_val(attr);
+    } else if (attr_name == "remaining_runtime") {
+      attrs.remaining_runtime = attr_int_val(attr);
     }
   }
 }
 
 shared_ptr<ChakraProtoMsg::Node> ETFeederNode::getChakraNode() {
-  return node_;
+  if (data_->node != nullptr) {
+    return data_->node;
+  }
+  // Not kept, every caller gets a fresh copy
+  if (data_->message_data != nullptr) {
+    shared_ptr<ChakraProtoMsg::Node> node =
+        make_shared<ChakraProtoMsg::Node>();
+    node->ParseFromArray(data_->message_data, data_->message_size);
+    return node;
+  }
+  return data_->source->readNode(data_->source_position);
+}
+
+bool ETFeederNode::isChakraNodeReleased() {
+  return data_->node == nullptr;
 }
 
-void ETFeederNode::addChild(shared_ptr<ETFeederNode> node) {
-  // Avoid adding the same child node multiple times
-  // addChild is called multiple times to resolve dependencies
-  if (children_set_.find(node) != children_set_.end()) {
+uint64_t ETFeederNode::messageBytes() {
+  if (data_->node != nullptr) {
+    return data_->node->SpaceUsedLong();
+  }
+  return data_->message_size + data_->name_size;
+}
+
+void ETFeederNode::addChild(const shared_ptr<ETFeederNode>& node) {
+  // Avoid adding the same child node multiple times when it lists this
+  // node more than once. All edges of a child are linked in one go, so a
+  // duplicate can only ever be the most recently added child.
+  if (!children_.empty() && children_.back() == node->slot_) {
     return;
   }
-  children_vec_.emplace_back(node);
-  children_set_.emplace(node);
+  children_.push_back(node->slot_);
 }
 
 vector<shared_ptr<ETFeederNode>> ETFeederNode::getChildren() {
-  return children_vec_;
+  vector<shared_ptr<ETFeederNode>> children;
+  children.reserve(children_.size());
+  for (uint32_t slot : children_) {
+    children.push_back(slab_->get(slot));
+  }
+  return children;
+}
+
+const ChildSlots& ETFeederNode::getChildSlots() {
+  return children_;
+}
+
+void ETFeederNode::clearChildren() {
+  children_.clear();
+}
+
+uint32_t ETFeederNode::slot() {
+  return slot_;
 }
 
 void ETFeederNode::addDepUnresolvedParentID(uint64_t node_id) {
@@ -67,200 +239,199 @@ void ETFeederNode::setDepUnresolvedParentIDs(
   dep_unresolved_parent_ids_ = dep_unresolved_parent_ids;
 }
 
-void ETFeederNode::assign_attr_val(
-    shared_ptr<ChakraProtoMsg::Node> node,
-    int i,
-    void* member) {
-  auto attr = node->attr(i);
+// Returns true once the last unresolved parent has been removed
+bool ETFeederNode::removeDepUnresolvedParentID(uint64_t node_id) {
+  for (auto it = dep_unresolved_parent_ids_.begin();
+       it != dep_unresolved_parent_ids_.end();
+       ++it) {
+    if (*it == node_id) {
+      dep_unresolved_parent_ids_.erase(it);
+      break;
+    }
+  }
+  return dep_unresolved_parent_ids_.empty();
+}
+
+void ETFeederNode::addUnfinishedParent() {
+  num_unfinished_parents_.fetch_add(1, memory_order_relaxed);
+}
+
+// Returns true once the last unfinished parent has finished
+bool ETFeederNode::finishParent() {
+  return num_unfinished_parents_.fetch_sub(1, memory_order_acq_rel) == 1;
+}
+
+uint32_t ETFeederNode::getNumUnfinishedParents() {
+  return num_unfinished_parents_.load(memory_order_acquire);
+}
+
+bool ETFeederNode::addChildIfUnfinished(const shared_ptr<ETFeederNode>& node) {
+  lockChildren();
+  bool added = !finished_;
+  if (added) {
+    addChild(node);
+  }
+  unlockChildren();
+  return added;
+}
+
+bool ETFeederNode::finish(vector<uint32_t>& child_slots) {
+  lockChildren();
+  bool first = !finished_;
+  finished_ = true;
+  child_slots.assign(children_.begin(), children_.end());
+  children_.clear();
+  unlockChildren();
+  return first;
+}
+
+// Held only for a few instructions, so spinning beats a mutex that would
+// double the size of the node
+void ETFeederNode::lockChildren() {
+  while (children_lock_.exchange(true, memory_order_acquire)) {
+    while (children_lock_.load(memory_order_relaxed)) {
+      this_thread::yield();
+    }
+  }
+}
+
+void ETFeederNode::unlockChildren() {
+  children_lock_.store(false, memory_order_release);
+}
+
+// Converts any scalar attribute value to an integer, whatever width the
+// trace writer picked for it
+int64_t ETFeederNode::attr_int_val(
+    const ChakraProtoMsg::AttributeProto& attr) {
   switch (attr.value_case()) {
     case ChakraProtoMsg::AttributeProto::kDoubleVal:
-      *((double*)member) = attr.double_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kDoubleList:
-      for (const auto& val : attr.double_list().values()) {
-        (*((std::vector<double>*)member)).push_back(val);
-      }
-      break;
+      return static_cast<int64_t>(attr.double_val());
     case ChakraProtoMsg::AttributeProto::kFloatVal:
-      *((float*)member) = attr.float_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kFloatList:
-      for (const auto& val : attr.float_list().values()) {
-        (*((std::vector<float>*)member)).push_back(val);
-      }
-      break;
+      return static_cast<int64_t>(attr.float_val());
     case ChakraProtoMsg::AttributeProto::kInt32Val:
-      *((int32_t*)member) = attr.int32_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kInt32List:
-      for (const auto& val : attr.int32_list().values()) {
-        (*((std::vector<int32_t>*)member)).push_back(val);
-      }
-      break;
+      return attr.int32_val();
     case ChakraProtoMsg::AttributeProto::kInt64Val:
-      *((int64_t*)member) = attr.int64_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kInt64List:
-      for (const auto& val : attr.int64_list().values()) {
-        (*((std::vector<int64_t>*)member)).push_back(val);
-      }
-      break;
+      return attr.int64_val();
     case ChakraProtoMsg::AttributeProto::kUint32Val:
-      *((uint32_t*)member) = attr.uint32_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kUint32List:
-      for (const auto& val : attr.uint32_list().values()) {
-        (*((std::vector<uint32_t>*)member)).push_back(val);
-      }
-      break;
+      return attr.uint32_val();
     case ChakraProtoMsg::AttributeProto::kUint64Val:
-      *((uint64_t*)member) = attr.uint64_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kUint64List:
-      for (const auto& val : attr.uint64_list().values()) {
-        (*((std::vector<uint64_t>*)member)).push_back(val);
-      }
-      break;
+      return static_cast<int64_t>(attr.uint64_val());
     case ChakraProtoMsg::AttributeProto::kSint32Val:
-      *((int32_t*)member) = attr.sint32_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kSint32List:
-      for (const auto& val : attr.sint32_list().values()) {
-        (*((std::vector<int32_t>*)member)).push_back(val);
-      }
-      break;
+      return attr.sint32_val();
     case ChakraProtoMsg::AttributeProto::kSint64Val:
-      *((int64_t*)member) = attr.sint64_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kSint64List:
-      for (const auto& val : attr.sint64_list().values()) {
-        (*((std::vector<int64_t>*)member)).push_back(val);
-      }
-      break;
+      return attr.sint64_val();
     case ChakraProtoMsg::AttributeProto::kFixed32Val:
-      *((uint32_t*)member) = attr.fixed32_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kFixed32List:
-      for (const auto& val : attr.fixed32_list().values()) {
-        (*((std::vector<uint32_t>*)member)).push_back(val);
-      }
-      break;
+      return attr.fixed32_val();
     case ChakraProtoMsg::AttributeProto::kFixed64Val:
-      *((uint64_t*)member) = attr.fixed64_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kFixed64List:
-      for (const auto& val : attr.fixed64_list().values()) {
-        (*((std::vector<uint64_t>*)member)).push_back(val);
-      }
-      break;
+      return static_cast<int64_t>(attr.fixed64_val());
     case ChakraProtoMsg::AttributeProto::kSfixed32Val:
-      *((int32_t*)member) = attr.sfixed32_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kSfixed32List:
-      for (const auto& val : attr.sfixed32_list().values()) {
-        (*((std::vector<int32_t>*)member)).push_back(val);
-      }
-      break;
+      return attr.sfixed32_val();
     case ChakraProtoMsg::AttributeProto::kSfixed64Val:
-      *((int64_t*)member) = attr.sfixed64_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kSfixed64List:
-      for (const auto& val : attr.sfixed64_list().values()) {
-        (*((std::vector<int64_t>*)member)).push_back(val);
-      }
-      break;
+      return attr.sfixed64_val();
     case ChakraProtoMsg::AttributeProto::kBoolVal:
-      *((bool*)member) = attr.bool_val();
-      break;
+      return attr.bool_val();
+    case ChakraProtoMsg::AttributeProto::VALUE_NOT_SET:
+      std::cerr << "undefined attr type in chakra node" << std::endl;
+      exit(EXIT_FAILURE);
+    default:
+      std::cerr << "attr " << attr.name() << " does not hold a scalar value"
+                << std::endl;
+      exit(EXIT_FAILURE);
+  }
+}
+
+void ETFeederNode::attr_bool_list_val(
+    const ChakraProtoMsg::AttributeProto& attr,
+    std::vector<bool>& values) {
+  switch (attr.value_case()) {
     case ChakraProtoMsg::AttributeProto::kBoolList:
       for (const auto& val : attr.bool_list().values()) {
-        (*((std::vector<bool>*)member)).push_back(val);
-      }
-      break;
-    case ChakraProtoMsg::AttributeProto::kStringVal:
-      *((std::string*)member) = attr.string_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kStringList:
-      for (const auto& val : attr.string_list().values()) {
-        (*((std::vector<std::string>*)member)).push_back(val);
-      }
-      break;
-    case ChakraProtoMsg::AttributeProto::kBytesVal:
-      *((std::string*)member) = attr.bytes_val();
-      break;
-    case ChakraProtoMsg::AttributeProto::kBytesList:
-      for (const auto& val : attr.bytes_list().values()) {
-        (*((std::vector<std::string>*)member)).push_back(val);
+        values.push_back(val);
       }
       break;
     case ChakraProtoMsg::AttributeProto::VALUE_NOT_SET:
-    default:
       std::cerr << "undefined attr type in chakra node" << std::endl;
       exit(EXIT_FAILURE);
-      break;
+    default:
+      std::cerr << "attr " << attr.name() << " does not hold a bool list"
+                << std::endl;
+      exit(EXIT_FAILURE);
   }
 }
 
 uint64_t ETFeederNode::id() {
-  return id_;
+  return data_->id;
 }
 
 string ETFeederNode::name() {
-  return name_;
+  if (data_->node != nullptr) {
+    return data_->node->name();
+  }
+  return data_->name_data != nullptr
+      ? string(data_->name_data, data_->name_size)
+      : data_->source->readName(data_->source_position);
 }
 
 bool ETFeederNode::is_cpu_op() {
-  return is_cpu_op_;
+  return data_->attrs.is_cpu_op;
 }
 
 ChakraProtoMsg::NodeType ETFeederNode::type() {
-  return node_->type();
+  return data_->type;
 }
 
 uint64_t ETFeederNode::runtime() {
-  return runtime_;
+  return data_->runtime;
 }
 
 uint64_t ETFeederNode::num_ops() {
-  return num_ops_;
+  return data_->attrs.num_ops;
 }
 
 uint32_t ETFeederNode::tensor_loc() {
-  return tensor_loc_;
+  return data_->attrs.tensor_loc;
 }
 
 uint64_t ETFeederNode::tensor_size() {
-  return tensor_size_;
+  return data_->attrs.tensor_size;
 }
 
 ChakraProtoMsg::CollectiveCommType ETFeederNode::comm_type() {
-  return comm_type_;
+  return data_->attrs.comm_type;
 }
 
 uint32_t ETFeederNode::involved_dim_size() {
-  return involved_dim_size_;
+  return data_->attrs.involved_dim.size();
 }
 
 bool ETFeederNode::involved_dim(int i) {
-  return involved_dim_[i];
+  return data_->attrs.involved_dim[i];
 }
 
 uint32_t ETFeederNode::comm_priority() {
-  return comm_priority_;
+  return data_->attrs.comm_priority;
 }
 
 uint64_t ETFeederNode::comm_size() {
-  return comm_size_;
+  return data_->attrs.comm_size;
 }
 
 uint32_t ETFeederNode::comm_src() {
-  return comm_src_;
+  return data_->attrs.comm_src;
 }
 
 uint32_t ETFeederNode::comm_dst() {
-  return comm_dst_;
+  return data_->attrs.comm_dst;
 }
 
 uint32_t ETFeederNode::comm_tag() {
-  return comm_tag_;
+  return data_->attrs.comm_tag;
+}
+
+uint64_t ETFeederNode::remaining_runtime() {
+  return data_->attrs.remaining_runtime;
+}
+
+const ETFeederNodeAttrs& ETFeederNode::attrs() {
+  return data_->attrs;
 }
@@ -1,23 +1,143 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
-#include <unordered_set>
+#include <string>
 #include <vector>
 
 #include "et_def/et_def.pb.h"
+#include "et_feeder/child_slots.h"
 
 namespace Chakra {
 
+class ETNodeSlab;
+class ETNodeSource;
+
+// Attribute values the feeder extracts from a node's AttributeProto list,
+// ordered by size to keep padding out
+struct ETFeederNodeAttrs {
+  std::vector<bool> involved_dim{};
+  uint64_t num_ops = 0;
+  uint64_t tensor_size = 0;
+  uint64_t comm_size = 0;
+  // Runtime of the node plus the longest chain of runtimes below it, as
+  // precomputed by trace tools for critical-path issue policies
+  uint64_t remaining_runtime = 0;
+  uint32_t tensor_loc = 0;
+  ChakraProtoMsg::CollectiveCommType comm_type = ChakraProtoMsg::ALL_REDUCE;
+  uint32_t comm_priority = 0;
+  uint32_t comm_src = 0;
+  uint32_t comm_dst = 0;
+  uint32_t comm_tag = 0;
+  bool is_cpu_op = true;
+};
+
+// Data and control parents of a node, sorted; a parent listed more than
+// once (or under both kinds) is returned once
+std::vector<uint64_t> getParentIDs(const ChakraProtoMsg::Node& node);
+std::vector<uint64_t> getParentIDs(
+    const uint64_t* data_deps,
+    size_t num_data_deps,
+    const uint64_t* ctrl_deps,
+    size_t num_ctrl_deps);
+
+// Fields of a node that do not change once it has been read, shared by the
+// node and its forks. Nodes without a message parse it from its encoding,
+// or else read it from the source, on demand.
+struct ETFeederNodeData {
+  ETFeederNodeData(std::shared_ptr<ChakraProtoMsg::Node> node);
+  ETFeederNodeData(
+      std::shared_ptr<ChakraProtoMsg::Node> node,
+      const ETFeederNodeAttrs& attrs);
+  // Lean node: takes what the feeder needs from the message and keeps the
+  // name interned by the source instead of the message
+  ETFeederNodeData(
+      const ChakraProtoMsg::Node& node,
+      const ETFeederNodeAttrs& attrs,
+      std::shared_ptr<ETNodeSource> source,
+      uint64_t position);
+  // Node in arena storage: keeps the encoded message and the name, whose
+  // bytes are owned by the arena
+  ETFeederNodeData(
+      const ChakraProtoMsg::Node& node,
+      const ETFeederNodeAttrs& attrs,
+      const char* message_data,
+      uint32_t message_size,
+      const char* name_data);
+  ETFeederNodeData(
+      uint64_t id,
+      ChakraProtoMsg::NodeType type,
+      uint64_t runtime,
+      const ETFeederNodeAttrs& attrs,
+      std::shared_ptr<ETNodeSource> source,
+      uint64_t position);
+
+  const std::shared_ptr<ChakraProtoMsg::Node> node{nullptr};
+  const std::shared_ptr<ETNodeSource> source{nullptr};
+  const uint64_t source_position{0};
+  const char* const message_data{nullptr};
+  // Interned by the source for lean nodes
+  const char* const name_data{nullptr};
+  const uint64_t id;
+  const uint64_t runtime;
+  const ChakraProtoMsg::NodeType type;
+  const uint32_t message_size{0};
+  const uint32_t name_size{0};
+  const ETFeederNodeAttrs attrs;
+};
+
 class ETFeederNode {
  public:
   ETFeederNode(std::shared_ptr<ChakraProtoMsg::Node> node);
+  // Takes attribute values that were decoded ahead of time; the attr list
+  // of the node message is not looked at
+  ETFeederNode(
+      std::shared_ptr<ChakraProtoMsg::Node> node,
+      const ETFeederNodeAttrs& attrs);
+  // Node without a message in memory, which getChakraNode() and name()
+  // read from the source on demand
+  ETFeederNode(
+      uint64_t id,
+      ChakraProtoMsg::NodeType type,
+      uint64_t runtime,
+      const ETFeederNodeAttrs& attrs,
+      std::shared_ptr<ETNodeSource> source,
+      uint64_t position);
+  ETFeederNode(std::shared_ptr<const ETFeederNodeData> data);
+  static void decodeAttrs(
+      const ChakraProtoMsg::Node& node,
+      ETFeederNodeAttrs& attrs);
+  // Copy for a forked feeder: shares the decoded fields and the message
+  // with this node and copies its dependency and completion state and its
+  // child slots, which the fork's slab fills with copies of the children
+  std::shared_ptr<ETFeederNode> fork() const;
+  // Returns the node message, read again from the trace if the node does
+  // not keep one
   std::shared_ptr<ChakraProtoMsg::Node> getChakraNode();
-  void addChild(std::shared_ptr<ETFeederNode> node);
+  bool isChakraNodeReleased();
+  // Memory held by the node message, parsed or encoded
+  uint64_t messageBytes();
+  // Children are linked by their slot in the slab of the feeder that holds
+  // this node and them
+  void addChild(const std::shared_ptr<ETFeederNode>& node);
   std::vector<std::shared_ptr<ETFeederNode>> getChildren();
+  const ChildSlots& getChildSlots();
+  void clearChildren();
+  uint32_t slot();
   void addDepUnresolvedParentID(uint64_t node_id);
   std::vector<uint64_t> getDepUnresolvedParentIDs();
   void setDepUnresolvedParentIDs(
       std::vector<uint64_t> const& dep_unresolved_parent_ids);
+  bool removeDepUnresolvedParentID(uint64_t node_id);
+  // Parents (data or control) this node still waits for to finish
+  void addUnfinishedParent();
+  bool finishParent();
+  uint32_t getNumUnfinishedParents();
+  // Thread-safe variants for feeders that link children while other threads
+  // finish parents. addChildIfUnfinished() fails once finish() has taken
+  // the children; finish() fails if the node was finished before.
+  bool addChildIfUnfinished(const std::shared_ptr<ETFeederNode>& node);
+  bool finish(std::vector<uint32_t>& child_slots);
 
   uint64_t id();
   std::string name();
@@ -35,33 +155,30 @@ class ETFeederNode {
   uint32_t comm_src();
   uint32_t comm_dst();
   uint32_t comm_tag();
+  uint64_t remaining_runtime();
+  const ETFeederNodeAttrs& attrs();
 
  private:
-  void assign_attr_val(
-      std::shared_ptr<ChakraProtoMsg::Node> node,
-      int i,
-      void* member);
+  friend class ETNodeSlab;
 
-  std::shared_ptr<ChakraProtoMsg::Node> node_{nullptr};
-  std::unordered_set<std::shared_ptr<ETFeederNode>> children_set_{};
-  std::vector<std::shared_ptr<ETFeederNode>> children_vec_{};
-  std::vector<uint64_t> dep_unresolved_parent_ids_{};
+  ETFeederNode(const ETFeederNode& other);
+  static int64_t attr_int_val(const ChakraProtoMsg::AttributeProto& attr);
+  static void attr_bool_list_val(
+      const ChakraProtoMsg::AttributeProto& attr,
+      std::vector<bool>& values);
+  void lockChildren();
+  void unlockChildren();
 
-  uint64_t id_;
-  std::string name_;
-  bool is_cpu_op_;
-  uint64_t runtime_;
-  uint64_t num_ops_;
-  uint32_t tensor_loc_;
-  uint64_t tensor_size_;
-  ChakraProtoMsg::CollectiveCommType comm_type_;
-  uint32_t involved_dim_size_;
-  std::vector<bool> involved_dim_;
-  uint32_t comm_priority_;
-  uint64_t comm_size_;
-  uint32_t comm_src_;
-  uint32_t comm_dst_;
-  uint32_t comm_tag_;
+  std::shared_ptr<const ETFeederNodeData> data_;
+  ChildSlots children_{};
+  std::vector<uint64_t> dep_unresolved_parent_ids_{};
+  // Set once the node is held by a feeder
+  const ETNodeSlab* slab_{nullptr};
+  uint32_t slot_{0};
+  std::atomic<uint32_t> num_unfinished_parents_{0};
+  // Guards children_ and finished_ in the thread-safe calls
+  std::atomic<bool> children_lock_{false};
+  bool finished_{false};
 };
 
 } // namespace Chakra
@@ -0,0 +1,170 @@
+#include "et_feeder/et_feeder_profiler.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace Chakra;
+
+void ETFeederHistogram::add(uint64_t ns) {
+  size_t bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+  ++buckets[min(bucket, kNumBuckets - 1)];
+  ++count;
+  total_ns += ns;
+  max_ns = max(max_ns, ns);
+}
+
+uint64_t ETFeederHistogram::quantile(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(q * count + 0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return min(max_ns, (uint64_t(2) << i) - 1);
+    }
+  }
+  return max_ns;
+}
+
+ETFeederProfiler::ETFeederProfiler() : start_(chrono::steady_clock::now()) {
+#ifdef CHAKRA_PROFILE
+  profile_.enabled = true;
+#endif
+}
+
+uint64_t ETFeederProfiler::now() const {
+  return chrono::duration_cast<chrono::nanoseconds>(
+             chrono::steady_clock::now() - start_)
+      .count();
+}
+
+ETFeederProfile& ETFeederProfiler::profile() {
+  return profile_;
+}
+
+void ETFeederProfiler::sampleTrace(
+    uint64_t bytes_read,
+    const ProtoInputStream::Stats& stats) {
+  bytes_read_.store(bytes_read, memory_order_relaxed);
+  bytes_inflated_.store(stats.bytesInflated, memory_order_relaxed);
+  inflate_ns_.store(stats.inflateNanos, memory_order_relaxed);
+  trace_read_ns_.store(stats.readNanos, memory_order_relaxed);
+}
+
+void ETFeederProfiler::addRefill(
+    uint64_t start_ns,
+    uint64_t end_ns,
+    uint64_t num_read,
+    uint64_t live_nodes,
+    uint64_t unresolved_nodes,
+    uint64_t queue_depth) {
+  profile_.refill.add(end_ns - start_ns);
+  ++profile_.refills;
+  profile_.unresolved_nodes = unresolved_nodes;
+  profile_.peak_unresolved_nodes =
+      max(profile_.peak_unresolved_nodes, unresolved_nodes);
+  profile_.queue_depth = queue_depth;
+  profile_.peak_queue_depth = max(profile_.peak_queue_depth, queue_depth);
+
+  if (events_.size() == kMaxEvents) {
+    ++dropped_events_;
+    return;
+  }
+  events_.push_back(
+      {start_ns, end_ns, num_read, live_nodes, unresolved_nodes, queue_depth});
+}
+
+ETFeederProfile ETFeederProfiler::snapshot() const {
+  ETFeederProfile profile = profile_;
+  profile.bytes_read = bytes_read_.load(memory_order_relaxed);
+  profile.bytes_inflated = bytes_inflated_.load(memory_order_relaxed);
+  profile.inflate_ns = inflate_ns_.load(memory_order_relaxed);
+  profile.trace_read_ns = trace_read_ns_.load(memory_order_relaxed);
+  return profile;
+}
+
+// Chrome trace timestamps are in microseconds
+static string micros(uint64_t ns) {
+  char buffer[32];
+  snprintf(
+      buffer,
+      sizeof(buffer),
+      "%" PRIu64 ".%03" PRIu64,
+      ns / 1000,
+      ns % 1000);
+  return buffer;
+}
+
+static void writeHistogram(
+    ofstream& out,
+    const char* name,
+    const ETFeederHistogram& histogram) {
+  out << ",\n    \"" << name << "\": {\"count\": " << histogram.count
+      << ", \"total_ns\": " << histogram.total_ns
+      << ", \"p50_ns\": " << histogram.quantile(0.5)
+      << ", \"p99_ns\": " << histogram.quantile(0.99)
+      << ", \"max_ns\": " << histogram.max_ns << "}";
+}
+
+void ETFeederProfiler::writeChromeTrace(const string& filename, uint32_t pid)
+    const {
+  ofstream out(filename);
+  if (!out) {
+    throw runtime_error("Failed to open profile output file: " + filename);
+  }
+
+  out << "{\"traceEvents\": [\n";
+  out << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+      << ", \"args\": {\"name\": \"et_feeder\"}}";
+  for (const Event& event : events_) {
+    string ts = micros(event.start_ns);
+    out << ",\n  {\"name\": \"refill\", \"ph\": \"X\", \"pid\": " << pid
+        << ", \"tid\": 0, \"ts\": " << ts
+        << ", \"dur\": " << micros(event.end_ns - event.start_ns)
+        << ", \"args\": {\"nodes_read\": " << event.num_read << "}}";
+    string end_ts = micros(event.end_ns);
+    const pair<const char*, uint64_t> counters[] = {
+        {"live_nodes", event.live_nodes},
+        {"unresolved_nodes", event.unresolved_nodes},
+        {"queue_depth", event.queue_depth},
+    };
+    for (const auto& counter : counters) {
+      out << ",\n  {\"name\": \"" << counter.first
+          << "\", \"ph\": \"C\", \"pid\": " << pid << ", \"ts\": " << end_ts
+          << ", \"args\": {\"" << counter.first << "\": " << counter.second
+          << "}}";
+    }
+  }
+  out << "\n],\n";
+
+  // The counters and histograms go along as metadata of the trace
+  ETFeederProfile profile = snapshot();
+  out << "\"otherData\": {\n";
+  out << "    \"nodes_read\": " << profile.nodes_read;
+  out << ",\n    \"nodes_issued\": " << profile.nodes_issued;
+  out << ",\n    \"nodes_completed\": " << profile.nodes_completed;
+  out << ",\n    \"refills\": " << profile.refills;
+  out << ",\n    \"bytes_read\": " << profile.bytes_read;
+  out << ",\n    \"bytes_inflated\": " << profile.bytes_inflated;
+  out << ",\n    \"inflate_ns\": " << profile.inflate_ns;
+  out << ",\n    \"trace_read_ns\": " << profile.trace_read_ns;
+  out << ",\n    \"peak_unresolved_nodes\": " << profile.peak_unresolved_nodes;
+  out << ",\n    \"peak_queue_depth\": " << profile.peak_queue_depth;
+  out << ",\n    \"dropped_events\": " << dropped_events_;
+  writeHistogram(out, "read", profile.read);
+  writeHistogram(out, "resolve_dep", profile.resolve_dep);
+  writeHistogram(out, "refill", profile.refill);
+  writeHistogram(out, "issue", profile.issue);
+  writeHistogram(out, "complete", profile.complete);
+  out << "\n}}\n";
+
+  if (!out) {
+    throw runtime_error("Failed to write profile output file: " + filename);
+  }
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "third_party/utils/protoio.hh"
+
+// The feeder is instrumented only when built with CHAKRA_PROFILE defined
+// (see the CHAKRA_ENABLE_PROFILING CMake option); otherwise the macros
+// below compile to nothing and profiles stay empty.
+#ifdef CHAKRA_PROFILE
+#define CHAKRA_PROFILE_SCOPE(profiler, histogram) \
+  ::Chakra::ETFeederProfileScope chakra_profile_scope((profiler), (histogram))
+#define CHAKRA_PROFILE_STMT(stmt) stmt
+#else
+#define CHAKRA_PROFILE_SCOPE(profiler, histogram)
+#define CHAKRA_PROFILE_STMT(stmt)
+#endif
+
+namespace Chakra {
+
+// Durations in power-of-two buckets of nanoseconds
+struct ETFeederHistogram {
+  static const size_t kNumBuckets = 48;
+
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns = 0;
+  // Bucket i counts durations in [2^i, 2^(i+1)) ns, bucket 0 also 0 ns
+  uint64_t buckets[kNumBuckets] = {};
+
+  void add(uint64_t ns);
+  // Upper bound of the bucket holding the q-quantile, for 0 < q <= 1
+  uint64_t quantile(double q) const;
+};
+
+struct ETFeederProfile {
+  // False if the feeder was built without CHAKRA_PROFILE
+  bool enabled = false;
+
+  uint64_t nodes_read = 0;
+  uint64_t nodes_issued = 0;
+  uint64_t nodes_completed = 0;
+  uint64_t refills = 0;
+  // Counters of the trace stream: uncompressed bytes read, bytes and time
+  // spent in decompression, and time spent reading messages overall
+  // (decompression plus protobuf parsing)
+  uint64_t bytes_read = 0;
+  uint64_t bytes_inflated = 0;
+  uint64_t inflate_ns = 0;
+  uint64_t trace_read_ns = 0;
+  // Nodes waiting for parents that have not been read yet, and issuable
+  // nodes, as of the last refill and at most
+  uint64_t unresolved_nodes = 0;
+  uint64_t peak_unresolved_nodes = 0;
+  uint64_t queue_depth = 0;
+  uint64_t peak_queue_depth = 0;
+
+  // Reading one node (from the trace or the prefetch queue)
+  ETFeederHistogram read{};
+  // Linking the children that waited for a node just read
+  ETFeederHistogram resolve_dep{};
+  // Window refills
+  ETFeederHistogram refill{};
+  // Taking issuable nodes from the queue, per call
+  ETFeederHistogram issue{};
+  // Freeing the children of a completed node
+  ETFeederHistogram complete{};
+};
+
+// Collects an ETFeederProfile and a timeline of window refills. All calls
+// come from the thread driving the feeder, except sampleTrace(), which
+// is called by whichever thread reads the trace.
+class ETFeederProfiler {
+ public:
+  ETFeederProfiler();
+
+  // Nanoseconds since the profiler was created
+  uint64_t now() const;
+  ETFeederProfile& profile();
+  void sampleTrace(uint64_t bytes_read, const ProtoInputStream::Stats& stats);
+  // Records a refill on the timeline, along with the number of nodes
+  // held, waiting and issuable once it is done
+  void addRefill(
+      uint64_t start_ns,
+      uint64_t end_ns,
+      uint64_t num_read,
+      uint64_t live_nodes,
+      uint64_t unresolved_nodes,
+      uint64_t queue_depth);
+
+  ETFeederProfile snapshot() const;
+  // Writes the timeline in the Chrome trace event format (viewable in
+  // chrome://tracing or Perfetto) under process ID pid, e.g. the NPU ID
+  // used by timeline_visualizer. Throws if the file cannot be written.
+  void writeChromeTrace(const std::string& filename, uint32_t pid) const;
+
+ private:
+  // Timeline entries beyond this many are dropped
+  static const size_t kMaxEvents = 1 << 20;
+
+  struct Event {
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t num_read;
+    uint64_t live_nodes;
+    uint64_t unresolved_nodes;
+    uint64_t queue_depth;
+  };
+
+  const std::chrono::steady_clock::time_point start_;
+  ETFeederProfile profile_{};
+  std::vector<Event> events_{};
+  uint64_t dropped_events_{0};
+
+  std::atomic<uint64_t> bytes_read_{0};
+  std::atomic<uint64_t> bytes_inflated_{0};
+  std::atomic<uint64_t> inflate_ns_{0};
+  std::atomic<uint64_t> trace_read_ns_{0};
+};
+
+// Adds the time until the end of the scope to a histogram
+class ETFeederProfileScope {
+ public:
+  ETFeederProfileScope(
+      const ETFeederProfiler& profiler,
+      ETFeederHistogram& histogram)
+      : profiler_(profiler), histogram_(histogram), start_(profiler.now()) {}
+  ~ETFeederProfileScope() {
+    histogram_.add(profiler_.now() - start_);
+  }
+
+ private:
+  const ETFeederProfiler& profiler_;
+  ETFeederHistogram& histogram_;
+  const uint64_t start_;
+};
+
+} // namespace Chakra
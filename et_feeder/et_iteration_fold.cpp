@@ -0,0 +1,396 @@
+#include "et_feeder/et_iteration_fold.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "third_party/utils/protoio.hh"
+
+using namespace std;
+using namespace Chakra;
+
+const char* const ETIterationFold::kFirstNodeAttr = "folded_first_node";
+const char* const ETIterationFold::kIterationNodesAttr =
+    "folded_iteration_nodes";
+const char* const ETIterationFold::kIterationsAttr = "folded_iterations";
+const char* const ETIterationFold::kIdStrideAttr = "folded_id_stride";
+
+// Iteration lengths tried, the most common distances between nodes that
+// look alike
+static const size_t kMaxCandidates = 8;
+
+static void readGlobalMetadata(
+    ProtoInputStream& trace,
+    const string& filename,
+    ChakraProtoMsg::GlobalMetadata& metadata) {
+  if (!trace.is_open()) {
+    throw runtime_error("Failed to open trace file: " + filename);
+  }
+  if (!trace.read(metadata)) {
+    throw runtime_error("Failed to read global metadata: " + filename);
+  }
+}
+
+static void removeFoldAttrs(ChakraProtoMsg::GlobalMetadata& metadata) {
+  auto attrs = metadata.mutable_attr();
+  attrs->erase(
+      remove_if(
+          attrs->begin(),
+          attrs->end(),
+          [](const ChakraProtoMsg::AttributeProto& attr) {
+            return (attr.name() == ETIterationFold::kFirstNodeAttr) ||
+                (attr.name() == ETIterationFold::kIterationNodesAttr) ||
+                (attr.name() == ETIterationFold::kIterationsAttr) ||
+                (attr.name() == ETIterationFold::kIdStrideAttr);
+          }),
+      attrs->end());
+}
+
+static void addUint64Attr(
+    ChakraProtoMsg::GlobalMetadata& metadata,
+    const char* name,
+    uint64_t value) {
+  ChakraProtoMsg::AttributeProto* attr = metadata.add_attr();
+  attr->set_name(name);
+  attr->set_uint64_val(value);
+}
+
+// Longest run of iterations per candidate iteration length, judged by node
+// signatures alone; longest first
+static vector<ETIterationFoldLayout> findIterations(
+    const vector<uint64_t>& ids,
+    const vector<uint64_t>& signatures) {
+  uint64_t num_nodes = ids.size();
+  unordered_map<uint64_t, uint64_t> last_position;
+  unordered_map<uint64_t, uint64_t> num_distances;
+  for (uint64_t i = 0; i < num_nodes; ++i) {
+    auto last = last_position.find(signatures[i]);
+    if (last == last_position.end()) {
+      last_position.emplace(signatures[i], i);
+    } else {
+      ++num_distances[i - last->second];
+      last->second = i;
+    }
+  }
+  vector<pair<uint64_t, uint64_t>> candidates;
+  for (const auto& distance : num_distances) {
+    candidates.emplace_back(distance.second, distance.first);
+  }
+  sort(candidates.rbegin(), candidates.rend());
+  candidates.resize(min(candidates.size(), kMaxCandidates));
+
+  vector<ETIterationFoldLayout> layouts;
+  for (const auto& candidate : candidates) {
+    uint64_t length = candidate.second;
+    ETIterationFoldLayout best;
+    uint64_t run_begin = 0;
+    uint64_t run_length = 0;
+    uint64_t id_stride = 0;
+    // Where iterations begin, modulo their length. A run that starts after
+    // a node that differs starts in the middle of an iteration, so runs
+    // are moved to where the first run starts, which is more likely to be
+    // the beginning of an iteration.
+    uint64_t phase = UINT64_MAX;
+    auto endRun = [&]() {
+      if (run_length + length < 2 * length) {
+        run_length = 0;
+        return;
+      }
+      if (phase == UINT64_MAX) {
+        phase = run_begin % length;
+      }
+      uint64_t first_node =
+          run_begin + (phase + length - run_begin % length) % length;
+      uint64_t iterations = (run_begin + run_length + length - first_node) /
+          length;
+      if ((iterations >= 2) && (iterations > best.iterations)) {
+        best.first_node = first_node;
+        best.iteration_nodes = length;
+        best.iterations = iterations;
+        best.id_stride = id_stride;
+      }
+      run_length = 0;
+    };
+    // A run is a stretch of nodes that look like the node one iteration
+    // later, whose ID is always the same distance away
+    for (uint64_t i = 0; i + length < num_nodes; ++i) {
+      bool repeats = (signatures[i] == signatures[i + length]) &&
+          (ids[i + length] != ids[i]);
+      if ((run_length != 0) &&
+          (!repeats || (ids[i + length] - ids[i] != id_stride))) {
+        endRun();
+      }
+      if (repeats) {
+        if (run_length == 0) {
+          run_begin = i;
+          id_stride = ids[i + length] - ids[i];
+        }
+        ++run_length;
+      }
+    }
+    endRun();
+    if (best.iterations != 0) {
+      layouts.push_back(best);
+    }
+  }
+  sort(
+      layouts.begin(),
+      layouts.end(),
+      [](const ETIterationFoldLayout& a, const ETIterationFoldLayout& b) {
+        return (a.iterations - 1) * a.iteration_nodes >
+            (b.iterations - 1) * b.iteration_nodes;
+      });
+  return layouts;
+}
+
+ETIterationFoldStats ETIterationFold::fold(
+    const string& input_filename,
+    const string& output_filename) {
+  ETIterationFoldStats stats;
+
+  // First pass: a signature of every node without its ID and dependencies
+  vector<uint64_t> ids;
+  vector<uint64_t> signatures;
+  {
+    ProtoInputStream input(input_filename);
+    ChakraProtoMsg::GlobalMetadata metadata;
+    readGlobalMetadata(input, input_filename, metadata);
+    ETIterationFoldLayout layout;
+    if (isFolded(metadata, layout)) {
+      throw runtime_error("Trace is folded already: " + input_filename);
+    }
+    ChakraProtoMsg::Node node;
+    string bytes;
+    while (input.read(node)) {
+      ids.push_back(node.id());
+      node.clear_id();
+      node.clear_data_deps();
+      node.clear_ctrl_deps();
+      node.SerializeToString(&bytes);
+      signatures.push_back(hash<string>()(bytes));
+    }
+  }
+  stats.num_nodes = ids.size();
+  vector<ETIterationFoldLayout> candidates = findIterations(ids, signatures);
+  vector<uint64_t>().swap(ids);
+  vector<uint64_t>().swap(signatures);
+
+  // Second pass per candidate: an iteration has to be the first one of its
+  // run with IDs moved, down to the last byte; an iteration that is not
+  // starts a new run, and the longest run wins
+  for (const ETIterationFoldLayout& candidate : candidates) {
+    if ((candidate.iterations - 1) * candidate.iteration_nodes <=
+        stats.folded_nodes) {
+      break;
+    }
+    ProtoInputStream input(input_filename);
+    ChakraProtoMsg::GlobalMetadata metadata;
+    readGlobalMetadata(input, input_filename, metadata);
+    unique_ptr<ETIterationFold> fold;
+    vector<shared_ptr<ChakraProtoMsg::Node>> iteration_nodes;
+    uint64_t run_begin = 0;
+    bool repeats = true;
+    uint64_t end = candidate.first_node +
+        candidate.iterations * candidate.iteration_nodes;
+    uint64_t position = 0;
+    ChakraProtoMsg::Node expected;
+    shared_ptr<ChakraProtoMsg::Node> node =
+        make_shared<ChakraProtoMsg::Node>();
+    while ((position < end) && input.read(*node)) {
+      if (position++ < candidate.first_node) {
+        continue;
+      }
+      uint64_t offset = position - 1 - candidate.first_node;
+      uint64_t iteration = offset / candidate.iteration_nodes;
+      if (repeats && (iteration != run_begin)) {
+        fold->instantiate(
+            *fold->template_nodes_[iteration_nodes.size()],
+            iteration - run_begin,
+            expected);
+        repeats = expected.SerializeAsString() == node->SerializeAsString();
+      }
+      iteration_nodes.push_back(node);
+      node = make_shared<ChakraProtoMsg::Node>();
+      if (iteration_nodes.size() < candidate.iteration_nodes) {
+        continue;
+      }
+
+      if ((iteration == run_begin) || !repeats) {
+        run_begin = iteration;
+        fold = make_unique<ETIterationFold>(candidate);
+        for (auto& template_node : iteration_nodes) {
+          fold->addTemplateNode(template_node, ETFeederNodeAttrs());
+        }
+      } else if (
+          (iteration - run_begin) * candidate.iteration_nodes >
+          stats.folded_nodes) {
+        stats.layout = candidate;
+        stats.layout.first_node =
+            candidate.first_node + run_begin * candidate.iteration_nodes;
+        stats.layout.iterations = iteration - run_begin + 1;
+        stats.folded_nodes =
+            (iteration - run_begin) * candidate.iteration_nodes;
+      }
+      iteration_nodes.clear();
+      repeats = true;
+    }
+  }
+
+  // Third pass: the trace without the iterations after the template
+  ProtoInputStream input(input_filename);
+  ChakraProtoMsg::GlobalMetadata metadata;
+  readGlobalMetadata(input, input_filename, metadata);
+  removeFoldAttrs(metadata);
+  uint64_t folded_begin = 0;
+  uint64_t folded_end = 0;
+  if (stats.folded_nodes != 0) {
+    addUint64Attr(metadata, kFirstNodeAttr, stats.layout.first_node);
+    addUint64Attr(
+        metadata, kIterationNodesAttr, stats.layout.iteration_nodes);
+    addUint64Attr(metadata, kIterationsAttr, stats.layout.iterations);
+    addUint64Attr(metadata, kIdStrideAttr, stats.layout.id_stride);
+    folded_begin = stats.layout.first_node + stats.layout.iteration_nodes;
+    folded_end = folded_begin + stats.folded_nodes;
+  }
+  ProtoOutputStream output(output_filename);
+  output.write(metadata);
+  ChakraProtoMsg::Node node;
+  for (uint64_t position = 0; input.read(node); ++position) {
+    if ((position < folded_begin) || (position >= folded_end)) {
+      output.write(node);
+    }
+  }
+  return stats;
+}
+
+ETIterationFoldStats ETIterationFold::unfold(
+    const string& input_filename,
+    const string& output_filename) {
+  ETIterationFoldStats stats;
+  ProtoInputStream input(input_filename);
+  ChakraProtoMsg::GlobalMetadata metadata;
+  readGlobalMetadata(input, input_filename, metadata);
+  isFolded(metadata, stats.layout);
+  removeFoldAttrs(metadata);
+  ProtoOutputStream output(output_filename);
+  output.write(metadata);
+
+  ETIterationFold fold(stats.layout);
+  while (true) {
+    shared_ptr<ETFeederNode> node;
+    if (fold.replaying()) {
+      node = fold.nextReplayedNode();
+      ++stats.folded_nodes;
+    } else {
+      shared_ptr<ChakraProtoMsg::Node> pkt_msg =
+          make_shared<ChakraProtoMsg::Node>();
+      if (!input.read(*pkt_msg)) {
+        break;
+      }
+      node = make_shared<ETFeederNode>(pkt_msg);
+      fold.addTraceNode(node);
+    }
+    output.write(*node->getChakraNode());
+    ++stats.num_nodes;
+  }
+  return stats;
+}
+
+bool ETIterationFold::isFolded(
+    const ChakraProtoMsg::GlobalMetadata& metadata,
+    ETIterationFoldLayout& layout) {
+  layout = ETIterationFoldLayout();
+  for (const ChakraProtoMsg::AttributeProto& attr : metadata.attr()) {
+    if (attr.name() == kFirstNodeAttr) {
+      layout.first_node = attr.uint64_val();
+    } else if (attr.name() == kIterationNodesAttr) {
+      layout.iteration_nodes = attr.uint64_val();
+    } else if (attr.name() == kIterationsAttr) {
+      layout.iterations = attr.uint64_val();
+    } else if (attr.name() == kIdStrideAttr) {
+      layout.id_stride = attr.uint64_val();
+    }
+  }
+  return (layout.iterations >= 2) && (layout.iteration_nodes != 0);
+}
+
+ETIterationFold::ETIterationFold(const ETIterationFoldLayout& layout)
+    : layout_(layout) {
+  template_nodes_.reserve(layout_.iteration_nodes);
+  template_attrs_.reserve(layout_.iteration_nodes);
+}
+
+void ETIterationFold::addTraceNode(shared_ptr<ETFeederNode> node) {
+  if (nextIsTemplateNode()) {
+    addTemplateNode(node->getChakraNode(), node->attrs());
+  }
+  ++num_trace_nodes_;
+}
+
+void ETIterationFold::addTraceNode(
+    shared_ptr<ChakraProtoMsg::Node> node,
+    const ETFeederNodeAttrs& attrs) {
+  if (nextIsTemplateNode()) {
+    addTemplateNode(move(node), attrs);
+  }
+  ++num_trace_nodes_;
+}
+
+bool ETIterationFold::nextIsTemplateNode() const {
+  return (num_trace_nodes_ >= layout_.first_node) &&
+      (template_nodes_.size() < layout_.iteration_nodes);
+}
+
+bool ETIterationFold::replaying() const {
+  return (layout_.iterations >= 2) &&
+      (template_nodes_.size() == layout_.iteration_nodes) &&
+      (iteration_ < layout_.iterations);
+}
+
+shared_ptr<ETFeederNode> ETIterationFold::nextReplayedNode() {
+  shared_ptr<ChakraProtoMsg::Node> pkt_msg =
+      make_shared<ChakraProtoMsg::Node>();
+  instantiate(*template_nodes_[template_node_], iteration_, *pkt_msg);
+  // The attributes were decoded once for the template
+  shared_ptr<ETFeederNode> node =
+      make_shared<ETFeederNode>(pkt_msg, template_attrs_[template_node_]);
+  if (++template_node_ == layout_.iteration_nodes) {
+    template_node_ = 0;
+    ++iteration_;
+  }
+  return node;
+}
+
+void ETIterationFold::addTemplateNode(
+    shared_ptr<ChakraProtoMsg::Node> node,
+    const ETFeederNodeAttrs& attrs) {
+  template_ids_.insert(node->id());
+  template_nodes_.emplace_back(move(node));
+  template_attrs_.push_back(attrs);
+}
+
+bool ETIterationFold::isShifted(uint64_t dep_id) const {
+  // A node of the template, or of the iteration before it
+  return (template_ids_.count(dep_id) != 0) ||
+      (template_ids_.count(dep_id + layout_.id_stride) != 0);
+}
+
+void ETIterationFold::instantiate(
+    const ChakraProtoMsg::Node& template_node,
+    uint64_t iteration,
+    ChakraProtoMsg::Node& node) const {
+  uint64_t offset = iteration * layout_.id_stride;
+  node = template_node;
+  node.set_id(template_node.id() + offset);
+  for (uint64_t& dep_id : *node.mutable_data_deps()) {
+    if (isShifted(dep_id)) {
+      dep_id += offset;
+    }
+  }
+  for (uint64_t& dep_id : *node.mutable_ctrl_deps()) {
+    if (isShifted(dep_id)) {
+      dep_id += offset;
+    }
+  }
+}
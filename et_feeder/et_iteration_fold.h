@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "et_def/et_def.pb.h"
+#include "et_feeder/et_feeder_node.h"
+
+namespace Chakra {
+
+// Where the repeated iterations of a folded trace are. The trace holds
+// the nodes before the iterations, the first iteration (the template), and
+// the nodes after the iterations; every other iteration is the template
+// with node IDs moved up by id_stride per iteration.
+struct ETIterationFoldLayout {
+  // Number of nodes in the trace before the template
+  uint64_t first_node = 0;
+  uint64_t iteration_nodes = 0;
+  // Number of iterations, including the template
+  uint64_t iterations = 0;
+  uint64_t id_stride = 0;
+};
+
+struct ETIterationFoldStats {
+  uint64_t num_nodes = 0;
+  ETIterationFoldLayout layout{};
+  // Nodes left out of the folded trace
+  uint64_t folded_nodes = 0;
+};
+
+// Folds traces made of near-identical training iterations into a template
+// iteration plus a repeat count, and instantiates the iterations again
+// while a trace is read. Dependencies of a template node on a node of the
+// template or of the iteration before it move along with the iteration;
+// all other dependencies stay as they are.
+class ETIterationFold {
+ public:
+  // Names of the global metadata attributes of folded traces
+  static const char* const kFirstNodeAttr;
+  static const char* const kIterationNodesAttr;
+  static const char* const kIterationsAttr;
+  static const char* const kIdStrideAttr;
+
+  // Finds the longest run of iterations that repeat node for node (same
+  // names, types, attributes, and dependencies up to the ID offset) and
+  // writes the trace with the run folded. Without such a run the trace is
+  // written as it is.
+  static ETIterationFoldStats fold(
+      const std::string& input_filename,
+      const std::string& output_filename);
+  // Writes a folded trace with all iterations spelled out, for tools that
+  // do not know about folding
+  static ETIterationFoldStats unfold(
+      const std::string& input_filename,
+      const std::string& output_filename);
+  // Returns true if global metadata marks the trace as folded, and where
+  // the iterations are
+  static bool isFolded(
+      const ChakraProtoMsg::GlobalMetadata& metadata,
+      ETIterationFoldLayout& layout);
+
+  explicit ETIterationFold(const ETIterationFoldLayout& layout);
+  // Hands every node read from a folded trace to the fold, which keeps the
+  // template nodes
+  void addTraceNode(std::shared_ptr<ETFeederNode> node);
+  // Same for a node message and its attributes, before a lean node that
+  // keeps no message is made from them
+  void addTraceNode(
+      std::shared_ptr<ChakraProtoMsg::Node> node,
+      const ETFeederNodeAttrs& attrs);
+  // True while the next node is an instance of a template node rather
+  // than the next node in the trace
+  bool replaying() const;
+  std::shared_ptr<ETFeederNode> nextReplayedNode();
+
+ private:
+  bool nextIsTemplateNode() const;
+  void addTemplateNode(
+      std::shared_ptr<ChakraProtoMsg::Node> node,
+      const ETFeederNodeAttrs& attrs);
+  bool isShifted(uint64_t dep_id) const;
+  void instantiate(
+      const ChakraProtoMsg::Node& template_node,
+      uint64_t iteration,
+      ChakraProtoMsg::Node& node) const;
+
+  const ETIterationFoldLayout layout_;
+  std::vector<std::shared_ptr<ChakraProtoMsg::Node>> template_nodes_{};
+  std::vector<ETFeederNodeAttrs> template_attrs_{};
+  std::unordered_set<uint64_t> template_ids_{};
+  uint64_t num_trace_nodes_{0};
+  // Next node to replay
+  uint64_t iteration_{1};
+  uint64_t template_node_{0};
+};
+
+} // namespace Chakra
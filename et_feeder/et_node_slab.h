@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "et_feeder/et_feeder_node.h"
+
+namespace Chakra {
+
+// Slots of the nodes a feeder holds. Nodes link to their children by slot,
+// which takes 4 bytes per edge and does not keep the child alive, so
+// shared pointers to nodes only leave the feeder through its public API.
+// Slots of removed nodes are reused. Slots live in fixed-size chunks found
+// through a two-level directory, none of which ever move, so one thread
+// may look up the slot of a node linked to it while another adds nodes.
+class ETNodeSlab {
+ public:
+  ETNodeSlab() = default;
+  // Copy for a forked feeder: every node is replaced by the copy make_copy
+  // returns, in the same slot, so that child links stay valid
+  ETNodeSlab(
+      const ETNodeSlab& other,
+      const std::function<std::shared_ptr<ETFeederNode>(
+          const std::shared_ptr<ETFeederNode>&)>& make_copy)
+      : free_slots_(other.free_slots_),
+        num_slots_(other.num_slots_),
+        size_(other.size_) {
+    for (uint32_t slot = 0; slot < num_slots_; ++slot) {
+      const std::shared_ptr<ETFeederNode>& node = other.get(slot);
+      std::shared_ptr<ETFeederNode>& copy = allocate(slot);
+      if (node != nullptr) {
+        copy = make_copy(node);
+        attach(*copy, slot);
+      }
+    }
+  }
+
+  uint32_t add(std::shared_ptr<ETFeederNode> node) {
+    uint32_t slot;
+    if (!free_slots_.empty()) {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+    } else {
+      if (num_slots_ == kMaxSlots) {
+        throw std::length_error("Too many nodes held by the feeder");
+      }
+      slot = num_slots_++;
+    }
+    attach(*node, slot);
+    allocate(slot) = std::move(node);
+    ++size_;
+    return slot;
+  }
+
+  void remove(uint32_t slot) {
+    entry(slot).reset();
+    free_slots_.push_back(slot);
+    --size_;
+  }
+
+  const std::shared_ptr<ETFeederNode>& get(uint32_t slot) const {
+    return entry(slot);
+  }
+
+  // True if the node sits in this slab
+  bool holds(const std::shared_ptr<ETFeederNode>& node) const {
+    return (node->slab_ == this) && (get(node->slot_) == node);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  ETNodeSlab(const ETNodeSlab&) = delete;
+  ETNodeSlab& operator=(const ETNodeSlab&) = delete;
+
+  // A slot number splits into directory, chunk, and chunk offset bits
+  static const uint32_t kChunkBits = 12;
+  static const uint32_t kDirectoryBits = 10;
+  static const uint32_t kNumDirectories =
+      1u << (32 - kChunkBits - kDirectoryBits);
+  static const uint32_t kMaxSlots = UINT32_MAX;
+
+  using Chunk = std::unique_ptr<std::shared_ptr<ETFeederNode>[]>;
+
+  std::shared_ptr<ETFeederNode>& entry(uint32_t slot) const {
+    const std::unique_ptr<Chunk[]>& directory =
+        directories_[slot >> (kChunkBits + kDirectoryBits)];
+    const Chunk& chunk =
+        directory[(slot >> kChunkBits) & ((1u << kDirectoryBits) - 1)];
+    return chunk[slot & ((1u << kChunkBits) - 1)];
+  }
+
+  std::shared_ptr<ETFeederNode>& allocate(uint32_t slot) {
+    std::unique_ptr<Chunk[]>& directory =
+        directories_[slot >> (kChunkBits + kDirectoryBits)];
+    if (directory == nullptr) {
+      directory.reset(new Chunk[1u << kDirectoryBits]);
+    }
+    Chunk& chunk =
+        directory[(slot >> kChunkBits) & ((1u << kDirectoryBits) - 1)];
+    if (chunk == nullptr) {
+      chunk.reset(new std::shared_ptr<ETFeederNode>[1u << kChunkBits]);
+    }
+    return chunk[slot & ((1u << kChunkBits) - 1)];
+  }
+
+  void attach(ETFeederNode& node, uint32_t slot) {
+    node.slab_ = this;
+    node.slot_ = slot;
+  }
+
+  std::unique_ptr<Chunk[]> directories_[kNumDirectories]{};
+  std::vector<uint32_t> free_slots_{};
+  uint32_t num_slots_{0};
+  size_t size_{0};
+};
+
+} // namespace Chakra
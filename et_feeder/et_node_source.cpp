@@ -0,0 +1,83 @@
+#include "et_feeder/et_node_source.h"
+
+#include <stdexcept>
+
+#include "et_feeder/et_trace_index.h"
+
+using namespace std;
+using namespace Chakra;
+
+ETNodeSource::ETNodeSource(string filename, string index_filename)
+    : filename_(move(filename)), index_filename_(move(index_filename)) {}
+
+ETNodeSource::ETNodeSource(
+    string filename,
+    shared_ptr<const ETCompiledTrace> compiled_trace)
+    : filename_(move(filename)), compiled_trace_(move(compiled_trace)) {}
+
+const string* ETNodeSource::internName(const string& name) {
+  lock_guard<mutex> lock(mutex_);
+  return &*names_.insert(name).first;
+}
+
+shared_ptr<ChakraProtoMsg::Node> ETNodeSource::readNode(uint64_t position) {
+  lock_guard<mutex> lock(mutex_);
+  openTrace();
+  shared_ptr<ChakraProtoMsg::Node> node = make_shared<ChakraProtoMsg::Node>();
+  if (compiled_trace_ != nullptr) {
+    checkCompiledPosition(position);
+    compiled_trace_->readMessage(position, *node);
+    return node;
+  }
+  if (!trace_->seek(position) || !trace_->read(*node)) {
+    throw runtime_error(
+        "Failed to read the node at offset " + to_string(position) + " of " +
+        filename_);
+  }
+  return node;
+}
+
+string ETNodeSource::readName(uint64_t position) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    openTrace();
+    // The column is read in place, only .et messages need the stream
+    if (compiled_trace_ != nullptr) {
+      checkCompiledPosition(position);
+      return compiled_trace_->readName(position);
+    }
+  }
+  return readNode(position)->name();
+}
+
+// Opens the trace on the first read; called with mutex_ held
+void ETNodeSource::openTrace() {
+  if ((trace_ == nullptr) && (compiled_trace_ == nullptr)) {
+    if (ETCompiledTrace::isCompiledTrace(filename_)) {
+      compiled_trace_ = make_shared<ETCompiledTrace>(filename_);
+    } else {
+      // Single messages are read at random positions, decompressing
+      // ahead on other threads would be wasted
+      trace_ = make_unique<ProtoInputStream>(filename_, 1);
+      if (!trace_->is_open()) {
+        trace_.reset();
+        throw runtime_error("Failed to open trace file: " + filename_);
+      }
+      if (!index_filename_.empty()) {
+        shared_ptr<ProtoStreamIndex> index =
+            ETTraceIndex::load(index_filename_);
+        if (index != nullptr) {
+          trace_->setIndex(index);
+        }
+      }
+    }
+  }
+}
+
+void ETNodeSource::checkCompiledPosition(uint64_t position) const {
+  if (position >= compiled_trace_->numNodes()) {
+    throw out_of_range(
+        "Node position " + to_string(position) + " out of range in " +
+        filename_);
+  }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "et_def/et_def.pb.h"
+#include "et_feeder/et_compiled_trace.h"
+#include "third_party/utils/protoio.hh"
+
+namespace Chakra {
+
+// Backing store of nodes whose message was dropped in lean node mode, or
+// that never had one because they were decoded from a compiled trace: it
+// interns their names and reads their message again on demand, through a
+// trace stream of its own so that the feeder's read position is left
+// alone. Nodes share the source, so it outlives the feeder as long as any
+// of them is referenced. All calls are thread-safe.
+class ETNodeSource {
+ public:
+  // index_filename is the trace index used to seek in gzip traces; it may
+  // be empty, in which case seeking backwards inflates from the start
+  ETNodeSource(std::string filename, std::string index_filename);
+  // Reads from a compiled trace that is already open
+  ETNodeSource(
+      std::string filename,
+      std::shared_ptr<const ETCompiledTrace> compiled_trace);
+
+  // Returns a name equal to the given one that stays valid as long as the
+  // source lives
+  const std::string* internName(const std::string& name);
+  // Reads the message of the node at the given position: the uncompressed
+  // offset of its message in an .et file, or its index in a compiled trace
+  std::shared_ptr<ChakraProtoMsg::Node> readNode(uint64_t position);
+  std::string readName(uint64_t position);
+
+ private:
+  ETNodeSource(const ETNodeSource&) = delete;
+  ETNodeSource& operator=(const ETNodeSource&) = delete;
+
+  void openTrace();
+  void checkCompiledPosition(uint64_t position) const;
+
+  const std::string filename_;
+  const std::string index_filename_;
+  std::mutex mutex_{};
+  std::unordered_set<std::string> names_{};
+  // Opened on the first read
+  std::unique_ptr<ProtoInputStream> trace_{};
+  std::shared_ptr<const ETCompiledTrace> compiled_trace_{};
+};
+
+} // namespace Chakra
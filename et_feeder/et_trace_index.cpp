@@ -0,0 +1,59 @@
+#include "et_feeder/et_trace_index.h"
+
+#include <stdexcept>
+
+#include "et_def/et_def.pb.h"
+
+using namespace std;
+using namespace Chakra;
+
+string ETTraceIndex::defaultFilename(const string& et_filename) {
+  return ProtoStreamIndex::sidecarName(et_filename);
+}
+
+void ETTraceIndex::build(
+    const string& et_filename,
+    const string& index_filename,
+    uint32_t node_stride,
+    uint64_t checkpoint_span) {
+  if (node_stride == 0) {
+    throw invalid_argument("Node stride of a trace index must be positive");
+  }
+
+  ProtoInputStream et(et_filename);
+  if (!et.is_open()) {
+    throw runtime_error("Failed to open trace file: " + et_filename);
+  }
+
+  ProtoStreamIndex index;
+  et.recordCheckpoints(&index, checkpoint_span);
+
+  ChakraProtoMsg::GlobalMetadata metadata;
+  if (!et.read(metadata)) {
+    throw runtime_error("Failed to read global metadata: " + et_filename);
+  }
+
+  ChakraProtoMsg::Node node;
+  uint64_t num_nodes = 0;
+  uint64_t offset = et.tell();
+  while (et.read(node)) {
+    if ((num_nodes % node_stride == 0) &&
+        (index.entries.empty() || (node.id() > index.entries.back().key))) {
+      index.entries.push_back({node.id(), offset});
+    }
+    ++num_nodes;
+    offset = et.tell();
+  }
+
+  if (!index.save(index_filename)) {
+    throw runtime_error("Failed to write trace index: " + index_filename);
+  }
+}
+
+shared_ptr<ProtoStreamIndex> ETTraceIndex::load(const string& index_filename) {
+  shared_ptr<ProtoStreamIndex> index = make_shared<ProtoStreamIndex>();
+  if (!index->load(index_filename)) {
+    return nullptr;
+  }
+  return index;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "third_party/utils/protoio.hh"
+
+namespace Chakra {
+
+// A trace index is a sidecar file that maps the ID of every N-th node of an
+// .et file to the uncompressed offset of its message, and for gzip files
+// also holds inflate checkpoints every few MB. With it the feeder can start
+// at any node without reading, or decompressing, the trace from the start.
+// Node IDs are expected to grow along the trace; entries for nodes whose ID
+// is smaller than an earlier entry are left out.
+class ETTraceIndex {
+ public:
+  static const uint32_t kDefaultNodeStride = 1024;
+  static const uint64_t kDefaultCheckpointSpan = 16 * 1024 * 1024;
+
+  // Name of the index the feeder picks up for a trace by default
+  static std::string defaultFilename(const std::string& et_filename);
+  // Reads an .et file (plain or gzip) once and writes its index
+  static void build(
+      const std::string& et_filename,
+      const std::string& index_filename,
+      uint32_t node_stride = kDefaultNodeStride,
+      uint64_t checkpoint_span = kDefaultCheckpointSpan);
+  // Loads an index, returns nullptr if the file is missing or invalid
+  static std::shared_ptr<ProtoStreamIndex> load(
+      const std::string& index_filename);
+};
+
+} // namespace Chakra
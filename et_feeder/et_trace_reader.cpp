@@ -0,0 +1,165 @@
+#include "et_feeder/et_trace_reader.h"
+
+#include <cstring>
+
+using namespace std;
+using namespace Chakra;
+
+// Nodes decoded consecutively share one arena in arena storage mode
+static const uint32_t kNodesPerArena = 16384;
+
+ETTraceReader::ETTraceReader(
+    const string& filename,
+    ProtoInputStream& trace,
+    bool arena_storage,
+    shared_ptr<ETNodeSource> node_source)
+    : trace_(trace),
+      arena_storage_(arena_storage),
+      node_source_(move(node_source)) {
+  if (ETCompiledTrace::isCompiledTrace(filename)) {
+    compiled_trace_ = make_shared<ETCompiledTrace>(filename);
+    compiled_source_ = make_shared<ETNodeSource>(filename, compiled_trace_);
+  }
+}
+
+// The copy starts an arena of its own
+ETTraceReader::ETTraceReader(
+    const ETTraceReader& other,
+    ProtoInputStream& trace)
+    : trace_(trace),
+      compiled_trace_(other.compiled_trace_),
+      compiled_source_(other.compiled_source_),
+      compiled_trace_next_node_(other.compiled_trace_next_node_),
+      arena_storage_(other.arena_storage_),
+      node_source_(other.node_source_) {
+  if (other.fold_ != nullptr) {
+    fold_ = make_unique<ETIterationFold>(*other.fold_);
+  }
+}
+
+bool ETTraceReader::isCompiled() const {
+  return compiled_trace_ != nullptr;
+}
+
+bool ETTraceReader::isFolded() const {
+  return fold_ != nullptr;
+}
+
+void ETTraceReader::readGlobalMetadata(
+    ChakraProtoMsg::GlobalMetadata& metadata) {
+  if (compiled_trace_ != nullptr) {
+    compiled_trace_->readGlobalMetadata(metadata);
+  } else {
+    trace_.read(metadata);
+  }
+  ETIterationFoldLayout fold_layout;
+  if (ETIterationFold::isFolded(metadata, fold_layout)) {
+    fold_ = make_unique<ETIterationFold>(fold_layout);
+  }
+}
+
+bool ETTraceReader::seekCompiledNode(uint64_t node_id) {
+  compiled_trace_next_node_ = compiled_trace_->findNode(node_id);
+  return compiled_trace_next_node_ != compiled_trace_->numNodes();
+}
+
+bool ETTraceReader::readNode(ETTraceNode& trace_node) {
+  // Iterations folded into the template come from memory
+  if ((fold_ != nullptr) && fold_->replaying()) {
+    trace_node.node = fold_->nextReplayedNode();
+    trace_node.parent_ids = getParentIDs(*trace_node.node->getChakraNode());
+    return true;
+  }
+  return readTraceNode(trace_node);
+}
+
+bool ETTraceReader::readTraceNode(ETTraceNode& trace_node) {
+  // Compiled nodes and their parents come straight from the columns
+  if (compiled_trace_ != nullptr) {
+    if (compiled_trace_next_node_ == compiled_trace_->numNodes()) {
+      return false;
+    }
+    uint64_t position = compiled_trace_next_node_++;
+    trace_node.node = compiled_trace_->readNode(position, compiled_source_);
+    trace_node.parent_ids = compiled_trace_->readParentIDs(position);
+    if (fold_ != nullptr) {
+      fold_->addTraceNode(trace_node.node);
+    }
+    return true;
+  }
+
+  // Lean nodes take what they need from the message, the dependencies
+  // included, and keep where it starts instead of the message itself
+  if (node_source_ != nullptr) {
+    uint64_t position = trace_.tell();
+    shared_ptr<ChakraProtoMsg::Node> pkt_msg =
+        make_shared<ChakraProtoMsg::Node>();
+    if (!trace_.read(*pkt_msg)) {
+      return false;
+    }
+    ETFeederNodeAttrs attrs;
+    ETFeederNode::decodeAttrs(*pkt_msg, attrs);
+    trace_node.node = make_shared<ETFeederNode>(
+        make_shared<ETFeederNodeData>(
+            *pkt_msg, attrs, node_source_, position));
+    trace_node.parent_ids = getParentIDs(*pkt_msg);
+    if (fold_ != nullptr) {
+      fold_->addTraceNode(move(pkt_msg), attrs);
+    }
+    return true;
+  }
+
+  // Arena nodes keep only the encoded message and the name, next to the
+  // decoded fields in the arena; the aliasing pointer keeps the arena
+  // alive for as long as the fields are referenced
+  if (arena_storage_) {
+    if ((arena_ == nullptr) || (arena_num_nodes_ == kNodesPerArena)) {
+      google::protobuf::ArenaOptions arena_options;
+      // Fixed-size blocks keep the unused tail of an arena small
+      arena_options.start_block_size = 256 * 1024;
+      arena_options.max_block_size = 256 * 1024;
+      arena_ = make_shared<google::protobuf::Arena>(arena_options);
+      arena_num_nodes_ = 0;
+    }
+    ++arena_num_nodes_;
+    if (!trace_.read(arena_message_)) {
+      return false;
+    }
+    ETFeederNodeAttrs attrs;
+    ETFeederNode::decodeAttrs(arena_message_, attrs);
+    const string& name = arena_message_.name();
+    size_t message_size = arena_message_.ByteSizeLong();
+    char* bytes = static_cast<char*>(
+        arena_->AllocateAligned(message_size + name.size()));
+    arena_message_.SerializeWithCachedSizesToArray(
+        reinterpret_cast<uint8_t*>(bytes));
+    memcpy(bytes + message_size, name.data(), name.size());
+    trace_node.node = make_shared<ETFeederNode>(
+        shared_ptr<const ETFeederNodeData>(
+            arena_,
+            google::protobuf::Arena::Create<ETFeederNodeData>(
+                arena_.get(),
+                arena_message_,
+                attrs,
+                bytes,
+                static_cast<uint32_t>(message_size),
+                bytes + message_size)));
+    trace_node.parent_ids = getParentIDs(arena_message_);
+    if (fold_ != nullptr) {
+      fold_->addTraceNode(trace_node.node);
+    }
+    return true;
+  }
+
+  shared_ptr<ChakraProtoMsg::Node> pkt_msg =
+      make_shared<ChakraProtoMsg::Node>();
+  if (!trace_.read(*pkt_msg)) {
+    return false;
+  }
+  trace_node.node = make_shared<ETFeederNode>(pkt_msg);
+  trace_node.parent_ids = getParentIDs(*pkt_msg);
+  if (fold_ != nullptr) {
+    fold_->addTraceNode(trace_node.node);
+  }
+  return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "et_def/et_def.pb.h"
+#include "et_feeder/et_compiled_trace.h"
+#include "et_feeder/et_feeder_node.h"
+#include "et_feeder/et_iteration_fold.h"
+#include "et_feeder/et_node_source.h"
+#include "third_party/utils/protoio.hh"
+
+namespace Chakra {
+
+// A node as read from a trace, with its data and control parents
+struct ETTraceNode {
+  std::shared_ptr<ETFeederNode> node{};
+  std::vector<uint64_t> parent_ids{};
+};
+
+// Reads the nodes of a trace for the feeders: from an .et stream or from a
+// compiled trace, with the iterations of a folded trace replayed from
+// memory. Compiled nodes are decoded without a message. Node storage of .et
+// traces follows the feeder options: nodes decoded one after the other
+// keep their encoded messages in shared protobuf arenas in arena storage
+// mode, and lean nodes drop their message once they have been read.
+class ETTraceReader {
+ public:
+  // Reads .et traces through the given stream, which the reader does not
+  // own; node_source is set in lean node mode
+  ETTraceReader(
+      const std::string& filename,
+      ProtoInputStream& trace,
+      bool arena_storage = false,
+      std::shared_ptr<ETNodeSource> node_source = nullptr);
+  // Copy for a forked feeder, which reads on from the same place through
+  // a stream of its own
+  ETTraceReader(const ETTraceReader& other, ProtoInputStream& trace);
+
+  bool isCompiled() const;
+  bool isFolded() const;
+  // Also picks up the layout of folded traces; read before any node
+  void readGlobalMetadata(ChakraProtoMsg::GlobalMetadata& metadata);
+  // Makes the node with the given ID the next one read from a compiled
+  // trace; returns false if the trace has no such node
+  bool seekCompiledNode(uint64_t node_id);
+  // Returns false at the end of the trace
+  bool readNode(ETTraceNode& trace_node);
+
+ private:
+  ETTraceReader& operator=(const ETTraceReader&) = delete;
+
+  bool readTraceNode(ETTraceNode& trace_node);
+
+  ProtoInputStream& trace_;
+  // Set when the input is a compiled trace, which is read instead of
+  // trace_; shared with forks
+  std::shared_ptr<const ETCompiledTrace> compiled_trace_{};
+  // Reads the names and messages of compiled nodes, which have neither
+  std::shared_ptr<ETNodeSource> compiled_source_{};
+  uint64_t compiled_trace_next_node_{0};
+  // Set when the trace is folded, replays the repeated iterations
+  std::unique_ptr<ETIterationFold> fold_{};
+  const bool arena_storage_;
+  std::shared_ptr<ETNodeSource> node_source_{};
+  // Arena shared by the nodes currently being decoded in arena storage
+  // mode, which are parsed into the same message one after the other
+  std::shared_ptr<google::protobuf::Arena> arena_{};
+  ChakraProtoMsg::Node arena_message_{};
+  uint32_t arena_num_nodes_{0};
+};
+
+} // namespace Chakra
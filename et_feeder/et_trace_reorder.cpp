@@ -0,0 +1,320 @@
+#include "et_feeder/et_trace_reorder.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "et_feeder/et_iteration_fold.h"
+#include "third_party/utils/protoio.hh"
+
+using namespace std;
+using namespace Chakra;
+
+const char* const ETTraceReorder::kTopologicalOrderAttr = "topological_order";
+const char* const ETTraceReorder::kMaxBackReachAttr = "max_dep_back_reach";
+const char* const ETTraceReorder::kRemainingRuntimeAttr = "remaining_runtime";
+
+static const uint32_t kMissingNode = UINT32_MAX;
+
+static void readGlobalMetadata(
+    ProtoInputStream& trace,
+    const string& filename,
+    ChakraProtoMsg::GlobalMetadata& metadata) {
+  if (!trace.is_open()) {
+    throw runtime_error("Failed to open trace file: " + filename);
+  }
+  if (!trace.read(metadata)) {
+    throw runtime_error("Failed to read global metadata: " + filename);
+  }
+}
+
+ETTraceReorderStats ETTraceReorder::reorder(
+    const string& input_filename,
+    const string& output_filename,
+    const ETTraceReorderOptions& options) {
+  ETTraceReorderStats stats;
+
+  // First pass: the dependency graph, with parents as node indices
+  vector<uint64_t> ids;
+  unordered_map<uint64_t, uint32_t> index;
+  vector<uint64_t> parents_begin = {0};
+  vector<uint64_t> parent_ids;
+  vector<uint64_t> runtimes;
+  {
+    ProtoInputStream input(input_filename);
+    ChakraProtoMsg::GlobalMetadata metadata;
+    readGlobalMetadata(input, input_filename, metadata);
+    // Reordering would move nodes in and out of the folded iterations
+    ETIterationFoldLayout layout;
+    if (ETIterationFold::isFolded(metadata, layout)) {
+      throw runtime_error(
+          "Unfold the trace before reordering it: " + input_filename);
+    }
+    ChakraProtoMsg::Node node;
+    vector<uint64_t> node_parent_ids;
+    while (input.read(node)) {
+      if (!index.emplace(node.id(), ids.size()).second) {
+        throw runtime_error(
+            "Duplicate node ID " + to_string(node.id()) + " in " +
+            input_filename);
+      }
+      ids.push_back(node.id());
+      if (options.annotate_remaining_runtime) {
+        runtimes.push_back(node.duration_micros());
+      }
+      // Data and control dependencies constrain the order alike
+      node_parent_ids.assign(node.data_deps().begin(), node.data_deps().end());
+      node_parent_ids.insert(
+          node_parent_ids.end(),
+          node.ctrl_deps().begin(),
+          node.ctrl_deps().end());
+      sort(node_parent_ids.begin(), node_parent_ids.end());
+      node_parent_ids.erase(
+          unique(node_parent_ids.begin(), node_parent_ids.end()),
+          node_parent_ids.end());
+      parent_ids.insert(
+          parent_ids.end(), node_parent_ids.begin(), node_parent_ids.end());
+      parents_begin.push_back(parent_ids.size());
+    }
+  }
+  uint32_t num_nodes = ids.size();
+  stats.num_nodes = num_nodes;
+
+  vector<uint32_t> parents(parent_ids.size());
+  vector<uint32_t> num_parents(num_nodes, 0);
+  vector<uint64_t> children_begin(num_nodes + 1, 0);
+  for (uint32_t child = 0; child < num_nodes; ++child) {
+    for (uint64_t i = parents_begin[child]; i < parents_begin[child + 1];
+         ++i) {
+      auto parent = index.find(parent_ids[i]);
+      if (parent == index.end()) {
+        parents[i] = kMissingNode;
+        ++stats.missing_deps;
+        continue;
+      }
+      if (parent->second == child) {
+        throw runtime_error(
+            "Node " + to_string(ids[child]) + " depends on itself in " +
+            input_filename);
+      }
+      parents[i] = parent->second;
+      ++num_parents[child];
+      ++children_begin[parent->second + 1];
+      if (parent->second > child) {
+        ++stats.forward_deps;
+      } else {
+        stats.input_max_back_reach =
+            max<uint64_t>(stats.input_max_back_reach, child - parent->second);
+      }
+    }
+  }
+  vector<uint64_t>().swap(parent_ids);
+
+  for (uint32_t i = 0; i < num_nodes; ++i) {
+    children_begin[i + 1] += children_begin[i];
+  }
+  vector<uint32_t> children(children_begin.back());
+  {
+    vector<uint64_t> next_child(
+        children_begin.begin(), children_begin.end() - 1);
+    for (uint32_t child = 0; child < num_nodes; ++child) {
+      for (uint64_t i = parents_begin[child]; i < parents_begin[child + 1];
+           ++i) {
+        if (parents[i] != kMissingNode) {
+          children[next_child[parents[i]]++] = child;
+        }
+      }
+    }
+  }
+
+  // Topological order that keeps the input order wherever it can: the
+  // ready node listed first in the input goes next
+  vector<uint32_t> order;
+  order.reserve(num_nodes);
+  {
+    vector<uint32_t> num_unplaced_parents = num_parents;
+    priority_queue<uint32_t, vector<uint32_t>, greater<uint32_t>> ready;
+    for (uint32_t i = 0; i < num_nodes; ++i) {
+      if (num_unplaced_parents[i] == 0) {
+        ready.push(i);
+      }
+    }
+    while (!ready.empty()) {
+      uint32_t node = ready.top();
+      ready.pop();
+      order.push_back(node);
+      for (uint64_t i = children_begin[node]; i < children_begin[node + 1];
+           ++i) {
+        if (--num_unplaced_parents[children[i]] == 0) {
+          ready.push(children[i]);
+        }
+      }
+    }
+  }
+  if (order.size() != num_nodes) {
+    throw runtime_error("Dependency cycle in " + input_filename);
+  }
+
+  // Nodes without parents can go anywhere before their children, so they
+  // move down to just before the first one
+  vector<uint32_t> position(num_nodes);
+  for (uint32_t i = 0; i < num_nodes; ++i) {
+    position[order[i]] = i;
+  }
+  vector<uint32_t> anchor(position);
+  for (uint32_t node = 0; node < num_nodes; ++node) {
+    if ((num_parents[node] != 0) ||
+        (children_begin[node] == children_begin[node + 1])) {
+      continue;
+    }
+    uint32_t first_child = UINT32_MAX;
+    for (uint64_t i = children_begin[node]; i < children_begin[node + 1];
+         ++i) {
+      first_child = min(first_child, position[children[i]]);
+    }
+    anchor[node] = first_child;
+  }
+  sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    // A moved node goes before its anchor, moved nodes keep their order
+    return make_tuple(anchor[a], anchor[a] == position[a], position[a]) <
+        make_tuple(anchor[b], anchor[b] == position[b], position[b]);
+  });
+  for (uint32_t i = 0; i < num_nodes; ++i) {
+    position[order[i]] = i;
+  }
+  for (uint32_t child = 0; child < num_nodes; ++child) {
+    for (uint64_t i = parents_begin[child]; i < parents_begin[child + 1];
+         ++i) {
+      if (parents[i] != kMissingNode) {
+        stats.max_back_reach = max<uint64_t>(
+            stats.max_back_reach, position[child] - position[parents[i]]);
+      }
+    }
+  }
+
+  // Children come after their parents in the new order, so going
+  // backwards their remaining runtimes are known before the parent's
+  vector<uint64_t> remaining_runtimes;
+  if (options.annotate_remaining_runtime) {
+    remaining_runtimes.assign(num_nodes, 0);
+    for (uint32_t i = num_nodes; i-- > 0;) {
+      uint32_t node = order[i];
+      uint64_t below = 0;
+      for (uint64_t j = children_begin[node]; j < children_begin[node + 1];
+           ++j) {
+        below = max(below, remaining_runtimes[children[j]]);
+      }
+      remaining_runtimes[node] = runtimes[node] + below;
+      stats.critical_path_runtime =
+          max(stats.critical_path_runtime, remaining_runtimes[node]);
+    }
+  }
+
+  // Second pass: nodes are written as soon as all nodes before them in
+  // the new order have been, the others are held back until then
+  ProtoInputStream input(input_filename);
+  ChakraProtoMsg::GlobalMetadata metadata;
+  readGlobalMetadata(input, input_filename, metadata);
+  auto attrs = metadata.mutable_attr();
+  attrs->erase(
+      remove_if(
+          attrs->begin(),
+          attrs->end(),
+          [](const ChakraProtoMsg::AttributeProto& attr) {
+            return (attr.name() == kTopologicalOrderAttr) ||
+                (attr.name() == kMaxBackReachAttr);
+          }),
+      attrs->end());
+  ChakraProtoMsg::AttributeProto* attr = metadata.add_attr();
+  attr->set_name(kTopologicalOrderAttr);
+  attr->set_bool_val(true);
+  attr = metadata.add_attr();
+  attr->set_name(kMaxBackReachAttr);
+  attr->set_uint64_val(stats.max_back_reach);
+
+  ProtoOutputStream output(output_filename);
+  output.write(metadata);
+
+  auto renumber = [&](google::protobuf::RepeatedField<uint64_t>* deps) {
+    auto end = remove_if(deps->begin(), deps->end(), [&](uint64_t id) {
+      return index.find(id) == index.end();
+    });
+    deps->Truncate(end - deps->begin());
+    for (uint64_t& id : *deps) {
+      id = position[index.at(id)];
+    }
+  };
+  auto write = [&](ChakraProtoMsg::Node& node, uint32_t node_index) {
+    if (options.annotate_remaining_runtime) {
+      auto node_attrs = node.mutable_attr();
+      node_attrs->erase(
+          remove_if(
+              node_attrs->begin(),
+              node_attrs->end(),
+              [](const ChakraProtoMsg::AttributeProto& attr) {
+                return attr.name() == kRemainingRuntimeAttr;
+              }),
+          node_attrs->end());
+      ChakraProtoMsg::AttributeProto* node_attr = node.add_attr();
+      node_attr->set_name(kRemainingRuntimeAttr);
+      node_attr->set_uint64_val(remaining_runtimes[node_index]);
+    }
+    if (options.renumber_ids) {
+      node.set_id(position[node_index]);
+      renumber(node.mutable_data_deps());
+      renumber(node.mutable_ctrl_deps());
+    }
+    output.write(node);
+  };
+
+  unordered_map<uint32_t, ChakraProtoMsg::Node> buffered;
+  uint32_t next = 0;
+  uint32_t node_index = 0;
+  ChakraProtoMsg::Node node;
+  while ((node_index < num_nodes) && input.read(node)) {
+    if (position[node_index] != next) {
+      buffered.emplace(node_index, move(node));
+      stats.peak_buffered_nodes =
+          max<uint64_t>(stats.peak_buffered_nodes, buffered.size());
+      node.Clear();
+      ++node_index;
+      continue;
+    }
+    write(node, node_index);
+    ++next;
+    ++node_index;
+    while (next < num_nodes) {
+      auto held = buffered.find(order[next]);
+      if (held == buffered.end()) {
+        break;
+      }
+      write(held->second, held->first);
+      buffered.erase(held);
+      ++next;
+    }
+  }
+  if (next != num_nodes) {
+    throw runtime_error(
+        "Trace file changed while reordering: " + input_filename);
+  }
+  return stats;
+}
+
+bool ETTraceReorder::isTopologicallyOrdered(
+    const ChakraProtoMsg::GlobalMetadata& metadata,
+    uint64_t& max_back_reach) {
+  bool topological_order = false;
+  max_back_reach = 0;
+  for (const ChakraProtoMsg::AttributeProto& attr : metadata.attr()) {
+    if (attr.name() == kTopologicalOrderAttr) {
+      topological_order = attr.bool_val();
+    } else if (attr.name() == kMaxBackReachAttr) {
+      max_back_reach = attr.uint64_val();
+    }
+  }
+  return topological_order;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "et_def/et_def.pb.h"
+
+namespace Chakra {
+
+struct ETTraceReorderOptions {
+  // Give nodes new IDs in their new order (starting from 0), so that IDs
+  // keep growing along the trace as trace indices and start_node_id
+  // expect. Dependencies on nodes missing from the trace are dropped.
+  bool renumber_ids = false;
+  // Set the remaining_runtime attribute of every node to its runtime plus
+  // the longest chain of runtimes below it, which RemainingRuntimePolicy
+  // issues by
+  bool annotate_remaining_runtime = false;
+};
+
+struct ETTraceReorderStats {
+  uint64_t num_nodes = 0;
+  // Dependencies on a node listed after its child, before reordering
+  uint64_t forward_deps = 0;
+  // Dependencies on nodes missing from the trace, which do not constrain
+  // the order
+  uint64_t missing_deps = 0;
+  // Largest distance, in nodes, from a node back to a parent listed
+  // before it, before and after reordering
+  uint64_t input_max_back_reach = 0;
+  uint64_t max_back_reach = 0;
+  // Nodes held back while writing the new order
+  uint64_t peak_buffered_nodes = 0;
+  // Longest chain of runtimes, when annotating remaining runtimes
+  uint64_t critical_path_runtime = 0;
+};
+
+// Rewrites an .et file so that every node comes after all of its parents,
+// keeping dependencies short: nodes keep their relative order unless a
+// parent has to move ahead of its child, and nodes without parents move
+// down to just before their first child. The output marks itself as
+// topologically ordered in its global metadata, along with how far back
+// dependencies reach, which the feeder uses to skip the bookkeeping of
+// parents it has not read yet.
+class ETTraceReorder {
+ public:
+  // Names of the global metadata attributes written to the output
+  static const char* const kTopologicalOrderAttr;
+  static const char* const kMaxBackReachAttr;
+  // Name of the node attribute written when annotating
+  static const char* const kRemainingRuntimeAttr;
+
+  // Reads the input once to build the dependency graph and once more to
+  // write the nodes in the new order. Throws on dependency cycles.
+  static ETTraceReorderStats reorder(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      const ETTraceReorderOptions& options = ETTraceReorderOptions());
+  // Returns true if global metadata marks the trace as topologically
+  // ordered, and how far back its dependencies reach
+  static bool isTopologicallyOrdered(
+      const ChakraProtoMsg::GlobalMetadata& metadata,
+      uint64_t& max_back_reach);
+};
+
+} // namespace Chakra
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "et_feeder/et_feeder_node.h"
+
+namespace Chakra {
+
+// An issue policy is the queue of issuable nodes of a BasicETFeeder and
+// decides which of them getNextIssuableNode() hands out first. Policies are
+// picked at compile time, so they share an interface but no base class:
+//
+//   void push(std::shared_ptr<ETFeederNode> node);
+//   std::shared_ptr<ETFeederNode> pop(); // only called when !empty()
+//   bool empty() const;
+//   size_t size() const;
+
+// Monotone radix heap over 64-bit keys: popping the minimum costs amortized
+// O(1) as long as no key smaller than the last popped one is pushed.
+// Keys that do break monotonicity go to a binary heap that is drained
+// first, since everything in it is smaller than anything in the radix heap.
+template <typename T>
+class RadixHeap {
+ public:
+  void push(uint64_t key, T value) {
+    if (key < last_) {
+      fallback_.emplace(key, std::move(value));
+    } else {
+      buckets_[bucketIndex(key)].emplace_back(key, std::move(value));
+      ++radix_size_;
+    }
+  }
+
+  // Pops a value with the smallest key
+  T pop() {
+    if (!fallback_.empty()) {
+      T value = std::move(const_cast<Entry&>(fallback_.top()).second);
+      fallback_.pop();
+      return value;
+    }
+    if (buckets_[0].empty()) {
+      refill();
+    }
+    T value = std::move(buckets_[0].back().second);
+    buckets_[0].pop_back();
+    --radix_size_;
+    return value;
+  }
+
+  bool empty() const {
+    return (radix_size_ == 0) && fallback_.empty();
+  }
+
+  size_t size() const {
+    return radix_size_ + fallback_.size();
+  }
+
+ private:
+  using Entry = std::pair<uint64_t, T>;
+
+  struct CompareKeys {
+    bool operator()(const Entry& lhs, const Entry& rhs) const {
+      return lhs.first > rhs.first;
+    }
+  };
+
+  // Bucket 0 holds keys equal to last_, bucket i keys whose highest bit
+  // differing from last_ is bit i - 1
+  size_t bucketIndex(uint64_t key) const {
+    return key == last_ ? 0 : 64 - __builtin_clzll(key ^ last_);
+  }
+
+  // Moves the smallest keys into bucket 0 by redistributing the first
+  // non-empty bucket around its minimum
+  void refill() {
+    size_t i = 1;
+    while (buckets_[i].empty()) {
+      ++i;
+    }
+    uint64_t min_key = buckets_[i].front().first;
+    for (const Entry& entry : buckets_[i]) {
+      min_key = std::min(min_key, entry.first);
+    }
+    last_ = min_key;
+    for (Entry& entry : buckets_[i]) {
+      buckets_[bucketIndex(entry.first)].push_back(std::move(entry));
+    }
+    buckets_[i].clear();
+  }
+
+  std::vector<Entry> buckets_[65]{};
+  size_t radix_size_{0};
+  uint64_t last_{0};
+  std::priority_queue<Entry, std::vector<Entry>, CompareKeys> fallback_{};
+};
+
+// Smallest node ID first, which is the order nodes appear in the trace
+class IdOrderPolicy {
+ public:
+  void push(std::shared_ptr<ETFeederNode> node) {
+    uint64_t id = node->id();
+    heap_.push(id, std::move(node));
+  }
+  std::shared_ptr<ETFeederNode> pop() {
+    return heap_.pop();
+  }
+  bool empty() const {
+    return heap_.empty();
+  }
+  size_t size() const {
+    return heap_.size();
+  }
+
+ private:
+  RadixHeap<std::shared_ptr<ETFeederNode>> heap_{};
+};
+
+// Nodes in the order they became issuable
+class FifoPolicy {
+ public:
+  void push(std::shared_ptr<ETFeederNode> node) {
+    queue_.push_back(std::move(node));
+  }
+  std::shared_ptr<ETFeederNode> pop() {
+    std::shared_ptr<ETFeederNode> node = std::move(queue_.front());
+    queue_.pop_front();
+    return node;
+  }
+  bool empty() const {
+    return queue_.empty();
+  }
+  size_t size() const {
+    return queue_.size();
+  }
+
+ private:
+  std::deque<std::shared_ptr<ETFeederNode>> queue_{};
+};
+
+// Highest comm_priority first, FIFO among equal priorities. Priorities are
+// small in practice and kept in one bucket each; larger ones share a heap.
+class CommPriorityPolicy {
+ public:
+  void push(std::shared_ptr<ETFeederNode> node) {
+    uint32_t priority = node->comm_priority();
+    if (priority >= kNumBuckets) {
+      overflow_.emplace(priority, seq_++, std::move(node));
+      return;
+    }
+    buckets_[priority].push_back(std::move(node));
+    top_bucket_ = std::max(top_bucket_, priority);
+    ++bucket_size_;
+  }
+  std::shared_ptr<ETFeederNode> pop() {
+    if (!overflow_.empty()) {
+      std::shared_ptr<ETFeederNode> node =
+          std::move(std::get<2>(const_cast<Entry&>(overflow_.top())));
+      overflow_.pop();
+      return node;
+    }
+    while (buckets_[top_bucket_].empty()) {
+      --top_bucket_;
+    }
+    std::shared_ptr<ETFeederNode> node =
+        std::move(buckets_[top_bucket_].front());
+    buckets_[top_bucket_].pop_front();
+    --bucket_size_;
+    return node;
+  }
+  bool empty() const {
+    return (bucket_size_ == 0) && overflow_.empty();
+  }
+  size_t size() const {
+    return bucket_size_ + overflow_.size();
+  }
+
+ private:
+  static const uint32_t kNumBuckets = 64;
+  // Priority and push order
+  using Entry = std::tuple<uint32_t, uint64_t, std::shared_ptr<ETFeederNode>>;
+
+  struct CompareEntries {
+    bool operator()(const Entry& lhs, const Entry& rhs) const {
+      if (std::get<0>(lhs) != std::get<0>(rhs)) {
+        return std::get<0>(lhs) < std::get<0>(rhs);
+      }
+      return std::get<1>(lhs) > std::get<1>(rhs);
+    }
+  };
+
+  std::deque<std::shared_ptr<ETFeederNode>> buckets_[kNumBuckets]{};
+  uint32_t top_bucket_{0};
+  size_t bucket_size_{0};
+  uint64_t seq_{0};
+  std::priority_queue<Entry, std::vector<Entry>, CompareEntries> overflow_{};
+};
+
+// Longest remaining runtime first, i.e. nodes on the critical path before
+// others. The remaining runtime of a node (its own runtime plus the longest
+// chain of runtimes below it) is precomputed offline and read from its
+// remaining_runtime attribute; ties go to the smaller node ID.
+class RemainingRuntimePolicy {
+ public:
+  void push(std::shared_ptr<ETFeederNode> node) {
+    uint64_t remaining_runtime = node->remaining_runtime();
+    uint64_t id = node->id();
+    heap_.emplace(remaining_runtime, id, std::move(node));
+  }
+  std::shared_ptr<ETFeederNode> pop() {
+    std::shared_ptr<ETFeederNode> node =
+        std::move(std::get<2>(const_cast<Entry&>(heap_.top())));
+    heap_.pop();
+    return node;
+  }
+  bool empty() const {
+    return heap_.empty();
+  }
+  size_t size() const {
+    return heap_.size();
+  }
+
+ private:
+  // Keys are kept next to the node so that comparisons do not chase it
+  using Entry = std::tuple<uint64_t, uint64_t, std::shared_ptr<ETFeederNode>>;
+
+  struct CompareEntries {
+    bool operator()(const Entry& lhs, const Entry& rhs) const {
+      if (std::get<0>(lhs) != std::get<0>(rhs)) {
+        return std::get<0>(lhs) < std::get<0>(rhs);
+      }
+      return std::get<1>(lhs) > std::get<1>(rhs);
+    }
+  };
+
+  std::priority_queue<Entry, std::vector<Entry>, CompareEntries> heap_{};
+};
+
+} // namespace Chakra
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+namespace Chakra {
+
+// Set of node IDs stored as a bitmap split into fixed-size pages that are
+// allocated on first use. Node IDs of a trace are dense, so this takes a
+// bit per node where a hash set would take tens of bytes.
+class NodeIdBitmap {
+ public:
+  NodeIdBitmap() = default;
+  // Deep copy, for forked feeders
+  NodeIdBitmap(const NodeIdBitmap& other) {
+    pages_.reserve(other.pages_.size());
+    for (const auto& page : other.pages_) {
+      std::unique_ptr<uint64_t[]>& copy = pages_[page.first];
+      copy.reset(new uint64_t[kWordsPerPage]);
+      std::copy(
+          page.second.get(), page.second.get() + kWordsPerPage, copy.get());
+    }
+  }
+
+  void insert(uint64_t id) {
+    std::unique_ptr<uint64_t[]>& page = pages_[id / kBitsPerPage];
+    if (page == nullptr) {
+      page.reset(new uint64_t[kWordsPerPage]());
+    }
+    page[(id % kBitsPerPage) / 64] |= uint64_t(1) << (id % 64);
+  }
+
+  bool contains(uint64_t id) const {
+    auto page = pages_.find(id / kBitsPerPage);
+    if (page == pages_.end()) {
+      return false;
+    }
+    return (page->second[(id % kBitsPerPage) / 64] >> (id % 64)) & 1;
+  }
+
+ private:
+  static const uint64_t kBitsPerPage = 65536;
+  static const uint64_t kWordsPerPage = kBitsPerPage / 64;
+
+  std::unordered_map<uint64_t, std::unique_ptr<uint64_t[]>> pages_{};
+};
+
+} // namespace Chakra
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace Chakra {
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. push() and pop() never block; they return false when the queue is
+// full or empty and leave waiting policy to the caller.
+template <typename T>
+class SPSCQueue {
+ public:
+  explicit SPSCQueue(size_t capacity) : slots_(capacity + 1) {}
+
+  // Only moves from value when the push succeeds
+  bool push(T&& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t next = increment(tail);
+    if (next == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    slots_[tail] = std::move(value);
+    tail_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = std::move(slots_[head]);
+    slots_[head] = T();
+    head_.store(increment(head), std::memory_order_release);
+    return true;
+  }
+
+  // Approximate when called concurrently with push() or pop()
+  size_t size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return (tail >= head) ? (tail - head) : (tail + slots_.size() - head);
+  }
+
+  size_t capacity() const {
+    return slots_.size() - 1;
+  }
+
+ private:
+  size_t increment(size_t index) const {
+    return (index + 1 == slots_.size()) ? 0 : index + 1;
+  }
+
+  std::vector<T> slots_;
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+} // namespace Chakra
@@ -0,0 +1,13 @@
+#include <string>
+
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+int main() {
+  return runShapes("concurrent_et_feeder_test", [](const TestTrace& trace) {
+    feedConcurrent(
+        trace.filename, trace.deps, string(trace.shape.name) + " concurrent");
+  });
+}
@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+static string readFile(const string& filename) {
+  ifstream file(filename, ios::in | ios::binary);
+  return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static void writeFile(const string& filename, const string& data) {
+  ofstream(filename, ios::out | ios::binary | ios::trunc) << data;
+}
+
+// Every corruption of a valid compiled trace has to be rejected when the
+// trace is opened
+static void checkCorrupt(const string& compiled_filename, const string& run) {
+  const string image = readFile(compiled_filename);
+  ETCompiledTraceHeader header;
+  memcpy(&header, image.data(), sizeof(header));
+  auto column = [&](ETCompiledTraceColumn col) {
+    return header.column_offset[col];
+  };
+  struct Corruption {
+    const char* name;
+    function<void(string&, ETCompiledTraceHeader&)> apply;
+  };
+  const Corruption corruptions[] = {
+      {"truncated",
+       [&](string& data, ETCompiledTraceHeader&) {
+         data.resize(column(kColumnCtrlDep));
+       }},
+      {"column past the end",
+       [&](string& data, ETCompiledTraceHeader& h) {
+         h.column_offset[kColumnRuntime] = data.size();
+       }},
+      {"misaligned column",
+       [&](string&, ETCompiledTraceHeader& h) {
+         h.column_offset[kColumnDataDep] += 1;
+       }},
+      {"too many nodes",
+       [&](string&, ETCompiledTraceHeader& h) { h.num_nodes *= 2; }},
+      {"name out of range",
+       [&](string& data, ETCompiledTraceHeader& h) {
+         uint32_t name = static_cast<uint32_t>(h.num_strings);
+         memcpy(&data[column(kColumnName)], &name, sizeof(name));
+       }},
+      {"decreasing dep offsets",
+       [&](string& data, ETCompiledTraceHeader&) {
+         uint64_t offset = UINT64_MAX;
+         memcpy(
+             &data[column(kColumnDataDepOffset) + sizeof(offset)],
+             &offset,
+             sizeof(offset));
+       }},
+      {"dep offsets past the deps",
+       [&](string&, ETCompiledTraceHeader& h) { h.num_ctrl_deps -= 1; }},
+      {"string offsets past the strings",
+       [&](string&, ETCompiledTraceHeader& h) { h.string_data_size -= 1; }},
+  };
+  const string corrupt_filename = "et_compiled_trace_test_corrupt.cet";
+  for (const Corruption& corruption : corruptions) {
+    string data = image;
+    ETCompiledTraceHeader corrupt_header = header;
+    corruption.apply(data, corrupt_header);
+    memcpy(&data[0], &corrupt_header, sizeof(corrupt_header));
+    writeFile(corrupt_filename, data);
+    bool rejected = false;
+    try {
+      ETCompiledTrace trace(corrupt_filename);
+    } catch (const runtime_error&) {
+      rejected = true;
+    }
+    check(rejected, run + ": accepted " + corruption.name + " trace");
+  }
+  remove(corrupt_filename.c_str());
+}
+
+// Compiled nodes keep no message; their name and the message built on
+// demand have to match the node of the original trace
+static void checkNodes(
+    const string& filename,
+    const string& compiled_filename,
+    const string& run) {
+  ETFeeder feeder(filename);
+  ETFeeder compiled_feeder(compiled_filename);
+  while (feeder.hasNodesToIssue()) {
+    shared_ptr<ETFeederNode> node = feeder.getNextIssuableNode();
+    shared_ptr<ETFeederNode> compiled_node =
+        compiled_feeder.getNextIssuableNode();
+    check(compiled_node != nullptr, run + ": missing node");
+    check(compiled_node->id() == node->id(), run + ": node order differs");
+    check(
+        compiled_node->isChakraNodeReleased(),
+        run + ": compiled node " + to_string(node->id()) + " keeps a message");
+    check(
+        compiled_node->name() == node->name(),
+        run + ": name of node " + to_string(node->id()) + " differs");
+    shared_ptr<ChakraProtoMsg::Node> msg = node->getChakraNode();
+    shared_ptr<ChakraProtoMsg::Node> compiled_msg =
+        compiled_node->getChakraNode();
+    check(
+        (compiled_msg->name() == msg->name()) &&
+            (compiled_msg->type() == msg->type()) &&
+            (compiled_msg->duration_micros() == msg->duration_micros()) &&
+            (getParentIDs(*compiled_msg) == getParentIDs(*msg)),
+        run + ": message of node " + to_string(node->id()) + " differs");
+    for (ETFeeder* f : {&feeder, &compiled_feeder}) {
+      f->freeChildrenNodes(node->id());
+      f->removeNode(node->id());
+    }
+  }
+  check(!compiled_feeder.hasNodesToIssue(), run + ": extra nodes");
+}
+
+// A compiled trace has to issue in the same order as the original one
+int main() {
+  return runShapes("et_compiled_trace_test", [](const TestTrace& trace) {
+    const string compiled_filename = "et_compiled_trace_test.cet";
+    const string run = string(trace.shape.name) + " compiled";
+    ETCompiledTrace::compile(trace.filename, compiled_filename);
+    checkSameOrder(
+        trace.expected,
+        feedTrace(compiled_filename, ETFeederOptions(), trace.deps, run),
+        run);
+    checkNodes(trace.filename, compiled_filename, run);
+    checkCorrupt(compiled_filename, run);
+    remove(compiled_filename.c_str());
+  });
+}
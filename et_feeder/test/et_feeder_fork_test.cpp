@@ -0,0 +1,40 @@
+#include <memory>
+#include <string>
+
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+// Forks the feeder halfway through every shape; the fork and the feeder it
+// was forked from have to continue the same way
+int main() {
+  return runShapes("et_feeder_fork_test", [](const TestTrace& trace) {
+    const string run = trace.shape.name;
+    ETFeederOptions options;
+    options.window_size = 1024;
+    options.fork_checkpoints = true;
+    ETFeeder feeder(trace.filename, options);
+    IssueChecker checker(trace.deps, run + " fork");
+    feed(feeder, checker, trace.deps.size() / 2);
+
+    unique_ptr<ETFeeder> fork = feeder.fork();
+    // Held nodes are copied, their decoded fields are shared
+    for (const auto& node : trace.deps) {
+      shared_ptr<ETFeederNode> held = feeder.lookupNode(node.first);
+      if (held == nullptr) {
+        continue;
+      }
+      shared_ptr<ETFeederNode> forked = fork->lookupNode(node.first);
+      check(
+          (forked != nullptr) && (forked != held) &&
+              (&forked->attrs() == &held->attrs()),
+          run + ": node " + to_string(node.first) + " not forked");
+    }
+    IssueChecker fork_checker = checker;
+    feed(feeder, checker);
+    feed(*fork, fork_checker);
+    checkSameOrder(trace.expected, checker.finish(), run + " forked feeder");
+    checkSameOrder(trace.expected, fork_checker.finish(), run + " fork");
+  });
+}
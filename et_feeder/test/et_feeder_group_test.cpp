@@ -0,0 +1,42 @@
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "et_feeder/et_feeder_group.h"
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+// Opens one rank per shape and splits a total node budget across them;
+// every rank has to feed its whole trace within its share of the budget
+int main() {
+  vector<string> filenames;
+  try {
+    for (const TestShape& shape : kTestShapes) {
+      filenames.push_back(string("et_feeder_group_test_") + shape.name + ".et");
+      writeSyntheticTrace(filenames.back(), shape.shape, kTestNumNodes);
+    }
+    ETFeederGroupOptions options;
+    options.feeder_options.window_size = 1024;
+    options.max_total_window_nodes = filenames.size() * 2048;
+    ETFeederGroup group(filenames, options);
+    for (size_t rank = 0; rank < group.size(); ++rank) {
+      const TraceDeps deps = readTraceDeps(filenames[rank]);
+      IssueChecker checker(deps, "group rank " + to_string(rank));
+      feed(*group.getFeeder(rank), checker);
+      checker.finish();
+    }
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  for (const string& filename : filenames) {
+    remove(filename.c_str());
+  }
+  cout << "group: ok" << endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <functional>
+#include <string>
+
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+// Forks a feeder halfway through a gzip trace; the fork seeks with the
+// inflate checkpoints the feeder records
+static void checkFork(
+    const TestTrace& trace,
+    const string& filename,
+    const string& run) {
+  ETFeederOptions options;
+  options.window_size = 1024;
+  options.fork_checkpoints = true;
+  ETFeeder feeder(filename, options);
+  IssueChecker checker(trace.deps, run);
+  feed(feeder, checker, trace.deps.size() / 2);
+  unique_ptr<ETFeeder> fork = feeder.fork();
+  IssueChecker fork_checker = checker;
+  feed(feeder, checker);
+  feed(*fork, fork_checker);
+  checkSameOrder(trace.expected, checker.finish(), run + " forked feeder");
+  checkSameOrder(trace.expected, fork_checker.finish(), run);
+}
+
+// Block and single-stream gzip round trips of every shape, fed with the
+// decompression options and the option sets and forks that seek in the
+// compressed trace
+int main() {
+  struct OptionSet {
+    const char* name;
+    function<void(ETFeederOptions&)> apply;
+  };
+  const OptionSet option_sets[] = {
+      {"default", [](ETFeederOptions&) {}},
+      {"decompression threads",
+       [](ETFeederOptions& o) { o.decompression_threads = 2; }},
+      {"prefetch", [](ETFeederOptions& o) { o.prefetch = true; }},
+      {"lean nodes", [](ETFeederOptions& o) { o.lean_nodes = true; }},
+  };
+  struct GzipFormat {
+    const char* name;
+    bool block_gzip;
+  };
+  const GzipFormat formats[] = {
+      {"block gzip", true},
+      {"single-stream gzip", false},
+  };
+  return runShapes("et_feeder_gzip_test", [&](const TestTrace& trace) {
+    for (const GzipFormat& format : formats) {
+      const string gzip_filename = trace.filename + ".gz";
+      const string run = string(trace.shape.name) + " " + format.name;
+      writeSyntheticTrace(
+          gzip_filename, trace.shape.shape, kTestNumNodes, format.block_gzip);
+      check(readTraceDeps(gzip_filename) == trace.deps, run + ": round trip");
+      for (const OptionSet& option_set : option_sets) {
+        ETFeederOptions options;
+        option_set.apply(options);
+        const string option_run = run + " " + option_set.name;
+        checkSameOrder(
+            trace.expected,
+            feedTrace(gzip_filename, options, trace.deps, option_run),
+            option_run);
+      }
+      checkFork(trace, gzip_filename, run + " fork");
+      remove(gzip_filename.c_str());
+    }
+  });
+}
@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+// Off the stride of the index, so that the feeder has to read on from the
+// entry before it
+static const uint64_t kStartNodeId = kTestNumNodes / 2 + 3;
+static const uint32_t kIndexNodeStride = 64;
+
+// Dependencies of the nodes from the start node on; parents before it
+// count as finished
+static TraceDeps startDeps(const TraceDeps& deps) {
+  TraceDeps start_deps;
+  for (const auto& node : deps) {
+    if (node.first < kStartNodeId) {
+      continue;
+    }
+    vector<uint64_t>& parents = start_deps[node.first];
+    for (uint64_t parent : node.second) {
+      if (parent >= kStartNodeId) {
+        parents.push_back(parent);
+      }
+    }
+  }
+  return start_deps;
+}
+
+// Starts every shape halfway through plain and gzip traces, with and
+// without a sidecar index; all runs have to issue in the same order, and
+// a start node that is not in the trace has to be reported
+int main() {
+  return runShapes("et_feeder_start_node_test", [](const TestTrace& trace) {
+    const TraceDeps deps = startDeps(trace.deps);
+    ETFeederOptions options;
+    options.start_node_id = kStartNodeId;
+    ETFeederOptions missing_options;
+    missing_options.start_node_id = kTestNumNodes;
+
+    const string gzip_filename = trace.filename + ".gz";
+    writeSyntheticTrace(gzip_filename, trace.shape.shape, kTestNumNodes);
+    vector<uint64_t> expected;
+    for (const string& filename : {trace.filename, gzip_filename}) {
+      const string index_filename = ETTraceIndex::defaultFilename(filename);
+      for (bool indexed : {false, true}) {
+        if (indexed) {
+          ETTraceIndex::build(filename, index_filename, kIndexNodeStride);
+        }
+        const string run =
+            filename + (indexed ? " indexed" : "") + " start node";
+        vector<uint64_t> order = feedTrace(filename, options, deps, run);
+        if (expected.empty()) {
+          expected = order;
+        }
+        checkSameOrder(expected, order, run);
+
+        bool reported = false;
+        try {
+          ETFeeder feeder(filename, missing_options);
+        } catch (const runtime_error&) {
+          reported = true;
+        }
+        check(reported, run + ": missing start node not reported");
+      }
+      remove(index_filename.c_str());
+    }
+    remove(gzip_filename.c_str());
+  });
+}
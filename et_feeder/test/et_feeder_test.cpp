@@ -0,0 +1,63 @@
+#include <functional>
+#include <string>
+
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+// Feeds every shape under the main option sets and issue policies; option
+// sets that keep the feeder deterministic have to issue in ID order like
+// the default one
+int main() {
+  struct OptionSet {
+    const char* name;
+    function<void(ETFeederOptions&)> apply;
+  };
+  const OptionSet option_sets[] = {
+      {"small window", [](ETFeederOptions& o) { o.window_size = 1024; }},
+      {"adaptive window",
+       [](ETFeederOptions& o) {
+         o.window_size = 1024;
+         o.adaptive_window = true;
+         o.min_window_size = 256;
+       }},
+      {"bounded window",
+       [](ETFeederOptions& o) {
+         o.window_size = 1024;
+         o.adaptive_window = true;
+         o.max_window_nodes = 2048;
+         o.bounded_window = true;
+       }},
+      {"prefetch",
+       [](ETFeederOptions& o) {
+         o.window_size = 1024;
+         o.prefetch = true;
+         o.prefetch_queue_size = 64;
+       }},
+      {"arena storage", [](ETFeederOptions& o) { o.arena_storage = true; }},
+      {"lean nodes", [](ETFeederOptions& o) { o.lean_nodes = true; }},
+  };
+  return runShapes("et_feeder_test", [&](const TestTrace& trace) {
+    for (const OptionSet& option_set : option_sets) {
+      ETFeederOptions options;
+      option_set.apply(options);
+      const string run = string(trace.shape.name) + " " + option_set.name;
+      checkSameOrder(
+          trace.expected,
+          feedTrace(trace.filename, options, trace.deps, run),
+          run);
+    }
+
+    const string run = trace.shape.name;
+    feedTrace<FifoETFeeder>(
+        trace.filename, ETFeederOptions(), trace.deps, run + " fifo");
+    feedTrace<CommPriorityETFeeder>(
+        trace.filename, ETFeederOptions(), trace.deps, run + " comm priority");
+    feedTrace<RemainingRuntimeETFeeder>(
+        trace.filename,
+        ETFeederOptions(),
+        trace.deps,
+        run + " remaining runtime");
+  });
+}
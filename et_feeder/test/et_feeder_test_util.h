@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "et_feeder/benchmark/synthetic_trace.h"
+#include "et_feeder/concurrent_et_feeder.h"
+#include "et_feeder/et_feeder.h"
+
+namespace Chakra {
+
+// Helpers shared by the feeder tests: every test feeds the synthetic trace
+// shapes through one feature, and every run has to issue each node of the
+// trace exactly once, after all of its parents. Runs of the same trace that
+// are deterministic have to issue in the same order.
+
+static const uint64_t kTestNumNodes = 1 << 14;
+
+struct TestShape {
+  const char* name;
+  SyntheticTraceShape shape;
+};
+
+static const TestShape kTestShapes[] = {
+    {"chain", SyntheticTraceShape::Chain},
+    {"long_range", SyntheticTraceShape::LongRange},
+    {"parallel", SyntheticTraceShape::Parallel},
+    {"fan_out", SyntheticTraceShape::FanOut},
+    {"collective", SyntheticTraceShape::Collective},
+    {"iterations", SyntheticTraceShape::Iterations},
+    {"ctrl_deps", SyntheticTraceShape::CtrlDeps},
+};
+
+// Parents (data and control) of every node, keyed by node ID
+using TraceDeps = std::unordered_map<uint64_t, std::vector<uint64_t>>;
+
+inline void check(bool condition, const std::string& message) {
+  if (!condition) {
+    throw std::runtime_error(message);
+  }
+}
+
+inline TraceDeps readTraceDeps(const std::string& filename) {
+  ProtoInputStream et(filename);
+  ChakraProtoMsg::GlobalMetadata metadata;
+  check(et.read(metadata), "Missing global metadata in " + filename);
+  TraceDeps deps;
+  ChakraProtoMsg::Node node;
+  while (et.read(node)) {
+    std::vector<uint64_t>& parents = deps[node.id()];
+    parents.assign(node.data_deps().begin(), node.data_deps().end());
+    parents.insert(
+        parents.end(), node.ctrl_deps().begin(), node.ctrl_deps().end());
+  }
+  return deps;
+}
+
+// Records the issue order of a run and checks every issued node against
+// the dependencies of the trace
+class IssueChecker {
+ public:
+  IssueChecker(const TraceDeps& deps, const std::string& run)
+      : deps_(deps), run_(run) {}
+
+  void issue(uint64_t node_id) {
+    auto parents = deps_.find(node_id);
+    check(
+        parents != deps_.end(),
+        run_ + ": issued unknown node " + std::to_string(node_id));
+    check(
+        issued_.insert(node_id).second,
+        run_ + ": issued node " + std::to_string(node_id) + " twice");
+    for (uint64_t parent : parents->second) {
+      check(
+          completed_.count(parent) != 0,
+          run_ + ": issued node " + std::to_string(node_id) +
+              " before parent " + std::to_string(parent));
+    }
+    order_.push_back(node_id);
+  }
+
+  void complete(uint64_t node_id) {
+    completed_.insert(node_id);
+  }
+
+  const std::vector<uint64_t>& finish() const {
+    check(
+        order_.size() == deps_.size(),
+        run_ + ": issued " + std::to_string(order_.size()) + " of " +
+            std::to_string(deps_.size()) + " nodes");
+    return order_;
+  }
+
+ private:
+  const TraceDeps& deps_;
+  const std::string run_;
+  std::unordered_set<uint64_t> issued_{};
+  std::unordered_set<uint64_t> completed_{};
+  std::vector<uint64_t> order_{};
+};
+
+// Issues and completes nodes one at a time until the feeder runs dry or
+// max_nodes nodes have been issued
+template <typename Feeder>
+void feed(
+    Feeder& feeder,
+    IssueChecker& checker,
+    uint64_t max_nodes = UINT64_MAX) {
+  for (uint64_t i = 0; (i < max_nodes) && feeder.hasNodesToIssue(); ++i) {
+    std::shared_ptr<ETFeederNode> node = feeder.getNextIssuableNode();
+    if (node == nullptr) {
+      break;
+    }
+    checker.issue(node->id());
+    checker.complete(node->id());
+    feeder.freeChildrenNodes(node->id());
+    feeder.removeNode(node->id());
+  }
+}
+
+template <typename Feeder = ETFeeder>
+std::vector<uint64_t> feedTrace(
+    const std::string& filename,
+    const ETFeederOptions& options,
+    const TraceDeps& deps,
+    const std::string& run) {
+  Feeder feeder(filename, options);
+  IssueChecker checker(deps, run);
+  feed(feeder, checker);
+  return checker.finish();
+}
+
+// Issues from several worker threads at once, in whatever order the
+// threads get to the nodes
+inline void feedConcurrent(
+    const std::string& filename,
+    const TraceDeps& deps,
+    const std::string& run) {
+  ConcurrentETFeederOptions options;
+  options.num_workers = 4;
+  options.window_size = 1024;
+  ConcurrentETFeeder feeder(filename, options);
+  IssueChecker checker(deps, run);
+  std::mutex checker_mutex;
+  std::exception_ptr error;
+
+  std::vector<std::thread> workers;
+  for (uint32_t worker = 0; worker < options.num_workers; ++worker) {
+    workers.emplace_back([&, worker]() {
+      try {
+        while (feeder.hasNodesToIssue()) {
+          std::shared_ptr<ETFeederNode> node =
+              feeder.getNextIssuableNode(worker);
+          if (node == nullptr) {
+            std::this_thread::yield();
+            continue;
+          }
+          std::lock_guard<std::mutex> lock(checker_mutex);
+          checker.issue(node->id());
+          checker.complete(node->id());
+          feeder.completeNode(worker, node);
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(checker_mutex);
+        error = std::current_exception();
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  checker.finish();
+}
+
+inline void checkSameOrder(
+    const std::vector<uint64_t>& expected,
+    const std::vector<uint64_t>& order,
+    const std::string& run) {
+  check(order == expected, run + ": issue order differs");
+}
+
+// A synthetic trace written for a test, with its dependencies and the
+// order in which a feeder with default options issues it
+struct TestTrace {
+  const TestShape& shape;
+  std::string filename;
+  TraceDeps deps;
+  std::vector<uint64_t> expected;
+};
+
+// Writes every shape as <test>_<shape>.et, hands it to check_trace and
+// removes it again; returns the exit status of the test
+inline int runShapes(
+    const std::string& test,
+    const std::function<void(const TestTrace&)>& check_trace) {
+  try {
+    for (const TestShape& shape : kTestShapes) {
+      TestTrace trace{shape, test + "_" + shape.name + ".et", {}, {}};
+      writeSyntheticTrace(trace.filename, shape.shape, kTestNumNodes);
+      trace.deps = readTraceDeps(trace.filename);
+      check(trace.deps.size() == kTestNumNodes, trace.filename + ": short");
+      trace.expected = feedTrace(
+          trace.filename, ETFeederOptions(), trace.deps, shape.name);
+      check_trace(trace);
+      std::remove(trace.filename.c_str());
+      std::cout << shape.name << ": ok" << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+} // namespace Chakra
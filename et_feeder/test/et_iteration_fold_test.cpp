@@ -0,0 +1,30 @@
+#include <cstdio>
+#include <string>
+
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+// A folded trace has to issue in the same order as the original one, on
+// the feeder and on the concurrent feeder; the shapes that repeat in
+// iterations have to fold
+int main() {
+  return runShapes("et_iteration_fold_test", [](const TestTrace& trace) {
+    const string folded_filename = "et_iteration_fold_test_folded.et";
+    const string run = string(trace.shape.name) + " folded";
+    ETIterationFoldStats stats =
+        ETIterationFold::fold(trace.filename, folded_filename);
+    bool repeats = (trace.shape.shape == SyntheticTraceShape::Iterations) ||
+        (trace.shape.shape == SyntheticTraceShape::CtrlDeps);
+    check(
+        !repeats || (stats.folded_nodes != 0),
+        run + ": trace did not fold");
+    checkSameOrder(
+        trace.expected,
+        feedTrace(folded_filename, ETFeederOptions(), trace.deps, run),
+        run);
+    feedConcurrent(folded_filename, trace.deps, run + " concurrent");
+    remove(folded_filename.c_str());
+  });
+}
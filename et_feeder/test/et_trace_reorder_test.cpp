@@ -0,0 +1,47 @@
+#include <cstdio>
+#include <string>
+
+#include "et_feeder/test/et_feeder_test_util.h"
+
+using namespace std;
+using namespace Chakra;
+
+// Round trip through et_reorder: the reordered trace keeps the node IDs
+// and has to issue in the same order as the original one, whether or not
+// the feeder trusts its topological order. With renumbered IDs the trace
+// is checked against its own dependencies.
+int main() {
+  return runShapes("et_trace_reorder_test", [](const TestTrace& trace) {
+    const string reordered_filename = "et_trace_reorder_test_reordered.et";
+    const string run = string(trace.shape.name) + " reordered";
+    ETTraceReorderStats stats =
+        ETTraceReorder::reorder(trace.filename, reordered_filename);
+    check(stats.num_nodes == trace.deps.size(), run + ": lost nodes");
+    check(
+        readTraceDeps(reordered_filename) == trace.deps,
+        run + ": dependencies differ");
+    ETFeederOptions options;
+    checkSameOrder(
+        trace.expected,
+        feedTrace(reordered_filename, options, trace.deps, run),
+        run);
+    options.trust_topological_order = false;
+    checkSameOrder(
+        trace.expected,
+        feedTrace(reordered_filename, options, trace.deps, run + " untrusted"),
+        run + " untrusted");
+
+    ETTraceReorderOptions reorder_options;
+    reorder_options.renumber_ids = true;
+    ETTraceReorder::reorder(
+        trace.filename, reordered_filename, reorder_options);
+    const TraceDeps renumbered_deps = readTraceDeps(reordered_filename);
+    const string renumbered_run = string(trace.shape.name) + " renumbered";
+    check(
+        renumbered_deps.size() == trace.deps.size(),
+        renumbered_run + ": lost nodes");
+    feedTrace(
+        reordered_filename, ETFeederOptions(), renumbered_deps, renumbered_run);
+    remove(reordered_filename.c_str());
+  });
+}
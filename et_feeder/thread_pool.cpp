@@ -0,0 +1,136 @@
+#include "et_feeder/thread_pool.h"
+
+#include <exception>
+
+using namespace std;
+using namespace Chakra;
+
+// Worker index of the current thread within the pool it belongs to
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local size_t current_worker_id = 0;
+
+ThreadPool::ThreadPool(size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = max<size_t>(1, thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(make_unique<Worker>());
+  }
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(idle_mutex_);
+    stop_ = true;
+  }
+  idle_cv_.notify_all();
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+size_t ThreadPool::numThreads() const {
+  return workers_.size();
+}
+
+void ThreadPool::submit(function<void()> task) {
+  // Tasks spawned by a worker stay local to it until someone steals them
+  size_t worker_id = (current_pool == this)
+      ? current_worker_id
+      : next_worker_.fetch_add(1, memory_order_relaxed) % workers_.size();
+  {
+    lock_guard<mutex> lock(workers_[worker_id]->mutex);
+    workers_[worker_id]->tasks.emplace_back(move(task));
+  }
+  {
+    lock_guard<mutex> lock(idle_mutex_);
+    num_queued_.fetch_add(1, memory_order_relaxed);
+  }
+  idle_cv_.notify_one();
+}
+
+bool ThreadPool::popTask(size_t worker_id, function<void()>& task) {
+  {
+    Worker& own = *workers_[worker_id];
+    lock_guard<mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = move(own.tasks.back());
+      own.tasks.pop_back();
+      num_queued_.fetch_sub(1, memory_order_relaxed);
+      return true;
+    }
+  }
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    Worker& victim = *workers_[(worker_id + i) % workers_.size()];
+    lock_guard<mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = move(victim.tasks.front());
+      victim.tasks.pop_front();
+      num_queued_.fetch_sub(1, memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::workerLoop(size_t worker_id) {
+  current_pool = this;
+  current_worker_id = worker_id;
+  function<void()> task;
+  while (true) {
+    if (popTask(worker_id, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    unique_lock<mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this] {
+      return stop_ || num_queued_.load(memory_order_relaxed) != 0;
+    });
+    if (stop_ && num_queued_.load(memory_order_relaxed) == 0) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::parallelFor(size_t n, const function<void(size_t)>& task) {
+  struct State {
+    atomic<size_t> remaining;
+    mutex error_mutex;
+    exception_ptr error;
+  };
+  auto state = make_shared<State>();
+  state->remaining = n;
+
+  for (size_t i = 0; i < n; ++i) {
+    submit([state, &task, i] {
+      try {
+        task(i);
+      } catch (...) {
+        lock_guard<mutex> lock(state->error_mutex);
+        if (state->error == nullptr) {
+          state->error = current_exception();
+        }
+      }
+      state->remaining.fetch_sub(1, memory_order_release);
+    });
+  }
+
+  size_t helper_id = (current_pool == this) ? current_worker_id : 0;
+  function<void()> pending;
+  while (state->remaining.load(memory_order_acquire) != 0) {
+    if (popTask(helper_id, pending)) {
+      pending();
+      pending = nullptr;
+    } else {
+      this_thread::yield();
+    }
+  }
+
+  if (state->error != nullptr) {
+    rethrow_exception(state->error);
+  }
+}
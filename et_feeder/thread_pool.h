@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Chakra {
+
+// Work-stealing thread pool. Every worker owns a task deque; it pops its own
+// tasks from the back and steals from the front of the other deques when it
+// runs dry, so uneven tasks (e.g. traces of very different sizes) spread
+// over all workers without a central queue.
+class ThreadPool {
+ public:
+  // num_threads == 0 picks the number of hardware threads
+  explicit ThreadPool(size_t num_threads = 0);
+  ~ThreadPool();
+
+  size_t numThreads() const;
+  void submit(std::function<void()> task);
+  // Runs task(i) for every i in [0, n) and blocks until all of them are
+  // done. The calling thread helps executing tasks while it waits. The
+  // first exception thrown by a task is rethrown here.
+  void parallelFor(size_t n, const std::function<void(size_t)>& task);
+
+ private:
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  bool popTask(size_t worker_id, std::function<void()>& task);
+  void workerLoop(size_t worker_id);
+
+  std::vector<std::unique_ptr<Worker>> workers_{};
+  std::vector<std::thread> threads_{};
+  std::atomic<size_t> next_worker_{0};
+  std::atomic<size_t> num_queued_{0};
+  std::mutex idle_mutex_{};
+  std::condition_variable idle_cv_{};
+  bool stop_{false};
+};
+
+} // namespace Chakra
@@ -37,29 +37,86 @@
 
 #include "protoio.hh"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PROTOIO_HAVE_MMAP 1
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
 #define panic(format, args...)
 
+/// Consumed parts of a mapped file are handed back to the kernel in
+/// chunks of this size to keep the resident set small on huge traces
+static const size_t mappedReleaseChunk = 64 * 1024 * 1024;
+
+/// Deflate never refers back further than 32 KB
+static const size_t inflateWindowSize = 32768;
+
+/// Size of the compressed and uncompressed inflate buffers
+static const size_t inflateBufferSize = 256 * 1024;
+
+/// Uncompressed data per block of a block gzip file, chosen so that
+/// even incompressible data fits the 64 KB limit of a block
+static const size_t blockDataSize = 0xff00;
+
+/// Upper bound of the size of a compressed block, including header
+static const size_t blockMaxSize = 0x10000;
+
+/// Fixed part of a block header, followed by XLEN bytes of subfields
+static const size_t blockHeaderSize = 12;
+
+/// Blocks inflated ahead of the reader per worker thread
+static const size_t blocksPerWorker = 4;
+
+/// The empty block that terminates a block gzip file
+static const unsigned char blockEof[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+    0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+/// Identifies sidecar index files, followed by a format version
+static const char indexMagic[8] = {'C', 'H', 'K', 'R', 'I', 'D', 'X', '\0'};
+static const uint32_t indexVersion = 1;
+
 using namespace google::protobuf;
 
-ProtoOutputStream::ProtoOutputStream(const std::string& filename)
+ProtoOutputStream::ProtoOutputStream(
+    const std::string& filename,
+    bool blockGzip)
     : fileStream(
           filename.c_str(),
           std::ios::out | std::ios::binary | std::ios::trunc),
       wrappedFileStream(NULL),
       gzipStream(NULL),
+      blockStream(NULL),
       zeroCopyStream(NULL) {
   if (!fileStream.good())
     panic("Could not open %s for writing\n", filename);
 
   // Wrap the output file in a zero copy stream, that in turn is
   // wrapped in a gzip stream if the filename ends with .gz. The
-  // latter stream is in turn wrapped in a coded stream
-  wrappedFileStream = new io::OstreamOutputStream(&fileStream);
-  if (filename.find_last_of('.') != std::string::npos &&
-      filename.substr(filename.find_last_of('.') + 1) == "gz") {
+  // latter stream is in turn wrapped in a coded stream. Block gzip
+  // streams write to the file directly
+  bool useGzip = filename.find_last_of('.') != std::string::npos &&
+      filename.substr(filename.find_last_of('.') + 1) == "gz";
+  if (useGzip && blockGzip) {
+    blockStream = new BlockDeflateOutputStream(&fileStream);
+    zeroCopyStream = blockStream;
+  } else if (useGzip) {
+    wrappedFileStream = new io::OstreamOutputStream(&fileStream);
     gzipStream = new io::GzipOutputStream(wrappedFileStream);
     zeroCopyStream = gzipStream;
   } else {
+    wrappedFileStream = new io::OstreamOutputStream(&fileStream);
     zeroCopyStream = wrappedFileStream;
   }
 }
@@ -68,6 +125,8 @@ ProtoOutputStream::~ProtoOutputStream() {
   // As the compression is optional, see if the stream exists
   if (gzipStream != NULL)
     delete gzipStream;
+  if (blockStream != NULL)
+    delete blockStream;
   delete wrappedFileStream;
   fileStream.close();
 }
@@ -90,26 +149,126 @@ void ProtoOutputStream::write(const Message& msg) {
   msg.SerializeWithCachedSizes(&codedStream);
 }
 
-ProtoInputStream::ProtoInputStream(const std::string& filename)
+#ifdef CHAKRA_PROFILE
+/**
+ * A ProfiledInputStream forwards to a decompressing stream and
+ * accounts for the bytes it produces and the time it takes.
+ */
+class ProfiledInputStream : public io::ZeroCopyInputStream {
+ public:
+  ProfiledInputStream(
+      io::ZeroCopyInputStream* stream,
+      ProtoInputStream::Stats* stats)
+      : stream(stream), stats(stats) {}
+
+  bool Next(const void** data, int* size) override {
+    auto start = std::chrono::steady_clock::now();
+    bool success = stream->Next(data, size);
+    stats->inflateNanos +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count();
+    if (success)
+      stats->bytesInflated += *size;
+    return success;
+  }
+
+  void BackUp(int count) override {
+    stream->BackUp(count);
+    stats->bytesInflated -= count;
+  }
+
+  bool Skip(int count) override {
+    return stream->Skip(count);
+  }
+
+  int64_t ByteCount() const override {
+    return stream->ByteCount();
+  }
+
+ private:
+  io::ZeroCopyInputStream* stream;
+  ProtoInputStream::Stats* stats;
+};
+#endif
+
+ProtoInputStream::ProtoInputStream(
+    const std::string& filename,
+    unsigned numThreads)
     : fileStream(filename.c_str(), std::ios::in | std::ios::binary),
       fileName(filename),
       useGzip(false),
+      useBlockGzip(false),
+      numThreads(numThreads),
       wrappedFileStream(NULL),
       gzipStream(NULL),
-      zeroCopyStream(NULL) {
+      zeroCopyStream(NULL),
+      streamOffset(0),
+      mappedData(NULL),
+      mappedSize(0),
+      mappedOffset(0),
+      mappedReleased(0) {
   if (!fileStream.good())
     panic("Could not open %s for reading\n", filename);
 
-  // check the magic number to see if this is a gzip stream
-  unsigned char bytes[2];
-  fileStream.read((char*)bytes, 2);
-  useGzip = fileStream.good() && bytes[0] == 0x1f && bytes[1] == 0x8b;
+  // check the magic number to see if this is a gzip stream, and the
+  // extra header field to see if it is made of independent blocks
+  unsigned char bytes[blockHeaderSize + 4];
+  fileStream.read((char*)bytes, sizeof(bytes));
+  size_t numBytes = fileStream.gcount();
+  useGzip = numBytes >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b;
+  useBlockGzip = BlockInflateInputStream::isBlockGzip(bytes, numBytes);
 
   // seek to the start of the input file and clear any flags
   fileStream.clear();
   fileStream.seekg(0, std::ifstream::beg);
 
-  createStreams();
+  // uncompressed files are parsed straight out of a memory mapping,
+  // the streams are only needed if mapping is not possible
+  if (useGzip || !mapFile())
+    createStreams();
+}
+
+bool ProtoInputStream::mapFile() {
+#ifdef PROTOIO_HAVE_MMAP
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (addr == MAP_FAILED)
+    return false;
+
+  madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+  mappedData = static_cast<const uint8_t*>(addr);
+  mappedSize = st.st_size;
+  mappedOffset = 0;
+  mappedReleased = 0;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void ProtoInputStream::unmapFile() {
+#ifdef PROTOIO_HAVE_MMAP
+  if (mappedData != NULL) {
+    munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+    mappedData = NULL;
+    mappedSize = 0;
+    mappedOffset = 0;
+    mappedReleased = 0;
+  }
+#endif
 }
 
 void ProtoInputStream::createStreams() {
@@ -118,19 +277,31 @@ void ProtoInputStream::createStreams() {
       wrappedFileStream == NULL && gzipStream == NULL &&
       zeroCopyStream == NULL);
 
-  // Wrap the input file in a zero copy stream, that in turn is
-  // wrapped in a gzip stream if the filename ends with .gz. The
-  // latter stream is in turn wrapped in a coded stream
-  wrappedFileStream = new io::IstreamInputStream(&fileStream);
-  if (useGzip) {
-    gzipStream = new io::GzipInputStream(wrappedFileStream);
+  // Wrap the input file in a zero copy stream, or in a gzip stream
+  // reading the file directly if it is compressed. The latter
+  // stream is in turn wrapped in a coded stream
+  if (useBlockGzip) {
+    gzipStream = new BlockInflateInputStream(&fileStream, numThreads);
+    zeroCopyStream = gzipStream;
+  } else if (useGzip) {
+    gzipStream = new InflateInputStream(&fileStream);
     zeroCopyStream = gzipStream;
   } else {
+    wrappedFileStream = new io::IstreamInputStream(&fileStream);
     zeroCopyStream = wrappedFileStream;
   }
+
+#ifdef CHAKRA_PROFILE
+  if (gzipStream != NULL)
+    zeroCopyStream = new ProfiledInputStream(gzipStream, &readStats);
+#endif
 }
 
 void ProtoInputStream::destroyStreams() {
+  // The top-level stream may wrap the others for profiling
+  if (zeroCopyStream != gzipStream && zeroCopyStream != wrappedFileStream)
+    delete zeroCopyStream;
+
   // As the compression is optional, see if the stream exists
   if (gzipStream != NULL) {
     delete gzipStream;
@@ -144,22 +315,123 @@ void ProtoInputStream::destroyStreams() {
 
 ProtoInputStream::~ProtoInputStream() {
   destroyStreams();
+  unmapFile();
   fileStream.close();
 }
 
 void ProtoInputStream::reset() {
+  if (mappedData != NULL) {
+    mappedOffset = 0;
+    mappedReleased = 0;
+    return;
+  }
+
   destroyStreams();
   // seek to the start of the input file and clear any flags
   fileStream.clear();
   fileStream.seekg(0, std::ifstream::beg);
+  streamOffset = 0;
   createStreams();
 }
 
+uint64_t ProtoInputStream::tell() {
+  if (mappedData != NULL)
+    return mappedOffset;
+  // the coded streams back up whatever they read ahead when they are
+  // destroyed, so the byte count is exact between messages
+  return streamOffset + zeroCopyStream->ByteCount();
+}
+
+bool ProtoInputStream::seek(uint64_t offset) {
+  if (mappedData != NULL) {
+    if (offset > mappedSize)
+      return false;
+    mappedOffset = offset;
+    mappedReleased = std::min(
+        mappedReleased, offset - offset % mappedReleaseChunk);
+    return true;
+  }
+
+  if (!useGzip) {
+    destroyStreams();
+    fileStream.clear();
+    fileStream.seekg(offset, std::ifstream::beg);
+    streamOffset = offset;
+    createStreams();
+    return fileStream.good();
+  }
+
+  // restart at the closest checkpoint before the offset unless the
+  // stream can simply move forward from where it is
+  uint64_t current = tell();
+  const ProtoStreamIndex::Checkpoint* checkpoint =
+      index != nullptr ? index->floorCheckpoint(offset) : NULL;
+  if (offset < current ||
+      (checkpoint != NULL && checkpoint->offset > current)) {
+    gzipStream->restart(checkpoint);
+    current = checkpoint != NULL ? checkpoint->offset : 0;
+  }
+  while (current < offset) {
+    int step = (int)std::min<uint64_t>(offset - current, INT_MAX);
+    if (!gzipStream->Skip(step))
+      return false;
+    current += step;
+  }
+  return true;
+}
+
+bool ProtoInputStream::setIndex(
+    std::shared_ptr<const ProtoStreamIndex> index) {
+  fileStream.clear();
+  std::streampos pos = fileStream.tellg();
+  fileStream.seekg(0, std::ifstream::end);
+  uint64_t fileSize = fileStream.tellg();
+  fileStream.seekg(pos);
+
+  if (index == nullptr || index->fileSize != fileSize)
+    return false;
+  this->index = index;
+  return true;
+}
+
+void ProtoInputStream::recordCheckpoints(
+    ProtoStreamIndex* index,
+    uint64_t span) {
+  fileStream.clear();
+  std::streampos pos = fileStream.tellg();
+  fileStream.seekg(0, std::ifstream::end);
+  index->fileSize = fileStream.tellg();
+  fileStream.seekg(pos);
+
+  if (gzipStream != NULL)
+    gzipStream->recordCheckpoints(index, span);
+}
+
 bool ProtoInputStream::is_open() {
   return fileStream.is_open();
 }
 
+const ProtoInputStream::Stats& ProtoInputStream::stats() const {
+  return readStats;
+}
+
 bool ProtoInputStream::read(Message& msg) {
+#ifdef CHAKRA_PROFILE
+  auto start = std::chrono::steady_clock::now();
+  bool success = mappedData != NULL ? readMapped(msg) : readStream(msg);
+  readStats.readNanos +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+  if (success)
+    ++readStats.messagesRead;
+  return success;
+#else
+  return mappedData != NULL ? readMapped(msg) : readStream(msg);
+#endif
+}
+
+bool ProtoInputStream::readStream(Message& msg) {
   // Read a message from the stream by getting the size, using it as
   // a limit when parsing the message, then popping the limit again
   uint32_t size;
@@ -182,3 +454,691 @@ bool ProtoInputStream::read(Message& msg) {
 
   return false;
 }
+
+bool ProtoInputStream::readMapped(Message& msg) {
+  if (mappedOffset >= mappedSize)
+    return false;
+
+  // The coded stream reads straight from the mapped region, its buffer
+  // size is an int, so clamp it for files larger than 2 GB (a single
+  // message is always far below that limit)
+  size_t remaining = mappedSize - mappedOffset;
+  int bufferSize = remaining > INT_MAX ? INT_MAX : (int)remaining;
+  io::CodedInputStream codedStream(mappedData + mappedOffset, bufferSize);
+
+  uint32_t size;
+  if (!codedStream.ReadVarint32(&size))
+    return false;
+
+  io::CodedInputStream::Limit limit = codedStream.PushLimit(size);
+  if (!msg.ParseFromCodedStream(&codedStream)) {
+    panic("Unable to read message from mapped file %s\n", fileName);
+    return false;
+  }
+  codedStream.PopLimit(limit);
+  mappedOffset += codedStream.CurrentPosition();
+
+#ifdef PROTOIO_HAVE_MMAP
+  // Pages behind the read position are not needed again unless the
+  // stream is reset, in which case they are simply faulted back in
+  if (mappedOffset - mappedReleased >= 2 * mappedReleaseChunk) {
+    size_t release = mappedOffset - mappedReleased - mappedReleaseChunk;
+    release -= release % mappedReleaseChunk;
+    madvise(
+        const_cast<uint8_t*>(mappedData) + mappedReleased,
+        release,
+        MADV_DONTNEED);
+    mappedReleased += release;
+  }
+#endif
+
+  return true;
+}
+
+std::string ProtoStreamIndex::sidecarName(const std::string& filename) {
+  return filename + ".idx";
+}
+
+bool ProtoStreamIndex::load(const std::string& filename) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(indexMagic)];
+  uint32_t version;
+  uint64_t numEntries, numCheckpoints;
+  if (!file.read(magic, sizeof(magic)) ||
+      memcmp(magic, indexMagic, sizeof(indexMagic)) != 0 ||
+      !file.read((char*)&version, sizeof(version)) ||
+      version != indexVersion ||
+      !file.read((char*)&fileSize, sizeof(fileSize)) ||
+      !file.read((char*)&numEntries, sizeof(numEntries)))
+    return false;
+
+  entries.resize(numEntries);
+  if (numEntries != 0 &&
+      !file.read((char*)entries.data(), numEntries * sizeof(Entry)))
+    return false;
+
+  if (!file.read((char*)&numCheckpoints, sizeof(numCheckpoints)))
+    return false;
+  checkpoints.resize(numCheckpoints);
+  for (auto& checkpoint : checkpoints) {
+    uint32_t windowSize;
+    if (!file.read((char*)&checkpoint.offset, sizeof(checkpoint.offset)) ||
+        !file.read(
+            (char*)&checkpoint.compressedOffset,
+            sizeof(checkpoint.compressedOffset)) ||
+        !file.read((char*)&checkpoint.bits, sizeof(checkpoint.bits)) ||
+        !file.read((char*)&windowSize, sizeof(windowSize)) ||
+        windowSize > inflateWindowSize)
+      return false;
+    checkpoint.window.resize(windowSize);
+    if (windowSize != 0 && !file.read(&checkpoint.window[0], windowSize))
+      return false;
+  }
+  return true;
+}
+
+bool ProtoStreamIndex::save(const std::string& filename) const {
+  std::ofstream file(
+      filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  uint64_t numEntries = entries.size();
+  uint64_t numCheckpoints = checkpoints.size();
+  file.write(indexMagic, sizeof(indexMagic));
+  file.write((const char*)&indexVersion, sizeof(indexVersion));
+  file.write((const char*)&fileSize, sizeof(fileSize));
+  file.write((const char*)&numEntries, sizeof(numEntries));
+  file.write((const char*)entries.data(), numEntries * sizeof(Entry));
+  file.write((const char*)&numCheckpoints, sizeof(numCheckpoints));
+  for (const auto& checkpoint : checkpoints) {
+    uint32_t windowSize = checkpoint.window.size();
+    file.write((const char*)&checkpoint.offset, sizeof(checkpoint.offset));
+    file.write(
+        (const char*)&checkpoint.compressedOffset,
+        sizeof(checkpoint.compressedOffset));
+    file.write((const char*)&checkpoint.bits, sizeof(checkpoint.bits));
+    file.write((const char*)&windowSize, sizeof(windowSize));
+    file.write(checkpoint.window.data(), windowSize);
+  }
+  return file.good();
+}
+
+const ProtoStreamIndex::Entry* ProtoStreamIndex::floorEntry(
+    uint64_t key) const {
+  auto it = std::upper_bound(
+      entries.begin(), entries.end(), key, [](uint64_t k, const Entry& e) {
+        return k < e.key;
+      });
+  return it == entries.begin() ? NULL : &*(it - 1);
+}
+
+const ProtoStreamIndex::Checkpoint* ProtoStreamIndex::floorCheckpoint(
+    uint64_t offset) const {
+  auto it = std::upper_bound(
+      checkpoints.begin(),
+      checkpoints.end(),
+      offset,
+      [](uint64_t o, const Checkpoint& c) { return o < c.offset; });
+  return it == checkpoints.begin() ? NULL : &*(it - 1);
+}
+
+InflateInputStream::InflateInputStream(std::ifstream* file)
+    : file(file),
+      input(inflateBufferSize),
+      inputOffset(0),
+      output(inflateBufferSize),
+      outputOffset(0),
+      outputSize(0),
+      outputPos(0),
+      raw(false),
+      done(false),
+      corrupt(false),
+      recordIndex(NULL),
+      recordSpan(0) {
+  memset(&zstream, 0, sizeof(zstream));
+  // 16 + MAX_WBITS makes zlib expect a gzip header and trailer
+  if (inflateInit2(&zstream, 16 + MAX_WBITS) != Z_OK)
+    done = true;
+  inputOffset = file->tellg();
+}
+
+InflateInputStream::~InflateInputStream() {
+  inflateEnd(&zstream);
+}
+
+bool InflateInputStream::Next(const void** data, int* size) {
+  if (outputPos == outputSize) {
+    outputOffset += outputSize;
+    outputSize = 0;
+    outputPos = 0;
+    while (outputSize == 0) {
+      if (!inflateMore()) {
+        if (corrupt)
+          throw std::runtime_error(
+              "Failed to inflate gzip stream at uncompressed offset " +
+              std::to_string(outputOffset));
+        return false;
+      }
+    }
+  }
+  *data = output.data() + outputPos;
+  *size = outputSize - outputPos;
+  outputPos = outputSize;
+  return true;
+}
+
+void InflateInputStream::BackUp(int count) {
+  outputPos -= count;
+}
+
+bool InflateInputStream::Skip(int count) {
+  const void* data;
+  int size;
+  while (count > 0) {
+    if (!Next(&data, &size))
+      return false;
+    if (size > count) {
+      BackUp(size - count);
+      size = count;
+    }
+    count -= size;
+  }
+  return true;
+}
+
+int64_t InflateInputStream::ByteCount() const {
+  return outputOffset + outputPos;
+}
+
+void InflateInputStream::recordCheckpoints(
+    ProtoStreamIndex* index,
+    uint64_t span) {
+  recordIndex = index;
+  recordSpan = span;
+}
+
+void InflateInputStream::restart(
+    const ProtoStreamIndex::Checkpoint* checkpoint) {
+  file->clear();
+  zstream.avail_in = 0;
+  zstream.next_in = NULL;
+  outputSize = 0;
+  outputPos = 0;
+  done = false;
+  corrupt = false;
+  history.clear();
+
+  if (checkpoint == NULL) {
+    file->seekg(0, std::ifstream::beg);
+    inputOffset = 0;
+    outputOffset = 0;
+    raw = false;
+    if (inflateReset2(&zstream, 16 + MAX_WBITS) != Z_OK)
+      done = true;
+    return;
+  }
+
+  // a checkpoint may sit in the middle of a byte, whose remaining
+  // bits are fed to inflate before the following bytes
+  raw = true;
+  outputOffset = checkpoint->offset;
+  inputOffset = checkpoint->compressedOffset - (checkpoint->bits ? 1 : 0);
+  file->seekg(inputOffset, std::ifstream::beg);
+  if (inflateReset2(&zstream, -MAX_WBITS) != Z_OK) {
+    done = true;
+    return;
+  }
+  if (checkpoint->bits) {
+    int byte = file->get();
+    if (byte == EOF) {
+      done = true;
+      return;
+    }
+    ++inputOffset;
+    inflatePrime(&zstream, checkpoint->bits, byte >> (8 - checkpoint->bits));
+  }
+  inflateSetDictionary(
+      &zstream,
+      (const Bytef*)checkpoint->window.data(),
+      checkpoint->window.size());
+}
+
+bool InflateInputStream::fillInput() {
+  if (zstream.avail_in != 0)
+    return true;
+  inputOffset += zstream.next_in != NULL ? zstream.next_in - input.data() : 0;
+  file->read((char*)input.data(), input.size());
+  zstream.next_in = input.data();
+  zstream.avail_in = file->gcount();
+  return zstream.avail_in != 0;
+}
+
+bool InflateInputStream::inflateMore() {
+  if (done || !fillInput()) {
+    done = true;
+    return false;
+  }
+
+  zstream.next_out = output.data() + outputSize;
+  zstream.avail_out = output.size() - outputSize;
+  // stopping at every deflate block boundary is only needed to find
+  // places to put checkpoints at
+  int ret = inflate(&zstream, recordIndex != NULL ? Z_BLOCK : Z_NO_FLUSH);
+  int produced = output.size() - outputSize - zstream.avail_out;
+
+  if (recordIndex != NULL) {
+    history.append((const char*)output.data() + outputSize, produced);
+    if (history.size() > 2 * inflateWindowSize)
+      history.erase(0, history.size() - inflateWindowSize);
+  }
+  outputSize += produced;
+
+  if (ret == Z_STREAM_END) {
+    // a raw stream restarted from a checkpoint leaves the gzip trailer
+    // of its member to be skipped by hand
+    if (raw) {
+      for (int trailer = 8; trailer > 0; --trailer) {
+        if (!fillInput())
+          break;
+        ++zstream.next_in;
+        --zstream.avail_in;
+      }
+      raw = false;
+    }
+    // another gzip member may follow the one that just ended
+    if (!fillInput() || inflateReset2(&zstream, 16 + MAX_WBITS) != Z_OK)
+      done = true;
+    return true;
+  }
+  if (ret != Z_OK && ret != Z_BUF_ERROR) {
+    // the output so far is handed out before Next() throws
+    corrupt = true;
+    done = true;
+    return outputSize != 0;
+  }
+
+  uint64_t total = outputOffset + outputSize;
+  bool blockBoundary =
+      (zstream.data_type & 128) != 0 && (zstream.data_type & 64) == 0;
+  if (recordIndex != NULL && blockBoundary) {
+    uint64_t last = recordIndex->checkpoints.empty()
+        ? 0
+        : recordIndex->checkpoints.back().offset;
+    if (total - last >= recordSpan) {
+      ProtoStreamIndex::Checkpoint checkpoint;
+      checkpoint.offset = total;
+      checkpoint.compressedOffset =
+          inputOffset + (zstream.next_in - input.data());
+      checkpoint.bits = zstream.data_type & 7;
+      size_t window = std::min(history.size(), inflateWindowSize);
+      checkpoint.window = history.substr(history.size() - window);
+      recordIndex->checkpoints.push_back(checkpoint);
+    }
+  }
+  return true;
+}
+
+BlockDeflateOutputStream::BlockDeflateOutputStream(
+    std::ofstream* file,
+    int level)
+    : file(file),
+      input(blockDataSize),
+      inputSize(0),
+      output(blockMaxSize),
+      byteCount(0) {
+  memset(&zstream, 0, sizeof(zstream));
+  // every block is a raw deflate stream wrapped in a gzip member
+  // whose header and trailer are written by hand
+  if (deflateInit2(
+          &zstream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK)
+    throw std::runtime_error("Failed to initialize deflate");
+}
+
+BlockDeflateOutputStream::~BlockDeflateOutputStream() {
+  // a destructor cannot throw, so a last block that fails to deflate is
+  // left out along with the end marker, and readers see a truncated file
+  try {
+    if (inputSize != 0)
+      writeBlock();
+    file->write((const char*)blockEof, sizeof(blockEof));
+  } catch (const std::exception&) {
+  }
+  deflateEnd(&zstream);
+}
+
+bool BlockDeflateOutputStream::Next(void** data, int* size) {
+  if (inputSize == (int)input.size())
+    writeBlock();
+  *data = input.data() + inputSize;
+  *size = input.size() - inputSize;
+  inputSize = input.size();
+  return true;
+}
+
+void BlockDeflateOutputStream::BackUp(int count) {
+  inputSize -= count;
+}
+
+int64_t BlockDeflateOutputStream::ByteCount() const {
+  return byteCount + inputSize;
+}
+
+void BlockDeflateOutputStream::writeBlock() {
+  static const size_t headerSize = 18;
+  static const size_t trailerSize = 8;
+
+  deflateReset(&zstream);
+  zstream.next_in = input.data();
+  zstream.avail_in = inputSize;
+  zstream.next_out = output.data() + headerSize;
+  zstream.avail_out = output.size() - headerSize - trailerSize;
+  if (deflate(&zstream, Z_FINISH) != Z_STREAM_END)
+    throw std::runtime_error("Failed to deflate gzip block");
+  size_t blockSize = headerSize + zstream.total_out + trailerSize;
+
+  // gzip header with a single BC subfield holding the block size - 1
+  Bytef* header = output.data();
+  memcpy(header, blockEof, headerSize);
+  header[16] = (blockSize - 1) & 0xff;
+  header[17] = (blockSize - 1) >> 8;
+
+  uint32_t crc = crc32(0, input.data(), inputSize);
+  Bytef* trailer = output.data() + headerSize + zstream.total_out;
+  for (int i = 0; i < 4; ++i) {
+    trailer[i] = (crc >> (8 * i)) & 0xff;
+    trailer[4 + i] = ((uint32_t)inputSize >> (8 * i)) & 0xff;
+  }
+
+  file->write((const char*)output.data(), blockSize);
+  byteCount += inputSize;
+  inputSize = 0;
+}
+
+bool BlockInflateInputStream::isBlockGzip(
+    const unsigned char* header,
+    size_t size) {
+  // magic, deflate, FEXTRA flag, and a first subfield BC of length 2
+  return size >= blockHeaderSize + 4 && header[0] == 0x1f &&
+      header[1] == 0x8b && header[2] == 8 && (header[3] & 4) != 0 &&
+      (header[10] | header[11] << 8) >= 6 && header[12] == 'B' &&
+      header[13] == 'C' && header[14] == 2 && header[15] == 0;
+}
+
+BlockInflateInputStream::BlockInflateInputStream(
+    std::ifstream* file,
+    unsigned numThreads)
+    : file(file),
+      fileOffset(0),
+      readOffset(0),
+      eof(false),
+      nextRead(0),
+      nextConsume(0),
+      consuming(false),
+      outputOffset(0),
+      outputPos(0),
+      stopping(false),
+      corrupt(false),
+      recordIndex(NULL),
+      recordSpan(0) {
+  memset(&zstream, 0, sizeof(zstream));
+  if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK)
+    eof = true;
+  fileOffset = file->tellg();
+
+  if (numThreads == 0)
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  // a single thread has nothing to overlap with, so blocks are
+  // inflated one at a time as they are consumed
+  blocks.resize(numThreads > 1 ? numThreads * blocksPerWorker : 1);
+  if (numThreads > 1) {
+    for (unsigned i = 0; i < numThreads; ++i)
+      workers.emplace_back(&BlockInflateInputStream::work, this);
+  }
+}
+
+BlockInflateInputStream::~BlockInflateInputStream() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  pendingCond.notify_all();
+  for (auto& worker : workers)
+    worker.join();
+  inflateEnd(&zstream);
+}
+
+bool BlockInflateInputStream::Next(const void** data, int* size) {
+  while (true) {
+    if (consuming) {
+      Block& block = blocks[nextConsume % blocks.size()];
+      if (outputPos < (int)block.data.size()) {
+        *data = block.data.data() + outputPos;
+        *size = block.data.size() - outputPos;
+        outputPos = block.data.size();
+        return true;
+      }
+      // the slot is free for the next block once it is consumed
+      outputOffset += block.data.size();
+      outputPos = 0;
+      consuming = false;
+      ++nextConsume;
+    }
+
+    submitBlocks();
+    if (nextConsume == nextRead) {
+      // all blocks before a corrupt one are handed out first
+      if (corrupt)
+        throw std::runtime_error(
+            "Corrupt gzip block at file offset " + std::to_string(fileOffset));
+      return false;
+    }
+
+    Block& block = blocks[nextConsume % blocks.size()];
+    if (workers.empty()) {
+      block.failed = !inflateBlock(&zstream, block);
+    } else {
+      std::unique_lock<std::mutex> lock(mutex);
+      readyCond.wait(lock, [&block] { return block.ready; });
+    }
+    if (block.failed) {
+      drain();
+      eof = true;
+      corrupt = true;
+      nextRead = nextConsume;
+      throw std::runtime_error(
+          "Failed to inflate gzip block at uncompressed offset " +
+          std::to_string(outputOffset));
+    }
+    consuming = true;
+  }
+}
+
+void BlockInflateInputStream::BackUp(int count) {
+  outputPos -= count;
+}
+
+bool BlockInflateInputStream::Skip(int count) {
+  const void* data;
+  int size;
+  while (count > 0) {
+    if (!Next(&data, &size))
+      return false;
+    if (size > count) {
+      BackUp(size - count);
+      size = count;
+    }
+    count -= size;
+  }
+  return true;
+}
+
+int64_t BlockInflateInputStream::ByteCount() const {
+  return outputOffset + outputPos;
+}
+
+void BlockInflateInputStream::recordCheckpoints(
+    ProtoStreamIndex* index,
+    uint64_t span) {
+  recordIndex = index;
+  recordSpan = span;
+}
+
+void BlockInflateInputStream::restart(
+    const ProtoStreamIndex::Checkpoint* checkpoint) {
+  drain();
+  nextRead = 0;
+  nextConsume = 0;
+  consuming = false;
+  outputPos = 0;
+  eof = false;
+  corrupt = false;
+
+  // every block boundary is a checkpoint, no window is needed
+  file->clear();
+  fileOffset = checkpoint != NULL ? checkpoint->compressedOffset : 0;
+  readOffset = checkpoint != NULL ? checkpoint->offset : 0;
+  outputOffset = readOffset;
+  file->seekg(fileOffset, std::ifstream::beg);
+}
+
+bool BlockInflateInputStream::readBlock(Block& block) {
+  block.compressed.resize(blockMaxSize);
+  Bytef* header = block.compressed.data();
+  file->read((char*)header, blockHeaderSize);
+  if (file->gcount() == 0)
+    return false;
+  // the header sizes come from the file, so they are checked against
+  // the block buffer before anything is read into it
+  size_t extraSize = header[10] | header[11] << 8;
+  size_t headerSize = blockHeaderSize + extraSize;
+  if (file->gcount() != (std::streamsize)blockHeaderSize ||
+      header[0] != 0x1f || header[1] != 0x8b || (header[3] & 4) == 0 ||
+      headerSize + 8 > blockMaxSize ||
+      !file->read((char*)header + blockHeaderSize, extraSize)) {
+    corrupt = true;
+    return false;
+  }
+
+  // the block size is in the BC subfield, wherever it is
+  size_t blockSize = 0;
+  bool foundSize = false;
+  for (size_t pos = blockHeaderSize; pos + 4 <= headerSize;) {
+    size_t fieldSize = header[pos + 2] | header[pos + 3] << 8;
+    if (pos + 4 + fieldSize > headerSize)
+      break;
+    if (header[pos] == 'B' && header[pos + 1] == 'C' && fieldSize == 2) {
+      blockSize = (header[pos + 4] | header[pos + 5] << 8) + 1;
+      foundSize = true;
+    }
+    pos += 4 + fieldSize;
+  }
+  if (!foundSize || blockSize < headerSize + 8 || blockSize > blockMaxSize ||
+      !file->read(
+          (char*)header + headerSize, blockSize - headerSize)) {
+    corrupt = true;
+    return false;
+  }
+
+  // a block never holds more than 64 KB of data
+  const Bytef* trailer = header + blockSize - 4;
+  uint32_t dataSize = trailer[0] | trailer[1] << 8 | trailer[2] << 16 |
+      (uint32_t)trailer[3] << 24;
+  if (dataSize > blockMaxSize) {
+    corrupt = true;
+    return false;
+  }
+  block.compressed.resize(blockSize);
+  block.headerSize = headerSize;
+  block.data.resize(dataSize);
+  block.ready = false;
+  block.failed = false;
+
+  if (recordIndex != NULL) {
+    uint64_t last = recordIndex->checkpoints.empty()
+        ? 0
+        : recordIndex->checkpoints.back().offset;
+    if (readOffset - last >= recordSpan) {
+      ProtoStreamIndex::Checkpoint checkpoint;
+      checkpoint.offset = readOffset;
+      checkpoint.compressedOffset = fileOffset;
+      checkpoint.bits = 0;
+      recordIndex->checkpoints.push_back(checkpoint);
+    }
+  }
+  fileOffset += blockSize;
+  readOffset += dataSize;
+  return true;
+}
+
+bool BlockInflateInputStream::inflateBlock(z_stream* zstream, Block& block) {
+  if (block.data.empty())
+    return true;
+  inflateReset(zstream);
+  zstream->next_in = block.compressed.data() + block.headerSize;
+  zstream->avail_in = block.compressed.size() - block.headerSize - 8;
+  zstream->next_out = block.data.data();
+  zstream->avail_out = block.data.size();
+  if (inflate(zstream, Z_FINISH) != Z_STREAM_END || zstream->avail_out != 0)
+    return false;
+
+  const Bytef* trailer = block.compressed.data() + block.compressed.size() - 8;
+  uint32_t crc = trailer[0] | trailer[1] << 8 | trailer[2] << 16 |
+      (uint32_t)trailer[3] << 24;
+  return crc == crc32(0, block.data.data(), block.data.size());
+}
+
+void BlockInflateInputStream::submitBlocks() {
+  // reading is sequential and cheap compared to inflating, so it is
+  // done on the reading thread
+  uint64_t first = nextRead;
+  while (!eof && nextRead - nextConsume < blocks.size()) {
+    if (!readBlock(blocks[nextRead % blocks.size()])) {
+      eof = true;
+      break;
+    }
+    ++nextRead;
+  }
+  if (workers.empty() || first == nextRead)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint64_t seq = first; seq < nextRead; ++seq)
+      pending.push_back(seq);
+  }
+  pendingCond.notify_all();
+}
+
+void BlockInflateInputStream::work() {
+  z_stream workerStream;
+  memset(&workerStream, 0, sizeof(workerStream));
+  bool ok = inflateInit2(&workerStream, -MAX_WBITS) == Z_OK;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    pendingCond.wait(lock, [this] { return stopping || !pending.empty(); });
+    if (stopping)
+      break;
+    Block& block = blocks[pending.front() % blocks.size()];
+    pending.pop_front();
+
+    lock.unlock();
+    bool failed = !ok || !inflateBlock(&workerStream, block);
+    lock.lock();
+
+    block.failed = failed;
+    block.ready = true;
+    readyCond.notify_all();
+  }
+  lock.unlock();
+  inflateEnd(&workerStream);
+}
+
+void BlockInflateInputStream::drain() {
+  if (workers.empty())
+    return;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (uint64_t seq = nextConsume; seq < nextRead; ++seq) {
+    Block& block = blocks[seq % blocks.size()];
+    readyCond.wait(lock, [&block] { return block.ready; });
+  }
+}
@@ -48,7 +48,16 @@
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/message.h>
 
+#include <zlib.h>
+
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 /**
  * A ProtoStream provides the shared functionality of the input and
@@ -74,6 +83,62 @@ class ProtoStream {
   /** @} */
 };
 
+/**
+ * A BlockDeflateOutputStream writes a block gzip file in the BGZF
+ * layout: a series of gzip members that each hold at most 64 KB of
+ * independently deflated data and announce their compressed size in
+ * an extra header field. Any gzip reader can decompress such a file
+ * as a multi-member stream, while readers that know the layout can
+ * decompress the blocks in parallel.
+ */
+class BlockDeflateOutputStream
+    : public google::protobuf::io::ZeroCopyOutputStream {
+ public:
+  /**
+   * Create a stream compressing into a file.
+   *
+   * @param file File stream to write the blocks to
+   * @param level zlib compression level
+   */
+  BlockDeflateOutputStream(
+      std::ofstream* file,
+      int level = Z_DEFAULT_COMPRESSION);
+
+  /**
+   * Compress any buffered data and terminate the file with an empty
+   * end-of-file block.
+   */
+  ~BlockDeflateOutputStream();
+
+  bool Next(void** data, int* size) override;
+  void BackUp(int count) override;
+  int64_t ByteCount() const override;
+
+ private:
+  /**
+   * Compress the buffered data into a block and write it out.
+   */
+  void writeBlock();
+
+  /// Compressed file the stream writes to
+  std::ofstream* file;
+
+  /// zlib deflate state
+  z_stream zstream;
+
+  /// Uncompressed data of the block being filled
+  std::vector<Bytef> input;
+
+  /// Number of valid bytes in the input buffer
+  int inputSize;
+
+  /// Buffer a block is compressed into
+  std::vector<Bytef> output;
+
+  /// Uncompressed bytes written in completed blocks
+  int64_t byteCount;
+};
+
 /**
  * A ProtoOutputStream wraps a coded stream, potentially with
  * compression, based on looking at the file name. Writing to the
@@ -86,11 +151,14 @@ class ProtoOutputStream : public ProtoStream {
  public:
   /**
    * Create an output stream for a given file name. If the filename
-   * ends with .gz then the file will be compressed accordinly.
+   * ends with .gz then the file will be compressed accordinly, by
+   * default in independently compressed blocks that can be
+   * decompressed in parallel.
    *
    * @param filename Path to the file to create or truncate
+   * @param blockGzip Compress in blocks rather than as a single stream
    */
-  ProtoOutputStream(const std::string& filename);
+  ProtoOutputStream(const std::string& filename, bool blockGzip = true);
 
   /**
    * Destruct the output stream, and also flush and close the
@@ -116,26 +184,379 @@ class ProtoOutputStream : public ProtoStream {
   /// Optional Gzip stream to wrap the Zero Copy stream
   google::protobuf::io::GzipOutputStream* gzipStream;
 
+  /// Optional block Gzip stream used instead of the Zero Copy stream
+  BlockDeflateOutputStream* blockStream;
+
   /// Top-level zero-copy stream, either with compression or not
   google::protobuf::io::ZeroCopyOutputStream* zeroCopyStream;
 };
 
+/**
+ * A ProtoStreamIndex is a sparse, seekable index of a message stream,
+ * typically kept in a sidecar file next to the trace. It maps a
+ * caller-defined key (e.g. a node id) of every N-th message to the
+ * uncompressed byte offset of that message, and for gzip files it
+ * holds inflate checkpoints that allow decompression to restart in
+ * the middle of the file.
+ */
+class ProtoStreamIndex {
+ public:
+  /// A message key and the uncompressed offset the message starts at
+  struct Entry {
+    uint64_t key;
+    uint64_t offset;
+  };
+
+  /**
+   * Everything needed to restart inflating at a deflate block
+   * boundary: the uncompressed and compressed offsets, the number of
+   * bits of the compressed byte already consumed, and the (up to) 32
+   * KB of output preceding the boundary.
+   */
+  struct Checkpoint {
+    uint64_t offset;
+    uint64_t compressedOffset;
+    uint32_t bits;
+    std::string window;
+  };
+
+  /// Size of the indexed file, used to detect stale indexes
+  uint64_t fileSize = 0;
+
+  /// Sparse message entries in stream order
+  std::vector<Entry> entries;
+
+  /// Inflate checkpoints in stream order, empty for plain files
+  std::vector<Checkpoint> checkpoints;
+
+  /**
+   * Name of the sidecar index file of a trace.
+   *
+   * @param filename Path to the trace
+   */
+  static std::string sidecarName(const std::string& filename);
+
+  /**
+   * Load an index from a file.
+   *
+   * @param filename Path to the index file
+   * @param return True if the index was read successfully
+   */
+  bool load(const std::string& filename);
+
+  /**
+   * Write the index to a file.
+   *
+   * @param filename Path to the index file
+   * @param return True if the index was written successfully
+   */
+  bool save(const std::string& filename) const;
+
+  /**
+   * Find the last entry whose key is not larger than the given key,
+   * assuming keys grow along the stream.
+   *
+   * @param key Key to look up
+   * @param return The entry, or NULL if there is none
+   */
+  const Entry* floorEntry(uint64_t key) const;
+
+  /**
+   * Find the last checkpoint at or before an uncompressed offset.
+   *
+   * @param offset Uncompressed offset to look up
+   * @param return The checkpoint, or NULL if there is none
+   */
+  const Checkpoint* floorCheckpoint(uint64_t offset) const;
+};
+
+/**
+ * A RestartableInputStream is a decompressing stream that can record
+ * checkpoints into a ProtoStreamIndex while reading, and restart
+ * decompression from one of them.
+ */
+class RestartableInputStream
+    : public google::protobuf::io::ZeroCopyInputStream {
+ public:
+  /**
+   * Record a checkpoint into an index every time at least span
+   * bytes of output were produced since the previous one.
+   *
+   * @param index Index receiving the checkpoints
+   * @param span Minimum distance between checkpoints in bytes
+   */
+  virtual void recordCheckpoints(ProtoStreamIndex* index, uint64_t span) = 0;
+
+  /**
+   * Restart decompression at a checkpoint, or at the start of the
+   * file if no checkpoint is given.
+   *
+   * @param checkpoint Checkpoint to restart from, may be NULL
+   */
+  virtual void restart(const ProtoStreamIndex::Checkpoint* checkpoint) = 0;
+};
+
+/**
+ * An InflateInputStream decompresses a gzip file, including files
+ * made of several concatenated gzip members, straight from an STL
+ * input stream. Unlike the protobuf GzipInputStream it keeps track
+ * of compressed offsets, can record inflate checkpoints while
+ * reading, and can restart decompression from a checkpoint.
+ */
+class InflateInputStream : public RestartableInputStream {
+ public:
+  /**
+   * Create a stream inflating from the current position of a file.
+   *
+   * @param file File stream positioned at the start of a gzip member
+   */
+  InflateInputStream(std::ifstream* file);
+
+  ~InflateInputStream();
+
+  bool Next(const void** data, int* size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64_t ByteCount() const override;
+  void recordCheckpoints(ProtoStreamIndex* index, uint64_t span) override;
+  void restart(const ProtoStreamIndex::Checkpoint* checkpoint) override;
+
+ private:
+  /**
+   * Run inflate once, reading more input if needed.
+   *
+   * @param return False once the end of the stream is reached
+   */
+  bool inflateMore();
+
+  /**
+   * Make sure there is input available to inflate.
+   *
+   * @param return False if the end of the file is reached
+   */
+  bool fillInput();
+
+  /// Compressed file the stream reads from
+  std::ifstream* file;
+
+  /// zlib inflate state
+  z_stream zstream;
+
+  /// Buffer of compressed bytes
+  std::vector<Bytef> input;
+
+  /// Compressed offset of the start of the input buffer
+  uint64_t inputOffset;
+
+  /// Buffer of uncompressed bytes handed out by Next()
+  std::vector<Bytef> output;
+
+  /// Uncompressed offset of the start of the output buffer
+  uint64_t outputOffset;
+
+  /// Number of valid bytes in the output buffer
+  int outputSize;
+
+  /// Number of bytes of the output buffer handed out so far
+  int outputPos;
+
+  /// Whether the current member is inflated without its gzip header
+  bool raw;
+
+  /// Whether the end of the last member was reached
+  bool done;
+
+  /// Whether inflating stopped at corrupt data
+  bool corrupt;
+
+  /// Index to record checkpoints into, NULL if not recording
+  ProtoStreamIndex* recordIndex;
+
+  /// Minimum distance between recorded checkpoints
+  uint64_t recordSpan;
+
+  /// Last 32 KB of output, kept while recording checkpoints
+  std::string history;
+};
+
+/**
+ * A BlockInflateInputStream decompresses a block gzip file as written
+ * by BlockDeflateOutputStream. Blocks are read from the file in order
+ * and inflated by a pool of worker threads a number of blocks ahead
+ * of the reader. Checkpoints are simply block boundaries.
+ */
+class BlockInflateInputStream : public RestartableInputStream {
+ public:
+  /**
+   * Check whether a file starts with a block gzip header.
+   *
+   * @param header First bytes of the file
+   * @param size Number of bytes available
+   * @param return True if the file uses the block layout
+   */
+  static bool isBlockGzip(const unsigned char* header, size_t size);
+
+  /**
+   * Create a stream inflating from the current position of a file.
+   *
+   * @param file File stream positioned at the start of a block
+   * @param numThreads Number of inflating threads, 0 uses one per
+   *                   core and 1 inflates on the reading thread
+   */
+  BlockInflateInputStream(std::ifstream* file, unsigned numThreads);
+
+  ~BlockInflateInputStream();
+
+  bool Next(const void** data, int* size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64_t ByteCount() const override;
+  void recordCheckpoints(ProtoStreamIndex* index, uint64_t span) override;
+  void restart(const ProtoStreamIndex::Checkpoint* checkpoint) override;
+
+ private:
+  /// A block moving from the file through a worker to the reader
+  struct Block {
+    std::vector<Bytef> compressed;
+    std::vector<Bytef> data;
+    uint32_t headerSize;
+    bool ready;
+    bool failed;
+  };
+
+  /**
+   * Read the next compressed block from the file.
+   *
+   * @param block Block to read into
+   * @param return False at the end of the file or on a corrupt block,
+   *     which sets corrupt for Next() to throw once it gets there
+   */
+  bool readBlock(Block& block);
+
+  /**
+   * Inflate a block and verify its checksum.
+   *
+   * @param zstream Raw inflate state to use
+   * @param block Block to inflate
+   * @param return True if the block was inflated successfully
+   */
+  static bool inflateBlock(z_stream* zstream, Block& block);
+
+  /**
+   * Read blocks from the file until all slots are in use, and queue
+   * them for the workers.
+   */
+  void submitBlocks();
+
+  /**
+   * Main loop of the worker threads.
+   */
+  void work();
+
+  /**
+   * Wait for the workers to finish all submitted blocks.
+   */
+  void drain();
+
+  /// Compressed file the stream reads from
+  std::ifstream* file;
+
+  /// Compressed offset of the next block to read
+  uint64_t fileOffset;
+
+  /// Uncompressed offset of the next block to read
+  uint64_t readOffset;
+
+  /// Whether the last block was read from the file
+  bool eof;
+
+  /// Ring of blocks being read, inflated and consumed
+  std::vector<Block> blocks;
+
+  /// Sequence number of the next block to read from the file
+  uint64_t nextRead;
+
+  /// Sequence number of the block handed out by Next()
+  uint64_t nextConsume;
+
+  /// Whether the block nextConsume is currently handed out
+  bool consuming;
+
+  /// Uncompressed offset of the block handed out by Next()
+  uint64_t outputOffset;
+
+  /// Number of bytes of the current block handed out so far
+  int outputPos;
+
+  /// Raw inflate state used when inflating on the reading thread
+  z_stream zstream;
+
+  /// Threads inflating blocks, empty when inflating on the reader
+  std::vector<std::thread> workers;
+
+  /// Protects the ready flags of the blocks and the pending queue
+  std::mutex mutex;
+
+  /// Signals the workers that blocks are pending or to stop
+  std::condition_variable pendingCond;
+
+  /// Signals the reader that a block is ready
+  std::condition_variable readyCond;
+
+  /// Sequence numbers of blocks waiting for a worker
+  std::deque<uint64_t> pending;
+
+  /// Tells the workers to exit
+  bool stopping;
+
+  /// Whether reading stopped at a corrupt block
+  bool corrupt;
+
+  /// Index to record checkpoints into, NULL if not recording
+  ProtoStreamIndex* recordIndex;
+
+  /// Minimum distance between recorded checkpoints
+  uint64_t recordSpan;
+};
+
 /**
  * A ProtoInputStream wraps a coded stream, potentially with
  * decompression, based on looking at the file name. Reading from the
  * stream is done on a per-message basis to avoid having to deal with
  * huge data structures. The latter assumes the length of each message
  * is encoded in the stream when it is written.
+ *
+ * Uncompressed files are memory-mapped when the platform allows it,
+ * and messages are parsed directly out of the mapped region instead
+ * of going through the STL input stream.
  */
 class ProtoInputStream : public ProtoStream {
  public:
+  /**
+   * Counters of an input stream. They are only maintained when built
+   * with CHAKRA_PROFILE defined, and stay zero otherwise.
+   */
+  struct Stats {
+    /// Number of messages read
+    uint64_t messagesRead = 0;
+    /// Time spent in read(), decompression included
+    uint64_t readNanos = 0;
+    /// Uncompressed bytes taken from the gzip stream
+    uint64_t bytesInflated = 0;
+    /// Time spent waiting for the gzip stream to produce them
+    uint64_t inflateNanos = 0;
+  };
+
   /**
    * Create an input stream for a given file name. If the filename
    * ends with .gz then the file will be decompressed accordingly.
    *
    * @param filename Path to the file to read from
+   * @param numThreads Number of threads decompressing block gzip
+   *                   files, 1 decompresses on the reading thread and
+   *                   0 uses one per core
    */
-  ProtoInputStream(const std::string& filename);
+  ProtoInputStream(const std::string& filename, unsigned numThreads = 1);
 
   /**
    * Destruct the input stream, and also close the underlying file
@@ -158,6 +579,48 @@ class ProtoInputStream : public ProtoStream {
    */
   void reset();
 
+  /**
+   * Get the uncompressed offset of the next message in the stream.
+   *
+   * @param return Offset of the next message
+   */
+  uint64_t tell();
+
+  /**
+   * Seek to a message boundary given by its uncompressed offset. For
+   * gzip files this restarts inflating at the closest checkpoint of
+   * the index, if one is set, and otherwise from the start.
+   *
+   * @param offset Uncompressed offset of the message to read next
+   * @param return True if the stream is positioned at the offset
+   */
+  bool seek(uint64_t offset);
+
+  /**
+   * Use an index for seeking. An index of a different file size is
+   * rejected.
+   *
+   * @param index Index of this stream
+   * @param return True if the index matches the file
+   */
+  bool setIndex(std::shared_ptr<const ProtoStreamIndex> index);
+
+  /**
+   * Record inflate checkpoints while reading a gzip file from its
+   * start. Has no effect on plain files, which need no checkpoints.
+   *
+   * @param index Index receiving the checkpoints and the file size
+   * @param span Minimum distance between checkpoints in bytes
+   */
+  void recordCheckpoints(ProtoStreamIndex* index, uint64_t span);
+
+  /**
+   * Get the counters of the stream.
+   *
+   * @param return Counters since the stream was opened
+   */
+  const Stats& stats() const;
+
  private:
   /**
    * Create the internal streams that are wrapping the input file.
@@ -169,6 +632,34 @@ class ProtoInputStream : public ProtoStream {
    */
   void destroyStreams();
 
+  /**
+   * Map the whole input file into memory for sequential reading.
+   *
+   * @return True if the file is mapped, false to fall back to streams
+   */
+  bool mapFile();
+
+  /**
+   * Unmap the input file if it is mapped.
+   */
+  void unmapFile();
+
+  /**
+   * Read a message from the zero-copy stream.
+   *
+   * @param msg Message read from the stream
+   * @param return True if a message was read, false if reading fails
+   */
+  bool readStream(google::protobuf::Message& msg);
+
+  /**
+   * Read a message from the memory-mapped file.
+   *
+   * @param msg Message read from the mapped region
+   * @param return True if a message was read, false if reading fails
+   */
+  bool readMapped(google::protobuf::Message& msg);
+
   /// Underlying file input stream
   std::ifstream fileStream;
 
@@ -178,14 +669,41 @@ class ProtoInputStream : public ProtoStream {
   /// Boolean flag to remember whether we use gzip or not
   bool useGzip;
 
+  /// Whether the gzip file uses the block layout
+  bool useBlockGzip;
+
+  /// Number of threads decompressing block gzip files
+  unsigned numThreads;
+
   /// Zero Copy stream wrapping the STL input stream
   google::protobuf::io::IstreamInputStream* wrappedFileStream;
 
-  /// Optional Gzip stream to wrap the Zero Copy stream
-  google::protobuf::io::GzipInputStream* gzipStream;
+  /// Optional Gzip stream used instead of the Zero Copy stream
+  RestartableInputStream* gzipStream;
 
   /// Top-level zero-copy stream, either with compression or not
   google::protobuf::io::ZeroCopyInputStream* zeroCopyStream;
+
+  /// Counters returned by stats()
+  Stats readStats;
+
+  /// File offset the uncompressed zero-copy stream was created at
+  uint64_t streamOffset;
+
+  /// Optional index used to seek in gzip files
+  std::shared_ptr<const ProtoStreamIndex> index;
+
+  /// Start of the memory-mapped file, NULL if the file is not mapped
+  const uint8_t* mappedData;
+
+  /// Size of the memory-mapped file in bytes
+  size_t mappedSize;
+
+  /// Offset of the next message in the memory-mapped file
+  size_t mappedOffset;
+
+  /// Offset up to which consumed pages have been released
+  size_t mappedReleased;
 };
 
 #endif //__PROTO_PROTOIO_HH
@@ -0,0 +1,70 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "et_analyzer/et_trace_analyzer.h"
+
+using namespace std;
+
+static void printUsage(const char* prog) {
+  cerr << "usage: " << prog << " --input_filename <et_filename>"
+       << " [--input_filename ...] [--output_filename <filename>]"
+       << " [--format json|csv] [--num_threads <num_threads>]" << endl;
+}
+
+int main(int argc, char** argv) {
+  vector<string> input_filenames;
+  string output_filename;
+  string format = "json";
+  size_t num_threads = 0;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      if ((strcmp(argv[i], "--input_filename") == 0) && (i + 1 < argc)) {
+        input_filenames.push_back(argv[++i]);
+      } else if (
+          (strcmp(argv[i], "--output_filename") == 0) && (i + 1 < argc)) {
+        output_filename = argv[++i];
+      } else if ((strcmp(argv[i], "--format") == 0) && (i + 1 < argc)) {
+        format = argv[++i];
+      } else if ((strcmp(argv[i], "--num_threads") == 0) && (i + 1 < argc)) {
+        num_threads = stoul(argv[++i]);
+      } else {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+  } catch (const exception& e) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (input_filenames.empty() || ((format != "json") && (format != "csv"))) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    Chakra::ETTraceAnalyzer analyzer(num_threads);
+    vector<Chakra::ETTraceSummary> summaries =
+        analyzer.analyze(input_filenames);
+    // The summary goes to stdout unless a file is given
+    ofstream output_file;
+    if (!output_filename.empty()) {
+      output_file.open(output_filename);
+      if (!output_file) {
+        throw runtime_error("Failed to open output file: " + output_filename);
+      }
+    }
+    ostream& os = output_filename.empty() ? cout : output_file;
+    if (format == "json") {
+      Chakra::ETTraceAnalyzer::writeJson(os, summaries);
+    } else {
+      Chakra::ETTraceAnalyzer::writeCsv(os, summaries);
+    }
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,40 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "et_feeder/et_compiled_trace.h"
+
+using namespace std;
+
+static void printUsage(const char* prog) {
+  cerr << "usage: " << prog
+       << " --input_filename <et_filename> --output_filename <filename>"
+       << endl;
+}
+
+int main(int argc, char** argv) {
+  string input_filename;
+  string output_filename;
+  for (int i = 1; i < argc; ++i) {
+    if ((strcmp(argv[i], "--input_filename") == 0) && (i + 1 < argc)) {
+      input_filename = argv[++i];
+    } else if ((strcmp(argv[i], "--output_filename") == 0) && (i + 1 < argc)) {
+      output_filename = argv[++i];
+    } else {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (input_filename.empty() || output_filename.empty()) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    Chakra::ETCompiledTrace::compile(input_filename, output_filename);
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,54 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "et_feeder/et_iteration_fold.h"
+
+using namespace std;
+
+static void printUsage(const char* prog) {
+  cerr << "usage: " << prog << " --input_filename <et_filename>"
+       << " --output_filename <et_filename> [--unfold]" << endl;
+}
+
+int main(int argc, char** argv) {
+  string input_filename;
+  string output_filename;
+  bool unfold = false;
+  for (int i = 1; i < argc; ++i) {
+    if ((strcmp(argv[i], "--input_filename") == 0) && (i + 1 < argc)) {
+      input_filename = argv[++i];
+    } else if ((strcmp(argv[i], "--output_filename") == 0) && (i + 1 < argc)) {
+      output_filename = argv[++i];
+    } else if (strcmp(argv[i], "--unfold") == 0) {
+      unfold = true;
+    } else {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (input_filename.empty() || output_filename.empty()) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    if (unfold) {
+      Chakra::ETIterationFoldStats stats =
+          Chakra::ETIterationFold::unfold(input_filename, output_filename);
+      cout << stats.num_nodes << " nodes, " << stats.folded_nodes
+           << " of them replayed" << endl;
+    } else {
+      Chakra::ETIterationFoldStats stats =
+          Chakra::ETIterationFold::fold(input_filename, output_filename);
+      cout << stats.num_nodes << " nodes, " << stats.layout.iterations
+           << " iterations of " << stats.layout.iteration_nodes
+           << " nodes starting at node " << stats.layout.first_node << ", "
+           << stats.folded_nodes << " nodes folded" << endl;
+    }
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
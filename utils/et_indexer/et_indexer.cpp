@@ -0,0 +1,57 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "et_feeder/et_trace_index.h"
+
+using namespace std;
+
+static void printUsage(const char* prog) {
+  cerr << "usage: " << prog << " --input_filename <et_filename>"
+       << " [--output_filename <filename>] [--node_stride <num_nodes>]"
+       << " [--checkpoint_span_mb <mb>]" << endl;
+}
+
+int main(int argc, char** argv) {
+  string input_filename;
+  string output_filename;
+  uint32_t node_stride = Chakra::ETTraceIndex::kDefaultNodeStride;
+  uint64_t checkpoint_span = Chakra::ETTraceIndex::kDefaultCheckpointSpan;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      if ((strcmp(argv[i], "--input_filename") == 0) && (i + 1 < argc)) {
+        input_filename = argv[++i];
+      } else if (
+          (strcmp(argv[i], "--output_filename") == 0) && (i + 1 < argc)) {
+        output_filename = argv[++i];
+      } else if ((strcmp(argv[i], "--node_stride") == 0) && (i + 1 < argc)) {
+        node_stride = stoul(argv[++i]);
+      } else if (
+          (strcmp(argv[i], "--checkpoint_span_mb") == 0) && (i + 1 < argc)) {
+        checkpoint_span = stoull(argv[++i]) * 1024 * 1024;
+      } else {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+  } catch (const exception& e) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (input_filename.empty()) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (output_filename.empty()) {
+    output_filename = Chakra::ETTraceIndex::defaultFilename(input_filename);
+  }
+
+  try {
+    Chakra::ETTraceIndex::build(
+        input_filename, output_filename, node_stride, checkpoint_span);
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
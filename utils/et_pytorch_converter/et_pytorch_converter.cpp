@@ -0,0 +1,67 @@
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "et_converter/pytorch2chakra_converter.h"
+#include "et_feeder/thread_pool.h"
+
+using namespace std;
+
+static void printUsage(const char* prog) {
+  cerr << "usage: " << prog
+       << " --input_filename <json_filename> --output_filename <et_filename>"
+       << " [--input_filename ... --output_filename ...]"
+       << " --num_dims <num_dims> [--num_threads <num_threads>]" << endl;
+}
+
+int main(int argc, char** argv) {
+  vector<string> input_filenames;
+  vector<string> output_filenames;
+  uint32_t num_dims = 0;
+  size_t num_threads = 0;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      if ((strcmp(argv[i], "--input_filename") == 0) && (i + 1 < argc)) {
+        input_filenames.push_back(argv[++i]);
+      } else if (
+          (strcmp(argv[i], "--output_filename") == 0) && (i + 1 < argc)) {
+        output_filenames.push_back(argv[++i]);
+      } else if ((strcmp(argv[i], "--num_dims") == 0) && (i + 1 < argc)) {
+        num_dims = stoul(argv[++i]);
+      } else if ((strcmp(argv[i], "--num_threads") == 0) && (i + 1 < argc)) {
+        num_threads = stoul(argv[++i]);
+      } else {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+  } catch (const exception& e) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (input_filenames.empty() ||
+      (input_filenames.size() != output_filenames.size()) || (num_dims == 0)) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // One trace per rank, converted in parallel; a failed rank does not stop
+  // the others
+  Chakra::ThreadPool thread_pool(num_threads);
+  mutex error_mutex;
+  bool failed = false;
+  thread_pool.parallelFor(input_filenames.size(), [&](size_t i) {
+    try {
+      Chakra::PyTorch2ChakraConverter converter(
+          input_filenames[i], output_filenames[i], num_dims);
+      converter.convert();
+    } catch (const exception& e) {
+      lock_guard<mutex> lock(error_mutex);
+      cerr << input_filenames[i] << ": " << e.what() << endl;
+      failed = true;
+    }
+  });
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,55 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "et_feeder/et_trace_reorder.h"
+
+using namespace std;
+
+static void printUsage(const char* prog) {
+  cerr << "usage: " << prog << " --input_filename <et_filename>"
+       << " --output_filename <et_filename> [--renumber_ids]"
+       << " [--annotate_remaining_runtime]" << endl;
+}
+
+int main(int argc, char** argv) {
+  string input_filename;
+  string output_filename;
+  Chakra::ETTraceReorderOptions options;
+  for (int i = 1; i < argc; ++i) {
+    if ((strcmp(argv[i], "--input_filename") == 0) && (i + 1 < argc)) {
+      input_filename = argv[++i];
+    } else if ((strcmp(argv[i], "--output_filename") == 0) && (i + 1 < argc)) {
+      output_filename = argv[++i];
+    } else if (strcmp(argv[i], "--renumber_ids") == 0) {
+      options.renumber_ids = true;
+    } else if (strcmp(argv[i], "--annotate_remaining_runtime") == 0) {
+      options.annotate_remaining_runtime = true;
+    } else {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (input_filename.empty() || output_filename.empty()) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    Chakra::ETTraceReorderStats stats = Chakra::ETTraceReorder::reorder(
+        input_filename, output_filename, options);
+    cout << stats.num_nodes << " nodes, " << stats.forward_deps
+         << " forward dependencies, " << stats.missing_deps
+         << " missing dependencies, max back-reach "
+         << stats.input_max_back_reach << " -> " << stats.max_back_reach
+         << endl;
+    if (options.annotate_remaining_runtime) {
+      cout << "critical path runtime " << stats.critical_path_runtime
+           << endl;
+    }
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}